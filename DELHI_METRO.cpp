@@ -7,15 +7,154 @@
 #include <algorithm>
 #include <cmath> // for sqrt and pow
 #include <set>   // for set_intersection
+#include <cstdint>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <list>
+#include <map>
+#include <deque>
+#include <condition_variable>
+#include <iterator>
+#include <string_view>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <charconv>
+#include <random>
+#include <cstdio>
+#include <cerrno>
+#include <cctype>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
+// Build with -DMETRO_SEARCH_STATS=1 to count the work of every route search
+// and keep per-engine latency histograms (see --stats). Off by default, and
+// then the counting calls are empty and compile away.
+#ifndef METRO_SEARCH_STATS
+#define METRO_SEARCH_STATS 0
+#endif
+constexpr bool SEARCH_STATS = METRO_SEARCH_STATS != 0;
+
+// Upper bound on distinct metro lines a network may register
+const size_t MAX_METRO_LINES = 256;
+
+// Fixed-width bitmask of line ids. Common-line checks are a word-wise AND.
+struct LineSet {
+    static constexpr size_t WORDS = MAX_METRO_LINES / 64;
+    uint64_t words[WORDS] = {};
+
+    void set(size_t line) { words[line / 64] |= uint64_t(1) << (line % 64); }
+    bool test(size_t line) const { return (words[line / 64] >> (line % 64)) & 1; }
+
+    bool any() const {
+        for (size_t w = 0; w < WORDS; ++w) {
+            if (words[w]) return true;
+        }
+        return false;
+    }
+
+    // Lowest line id in the set, or -1 if the set is empty
+    int first() const {
+        for (size_t w = 0; w < WORDS; ++w) {
+            if (words[w]) return static_cast<int>(w * 64 + __builtin_ctzll(words[w]));
+        }
+        return -1;
+    }
+
+    LineSet operator&(const LineSet& other) const {
+        LineSet result;
+        for (size_t w = 0; w < WORDS; ++w) result.words[w] = words[w] & other.words[w];
+        return result;
+    }
+
+    LineSet operator|(const LineSet& other) const {
+        LineSet result;
+        for (size_t w = 0; w < WORDS; ++w) result.words[w] = words[w] | other.words[w];
+        return result;
+    }
+
+    // Lines in this set that are missing from other
+    LineSet without(const LineSet& other) const {
+        LineSet result;
+        for (size_t w = 0; w < WORDS; ++w) result.words[w] = words[w] & ~other.words[w];
+        return result;
+    }
+
+    bool operator==(const LineSet& other) const {
+        for (size_t w = 0; w < WORDS; ++w) {
+            if (words[w] != other.words[w]) return false;
+        }
+        return true;
+    }
+};
+
+// Interns metro line names (Yellow Line, Blue Line...) to small integer ids
+class LineRegistry {
+private:
+    vector<string> names;
+    unordered_map<string, uint16_t> ids;
+
+public:
+    // Return the id of a line, registering it on first use
+    uint16_t intern(const string& name) {
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        if (names.size() >= MAX_METRO_LINES) {
+            throw length_error("too many metro lines, raise MAX_METRO_LINES");
+        }
+        uint16_t id = static_cast<uint16_t>(names.size());
+        names.push_back(name);
+        ids[name] = id;
+        return id;
+    }
+
+    LineSet internAll(const vector<string>& lineNames) {
+        LineSet result;
+        for (const auto& name : lineNames) {
+            result.set(intern(name));
+        }
+        return result;
+    }
+
+    const string& name(size_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+    // Expand a line set back to names, in registration order
+    vector<string> namesOf(const LineSet& lines) const {
+        vector<string> result;
+        for (size_t id = 0; id < names.size(); ++id) {
+            if (lines.test(id)) result.push_back(names[id]);
+        }
+        return result;
+    }
+};
+
 // Station details including latitude, longitude, and metro lines
 struct Station {
     string name;
     double latitude;
     double longitude;
-    vector<string> metroLines;
+    LineSet metroLines;
     Station(string n, double lat, double lon) : name(n), latitude(lat), longitude(lon) {}
     Station() : name(""), latitude(0), longitude(0) {} // Default constructor
 };
@@ -23,1267 +162,7405 @@ struct Station {
 // Edge structure
 struct Edge {
     string to;
-    int distance;
-    vector<string> metroLines;  // Metro lines between stations
-    Edge(string t, int d, vector<string> lines) : to(t), distance(d), metroLines(lines) {}
+    int distance;           // metres
+    LineSet metroLines;  // Metro lines between stations
+    Edge(string t, int d, LineSet lines) : to(t), distance(d), metroLines(lines) {}
 };
 
-// Graph class using adjacency list representation
-class MetroGraph {
-private:
-    unordered_map<string, vector<Edge>> adjacencyList;
-    unordered_map<string, Station> stations;
+// Edge weights and route distances are whole metres; kilometres are for input and display
+const int METRES_PER_KM = 1000;
+
+int metresFromKm(double km) {
+    return static_cast<int>(lround(km * METRES_PER_KM));
+}
+
+// Metres as kilometres with three decimals, e.g. 23795 -> "23.795"
+string formatKm(int metres) {
+    char text[24];
+    snprintf(text, sizeof(text), "%d.%03d", metres / METRES_PER_KM, metres % METRES_PER_KM);
+    return text;
+}
+
+// Read-only CSR arrays a search runs on, owned by a CompactGraph or mapped from a snapshot file
+struct GraphView {
+    uint32_t stationCount;
+    const uint32_t* offsets;    // edges of u are [offsets[u], offsets[u + 1])
+    const uint32_t* targets;
+    const int* weights;
+    const uint8_t* edgeState = nullptr;     // per-edge closure flags of a LiveNetwork, null when all are open
+
+    bool open(uint32_t e) const { return !edgeState || edgeState[e] == 0; }
+};
 
-public:
-    // Function to add an undirected edge between two stations
-    void addEdge(string station1, string station2, int distance, vector<string> lines) {
-        adjacencyList[station1].emplace_back(station2, distance, lines);
-        adjacencyList[station2].emplace_back(station1, distance, lines);
+// Frozen compressed sparse row (CSR) copy of the adjacency list.
+// Station names are interned once to dense ids, so a search only walks flat integer arrays.
+struct CompactGraph {
+    vector<string> names;                       // id -> station name
+    unordered_map<string, uint32_t> ids;        // station name -> id
+    vector<uint32_t> offsets;                   // edges of u are [offsets[u], offsets[u + 1])
+    vector<uint32_t> targets;
+    vector<int> weights;
+    vector<LineSet> edgeLines;                  // lines serving each CSR edge
+
+    uint32_t stationCount() const { return static_cast<uint32_t>(names.size()); }
+    size_t edgeCount() const { return targets.size(); }
+
+    // Look up the id of a station, returns false if the name is unknown
+    bool lookup(const string& name, uint32_t& id) const {
+        auto it = ids.find(name);
+        if (it == ids.end()) {
+            return false;
+        }
+        id = it->second;
+        return true;
     }
 
-    // Dijkstra's algorithm to find shortest path from source to destination
-    pair<vector<string>, int> dijkstra(string source, string destination) {
-        // Priority queue for Dijkstra's algorithm (min-heap)
-        priority_queue<pair<int, string>, vector<pair<int, string>>, greater<pair<int, string>>> pq;
-
-        // Distance map
-        unordered_map<string, int> distance;
-        for (auto& pair : adjacencyList) {
-            distance[pair.first] = numeric_limits<int>::max();
-        }
-        distance[source] = 0;
+    GraphView view() const {
+        return GraphView{stationCount(), offsets.data(), targets.data(), weights.data()};
+    }
 
-        // Previous station map for path reconstruction
-        unordered_map<string, string> previous;
+    void clear() {
+        names.clear();
+        ids.clear();
+        offsets.clear();
+        targets.clear();
+        weights.clear();
+        edgeLines.clear();
+    }
+};
 
-        // Insert source into priority queue
-        pq.push({0, source});
+// Monotone priority queue for non-negative integer keys: every key pushed
+// must be at least the last key popped, which Dijkstra guarantees. Items sit
+// in bucket 0 when their key equals the last popped key, otherwise in the
+// bucket of the highest bit where they differ from it. Popping from an empty
+// bucket 0 takes the lowest non-empty bucket, makes its minimum the new last
+// key and redistributes it into strictly lower buckets, so each item moves at
+// most 32 times and push is O(1) with no comparisons against other items.
+struct RadixHeap {
+    static constexpr int BUCKETS = 33;
+
+    vector<pair<int, uint32_t>> buckets[BUCKETS];
+    uint64_t occupied = 0;      // bit b set when buckets[b] is non-empty
+    int last = 0;
+
+    void clear() {
+        for (; occupied; occupied &= occupied - 1) {
+            buckets[__builtin_ctzll(occupied)].clear();
+        }
+        last = 0;
+    }
 
-        while (!pq.empty()) {
-            string u = pq.top().second;
-            int dist = pq.top().first;
-            pq.pop();
+    void push(int key, uint32_t v) {
+        int b = bucketOf(key);
+        buckets[b].emplace_back(key, v);
+        occupied |= uint64_t(1) << b;
+    }
 
-            // Stop early if we reach the destination
-            if (u == destination) {
-                break;
+    pair<int, uint32_t> pop() {
+        if (!(occupied & 1)) {
+            int b = __builtin_ctzll(occupied);
+            vector<pair<int, uint32_t>>& bucket = buckets[b];
+            last = bucket[0].first;
+            for (const auto& item : bucket) {
+                last = min(last, item.first);
             }
-
-            // If current distance is greater than known distance, skip
-            if (dist > distance[u]) {
-                continue;
+            for (const auto& item : bucket) {
+                int to = bucketOf(item.first);
+                buckets[to].push_back(item);
+                occupied |= uint64_t(1) << to;
             }
+            bucket.clear();
+            occupied &= ~(uint64_t(1) << b);
+        }
+        pair<int, uint32_t> top = buckets[0].back();
+        buckets[0].pop_back();
+        if (buckets[0].empty()) {
+            occupied &= ~uint64_t(1);
+        }
+        return top;
+    }
 
-            // Explore neighbors
-            for (const auto& edge : adjacencyList[u]) {
-                string v = edge.to;
-                int weight = edge.distance;
-                int new_dist = dist + weight;
+    bool empty() const { return occupied == 0; }
 
-                // Update shortest path to neighbor if found a shorter path
-                if (new_dist < distance[v]) {
-                    distance[v] = new_dist;
-                    previous[v] = u;
-                    pq.push({new_dist, v});
-                }
-            }
-        }
+private:
+    int bucketOf(int key) const {
+        uint32_t diff = static_cast<uint32_t>(key ^ last);
+        return diff == 0 ? 0 : 32 - __builtin_clz(diff);
+    }
+};
 
-        // Reconstruct path
-        vector<string> path;
-        int totalDistance = distance[destination];
-        if (totalDistance == numeric_limits<int>::max()) {
-            return {path, totalDistance}; // No path found
+// Work done by one search besides the stations it settled. Counted only in
+// METRO_SEARCH_STATS builds, otherwise these stay zero.
+struct SearchCounters {
+    uint64_t pushes = 0;        // heap insertions
+    uint64_t stalePops = 0;     // popped entries already beaten by a shorter distance
+    uint64_t relaxed = 0;       // edges scanned out of settled stations
+
+    void add(const SearchCounters& other) {
+        pushes += other.pushes;
+        stalePops += other.stalePops;
+        relaxed += other.relaxed;
+    }
+};
+
+// Scratch state for one search at a time over a CompactGraph. Hold one per
+// caller (or per thread) and pass it to every query: distances are reset lazily
+// by bumping an epoch instead of refilling the arrays, and the heap keeps its
+// capacity, so a steady stream of queries does no heap allocation. Cost is
+// the type distances add up in: int metres for station searches.
+template <typename Cost>
+struct BasicSearchWorkspace {
+    static constexpr Cost INF = numeric_limits<Cost>::max();
+    static constexpr uint32_t NONE = numeric_limits<uint32_t>::max();
+
+    vector<Cost> distance;
+    vector<uint32_t> previous;
+    vector<uint32_t> stamp;         // distance/previous are valid only where stamp == epoch
+    uint32_t epoch = 0;
+    vector<pair<Cost, uint32_t>> heap;
+    RadixHeap radix;                // queue of searchPathRadix(), in place of heap
+    vector<int> potential;          // goal-directed searches cache a per-station bound here
+    size_t settled = 0;             // stations settled by the last search
+    SearchCounters counters;        // the rest of its work, see METRO_SEARCH_STATS
+
+    // Start a new search over n stations
+    void prepare(uint32_t n) {
+        if (stamp.size() < n) {
+            distance.resize(n);
+            previous.resize(n);
+            potential.resize(n);
+            stamp.resize(n, 0);
         }
-        for (string at = destination; !at.empty(); at = previous[at]) {
-            path.push_back(at);
-            if (at == source) break;
+        if (++epoch == 0) {
+            // Epoch wrapped around, stale stamps could look current again
+            fill(stamp.begin(), stamp.end(), 0);
+            epoch = 1;
         }
-        reverse(path.begin(), path.end());
+        heap.clear();
+        radix.clear();
+        settled = 0;
+        if constexpr (SEARCH_STATS) {
+            counters = SearchCounters();
+        }
+    }
 
-        return {path, totalDistance};
+    // Hot-path counters, empty unless built with METRO_SEARCH_STATS
+    void countPush() {
+        if constexpr (SEARCH_STATS) ++counters.pushes;
+    }
+    void countStale() {
+        if constexpr (SEARCH_STATS) ++counters.stalePops;
+    }
+    void countRelaxed(uint32_t edges) {
+        if constexpr (SEARCH_STATS) counters.relaxed += edges;
     }
 
-    // Function to calculate Euclidean distance between two stations (based on latitude and longitude)
-    double toRadians(double degree) {
-        return degree * M_PI / 180.0;
+    Cost distanceOf(uint32_t v) const { return stamp[v] == epoch ? distance[v] : INF; }
+    uint32_t previousOf(uint32_t v) const { return stamp[v] == epoch ? previous[v] : NONE; }
+    bool reached(uint32_t v) const { return stamp[v] == epoch; }
+
+    void update(uint32_t v, Cost dist, uint32_t parent) {
+        stamp[v] = epoch;
+        distance[v] = dist;
+        previous[v] = parent;
     }
 
-    double calculateDistance(string station1, string station2) {
-        double lat1 = stations[station1].latitude;
-        double lon1 = stations[station1].longitude;
-        double lat2 = stations[station2].latitude;
-        double lon2 = stations[station2].longitude;
+    // Min-heap on (distance, station)
+    void push(Cost dist, uint32_t v) {
+        countPush();
+        heap.emplace_back(dist, v);
+        push_heap(heap.begin(), heap.end(), greater<pair<Cost, uint32_t>>());
+    }
 
-        double lat1Rad = toRadians(lat1);
-        double lon1Rad = toRadians(lon1);
-        double lat2Rad = toRadians(lat2);
-        double lon2Rad = toRadians(lon2);
+    pair<Cost, uint32_t> pop() {
+        pop_heap(heap.begin(), heap.end(), greater<pair<Cost, uint32_t>>());
+        pair<Cost, uint32_t> top = heap.back();
+        heap.pop_back();
+        return top;
+    }
 
-        // Using Haversine formula for simplicity (considering Earth as a perfect sphere)
-        double dlat = lat2Rad - lat1Rad;
-        double dlon = lon2Rad - lon1Rad;
+    bool heapEmpty() const { return heap.empty(); }
+    const pair<Cost, uint32_t>& top() const { return heap.front(); }
 
-        double a = sin(dlat / 2) * sin(dlat / 2) +
-                   cos(lat1Rad) * cos(lat2Rad) *
-                   sin(dlon / 2) * sin(dlon / 2);
-        double c = 2 * atan2(sqrt(a), sqrt(1 - a));
+    // Walk the parent links back from destination, path comes out source first
+    void tracePath(uint32_t source, uint32_t destination, vector<uint32_t>& path) const {
+        path.clear();
+        for (uint32_t at = destination; at != NONE; at = previousOf(at)) {
+            path.push_back(at);
+            if (at == source) break;
+        }
+        reverse(path.begin(), path.end());
+    }
+};
 
-        // Radius of Earth in kilometers (approximate)
-        const double radius = 6371.0;
+using SearchWorkspace = BasicSearchWorkspace<int>;
 
-        // Distance in kilometers
-        double distance = radius * c;
+// Point-to-point engines a query can be routed through
+enum RouteEngine {
+    ENGINE_DIJKSTRA,
+    ENGINE_BIDIRECTIONAL,
+    ENGINE_ASTAR,
+    ENGINE_CH,
+    ENGINE_RADIX,
+    ENGINE_COUNT
+};
 
-        return distance;
+const char* const ENGINE_NAMES[ENGINE_COUNT] = {"dijkstra", "bidirectional", "astar", "ch", "radix"};
+
+bool parseEngine(const string& name, RouteEngine& engine) {
+    for (int e = 0; e < ENGINE_COUNT; ++e) {
+        if (name == ENGINE_NAMES[e]) {
+            engine = static_cast<RouteEngine>(e);
+            return true;
+        }
     }
+    return false;
+}
+
+// The other searches SearchStats accounts, numbered on from the engines
+enum SearchKind {
+    SEARCH_TREE = ENGINE_COUNT,     // one-to-all searchTree()
+    SEARCH_K_SHORTEST,              // a whole Yen query, all of its spur searches
+    SEARCH_FARE_BAND,               // budget-bounded reachableWithin()
+    SEARCH_TRANSFERS,               // TransferRouter::route()
+    SEARCH_PARETO,                  // TransferRouter::paretoRoutes()
+    SEARCH_KIND_COUNT
+};
 
-    // Function to calculate fare based on distance
-    double calculateFare(int distance) {
-        // Example fare calculation based on Delhi Metro fare structure
-        if (distance <= 2) {
-            return 10.0;
-        } else if (distance > 2 && distance <= 5) {
-            return 20.0;
-        } else if (distance > 5 && distance <= 12) {
-            return 30.0;
-        } else if (distance > 12 && distance <= 21) {
-            return 40.0;
-        } else if (distance > 21 && distance <= 32) {
-            return 50.0;
-        } else {
-            return 60.0;
+const char* const SEARCH_KIND_NAMES[SEARCH_KIND_COUNT] = {
+    "dijkstra", "bidirectional", "astar", "ch", "radix", "tree", "k-shortest", "fare-band", "transfers", "pareto"};
+
+// HDR-style latency histogram over nanoseconds. Values below 32 get a bucket
+// each; above that every power of two is split into 16 linear sub-buckets, so
+// no bucket is wider than 1/16 of the values it holds, over the whole range
+// of a uint64_t in under a thousand counters.
+struct LatencyHistogram {
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    uint64_t counts[BUCKETS] = {};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t maximum = 0;
+
+    static int bucketOf(uint64_t value) {
+        if (value < 2 * SUB_BUCKETS) {
+            return static_cast<int>(value);
         }
+        int shift = 63 - __builtin_clzll(value) - SUB_BITS;
+        return shift * SUB_BUCKETS + static_cast<int>(value >> shift);
     }
 
-    // Function to add a station with details including latitude and longitude
-    void addStation(string name, double latitude, double longitude, vector<string> metroLines) {
-        stations[name] = Station(name, latitude, longitude);
-        stations[name].metroLines = metroLines;
+    // Smallest and largest value that land in bucket b
+    static uint64_t lowest(int b) {
+        if (b < 2 * SUB_BUCKETS) {
+            return b;
+        }
+        int shift = b / SUB_BUCKETS - 1;
+        return uint64_t(b % SUB_BUCKETS + SUB_BUCKETS) << shift;
+    }
+    static uint64_t highest(int b) {
+        return b + 1 < BUCKETS ? lowest(b + 1) - 1 : numeric_limits<uint64_t>::max();
     }
 
-    // Function to get the metro lines common to two stations
-    vector<string> getCommonLines(const string& station1, const string& station2) {
-        vector<string> commonLines;
-        const auto& lines1 = stations[station1].metroLines;
-        const auto& lines2 = stations[station2].metroLines;
+    void record(uint64_t value) {
+        ++counts[bucketOf(value)];
+        ++total;
+        sum += value;
+        maximum = max(maximum, value);
+    }
 
-        set_intersection(lines1.begin(), lines1.end(),
-                         lines2.begin(), lines2.end(),
-                         back_inserter(commonLines));
-        return commonLines;
+    void merge(const LatencyHistogram& other) {
+        for (int b = 0; b < BUCKETS; ++b) {
+            counts[b] += other.counts[b];
+        }
+        total += other.total;
+        sum += other.sum;
+        maximum = max(maximum, other.maximum);
     }
 
-    // Function to get metro lines for a station
-    vector<string> getMetroLines(const string& station) const {
-        return stations.at(station).metroLines;
+    // Value at or below which pct percent of the recorded values fall, to bucket precision
+    uint64_t percentile(double pct) const {
+        uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(pct / 100.0 * total)));
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; ++b) {
+            seen += counts[b];
+            if (seen >= rank) {
+                return min(highest(b), maximum);
+            }
+        }
+        return maximum;
     }
 };
 
-int main() {
-    MetroGraph delhiMetro;
-
-    // Adding metro stations and connections
-delhiMetro.addStation("Samaypur Badli", 28.748035, 77.134733, {"Yellow Line"});
-delhiMetro.addStation("Rohini Sector 18, 19", 28.736278, 77.124249, {"Yellow Line"});
-delhiMetro.addStation("Haiderpur Badli Mor", 28.721776, 77.154535, {"Yellow Line"});
-delhiMetro.addStation("Jahangirpuri", 28.716939, 77.170724, {"Yellow Line"});
-delhiMetro.addStation("Adarsh Nagar", 28.714401, 77.167288, {"Yellow Line"});
-delhiMetro.addStation("Azadpur", 28.704235, 77.170330, {"Yellow Line"});
-delhiMetro.addStation("Model Town", 28.704746, 77.185037, {"Yellow Line"});
-delhiMetro.addStation("GTB Nagar", 28.699882, 77.189732, {"Yellow Line"});
-delhiMetro.addStation("Vishwavidyalaya", 28.697151, 77.210441, {"Yellow Line"});
-delhiMetro.addStation("Vidhan Sabha", 28.684715, 77.217919, {"Yellow Line"});
-delhiMetro.addStation("Civil Lines", 28.675192, 77.225668, {"Yellow Line"});
-delhiMetro.addStation("Kashmere Gate", 28.667856, 77.228885, {"Yellow Line"});
-delhiMetro.addStation("Chandni Chowk", 28.657420, 77.231109, {"Yellow Line"});
-delhiMetro.addStation("Chawri Bazar", 28.650121, 77.229249, {"Yellow Line"});
-delhiMetro.addStation("New Delhi", 28.640382, 77.224842, {"Yellow Line"});
-delhiMetro.addStation("Rajiv Chowk", 28.632782, 77.219675, {"Yellow Line"});
-delhiMetro.addStation("Patel Chowk", 28.627567, 77.212830, {"Yellow Line"});
-delhiMetro.addStation("Central Secretariat", 28.618566, 77.208220, {"Yellow Line"});
-delhiMetro.addStation("Udyog Bhawan", 28.609851, 77.205502, {"Yellow Line"});
-delhiMetro.addStation("Lok Kalyan Marg", 28.599467, 77.204842, {"Yellow Line"});
-delhiMetro.addStation("Jor Bagh", 28.589578, 77.206206, {"Yellow Line"});
-delhiMetro.addStation("INA", 28.578802, 77.206432, {"Yellow Line"});
-delhiMetro.addStation("AIIMS", 28.567786, 77.209062, {"Yellow Line"});
-delhiMetro.addStation("Green Park", 28.558330, 77.207450, {"Yellow Line"});
-delhiMetro.addStation("Hauz Khas", 28.545656, 77.206173, {"Yellow Line"});
-delhiMetro.addStation("Malviya Nagar", 28.528545, 77.204276, {"Yellow Line"});
-delhiMetro.addStation("Saket", 28.518198, 77.206028, {"Yellow Line"});
-delhiMetro.addStation("Qutab Minar", 28.508559, 77.201447, {"Yellow Line"});
-delhiMetro.addStation("Chhatarpur", 28.500326, 77.175646, {"Yellow Line"});
-delhiMetro.addStation("Sultanpur", 28.485960, 77.156209, {"Yellow Line"});
-delhiMetro.addStation("Ghitorni", 28.474529, 77.146862, {"Yellow Line"});
-delhiMetro.addStation("Arjan Garh", 28.461856, 77.137522, {"Yellow Line"});
-delhiMetro.addStation("Guru Dronacharya", 28.456780, 77.121756, {"Yellow Line"});
-delhiMetro.addStation("Sikanderpur", 28.481986, 77.083438, {"Yellow Line"});
-delhiMetro.addStation("MG Road", 28.470822, 77.072855, {"Yellow Line"});
-delhiMetro.addStation("IFFCO Chowk", 28.467601, 77.064324, {"Yellow Line"});
-delhiMetro.addStation("HUDA City Centre", 28.459940, 77.050694, {"Yellow Line"});
-
-delhiMetro.addStation("Shaheed Sthal (New Bus Adda)", 28.682328, 77.453100, {"Red Line"});
-delhiMetro.addStation("Hindon River", 28.676695, 77.434548, {"Red Line"});
-delhiMetro.addStation("Arthala", 28.674124, 77.420869, {"Red Line"});
-delhiMetro.addStation("Mohan Nagar", 28.668681, 77.402053, {"Red Line"});
-delhiMetro.addStation("Shyam Park", 28.671632, 77.386873, {"Red Line"});
-delhiMetro.addStation("Major Mohit Sharma Rajendra Nagar", 28.674178, 77.374406, {"Red Line"});
-delhiMetro.addStation("Raj Bagh", 28.676860, 77.361217, {"Red Line"});
-delhiMetro.addStation("Shaheed Nagar", 28.678568, 77.347793, {"Red Line"});
-delhiMetro.addStation("Dilshad Garden", 28.682053, 77.327570, {"Red Line"});
-delhiMetro.addStation("Jhilmil", 28.675620, 77.314731, {"Red Line"});
-delhiMetro.addStation("Mansarovar Park", 28.672283, 77.305071, {"Red Line"});
-delhiMetro.addStation("Shahdara", 28.670072, 77.291874, {"Red Line"});
-delhiMetro.addStation("Welcome", 28.672592, 77.279591, {"Red Line"});
-delhiMetro.addStation("Seelampur", 28.671353, 77.266329, {"Red Line"});
-delhiMetro.addStation("Shastri Park", 28.668951, 77.250956, {"Red Line"});
-delhiMetro.addStation("Kashmere Gate", 28.667856, 77.228885, {"Red Line"});
-delhiMetro.addStation("Tis Hazari", 28.664364, 77.216701, {"Red Line"});
-delhiMetro.addStation("Pulbangash", 28.664255, 77.206060, {"Red Line"});
-delhiMetro.addStation("Pratap Nagar", 28.664196, 77.193961, {"Red Line"});
-delhiMetro.addStation("Shastri Nagar", 28.666105, 77.179902, {"Red Line"});
-delhiMetro.addStation("Inderlok", 28.667297, 77.168057, {"Red Line"});
-delhiMetro.addStation("Kanhaiya Nagar", 28.682240, 77.157448, {"Red Line"});
-delhiMetro.addStation("Keshav Puram", 28.696642, 77.153415, {"Red Line"});
-delhiMetro.addStation("Netaji Subhash Place", 28.698713, 77.149625, {"Red Line"});
-delhiMetro.addStation("Shakurpur", 28.701120, 77.141533, {"Red Line"});
-delhiMetro.addStation("Punjabi Bagh West", 28.705022, 77.131308, {"Red Line"});
-delhiMetro.addStation("Ashok Park Main", 28.698374, 77.125218, {"Red Line"});
-delhiMetro.addStation("Satguru Ram Singh Marg", 28.685384, 77.117357, {"Red Line"});
-delhiMetro.addStation("Kirti Nagar", 28.678474, 77.120043, {"Red Line"});
-
-delhiMetro.addStation("Kashmere Gate", 28.6672231, 77.2307327, {"Violet Line"});
-delhiMetro.addStation("Lal Qila", 28.6564738, 77.2410157, {"Violet Line"});
-delhiMetro.addStation("Jama Masjid", 28.6505282, 77.2360851, {"Violet Line"});
-delhiMetro.addStation("Delhi Gate", 28.6429863, 77.2433636, {"Violet Line"});
-delhiMetro.addStation("ITO", 28.6285392, 77.2447288, {"Violet Line"});
-delhiMetro.addStation("Mandi House", 28.625755, 77.241033, {"Violet Line"});
-delhiMetro.addStation("Janpath", 28.625802, 77.218707, {"Violet Line"});
-delhiMetro.addStation("Central Secretariat", 28.614707, 77.209045, {"Violet Line"});
-delhiMetro.addStation("Khan Market", 28.6007813, 77.2272815, {"Violet Line"});
-delhiMetro.addStation("Jawaharlal Nehru Stadium", 28.5855817, 77.2402333, {"Violet Line"});
-delhiMetro.addStation("Jangpura", 28.5744807, 77.2440081, {"Violet Line"});
-delhiMetro.addStation("Lajpat Nagar", 28.5686478, 77.2439311, {"Violet Line"});
-delhiMetro.addStation("Moolchand", 28.5583036, 77.237691, {"Violet Line"});
-delhiMetro.addStation("Kailash Colony", 28.5487422, 77.240526, {"Violet Line"});
-delhiMetro.addStation("Nehru Place", 28.5411366, 77.2463884, {"Violet Line"});
-delhiMetro.addStation("Kalkaji Mandir", 28.5316742, 77.2588722, {"Violet Line"});
-delhiMetro.addStation("Govind Puri", 28.5219614, 77.2670347, {"Violet Line"});
-delhiMetro.addStation("Okhla NSIC", 28.512188, 77.269095, {"Violet Line"});
-delhiMetro.addStation("Harkesh Nagar Okhla", 28.502588, 77.269853, {"Violet Line"});
-delhiMetro.addStation("Jasola Apollo", 28.484569, 77.269929, {"Violet Line"});
-delhiMetro.addStation("Sarita Vihar", 28.474222, 77.275438, {"Violet Line"});
-delhiMetro.addStation("Mohan Estate", 28.459574, 77.282737, {"Violet Line"});
-delhiMetro.addStation("Tughlakabad", 28.441823, 77.284299, {"Violet Line"});
-delhiMetro.addStation("Badarpur Border", 28.424145, 77.286287, {"Violet Line"});
-delhiMetro.addStation("Sarai", 28.408067, 77.291271, {"Violet Line"});
-delhiMetro.addStation("NHPC Chowk", 28.393115, 77.301728, {"Violet Line"});
-delhiMetro.addStation("Mewala Maharajpur", 28.380705, 77.308161, {"Violet Line"});
-delhiMetro.addStation("Sector 28", 28.368541, 77.314703, {"Violet Line"});
-delhiMetro.addStation("Badkhal Mor", 28.353668, 77.323024, {"Violet Line"});
-delhiMetro.addStation("Old Faridabad", 28.340175, 77.327356, {"Violet Line"});
-delhiMetro.addStation("Neelam Chowk Ajronda", 28.319508, 77.326519, {"Violet Line"});
-delhiMetro.addStation("Bata Chowk", 28.306912, 77.321365, {"Violet Line"});
-delhiMetro.addStation("Escorts Mujesar", 28.289001, 77.313548, {"Violet Line"});
-
-
-delhiMetro.addStation("Majlis Park", 28.7106, 77.1386, {"Pink Line"});
-delhiMetro.addStation("Keshav Puram", 28.7091, 77.1357, {"Pink Line"});
-delhiMetro.addStation("Kanhaiya Nagar", 28.7069, 77.1321, {"Pink Line"});
-delhiMetro.addStation("Shastri Nagar", 28.7055, 77.1305, {"Pink Line"});
-delhiMetro.addStation("Tis Hazari", 28.7023, 77.1328, {"Pink Line"});
-delhiMetro.addStation("Karam Pura", 28.6921, 77.1334, {"Pink Line"});
-delhiMetro.addStation("Maya Puri", 28.6863, 77.1294, {"Pink Line"});
-delhiMetro.addStation("Patel Nagar", 28.6920, 77.1370, {"Pink Line"});
-delhiMetro.addStation("Kirti Nagar", 28.6903, 77.1513, {"Pink Line"});
-delhiMetro.addStation("Rajouri Garden", 28.6614, 77.1398, {"Pink Line"});
-delhiMetro.addStation("Maharani Bagh", 28.5858, 77.2501, {"Pink Line"});
-delhiMetro.addStation("Hazrat Nizamuddin", 28.5863, 77.2453, {"Pink Line"});
-delhiMetro.addStation("Jangpura", 28.5948, 77.2498, {"Pink Line"});
-delhiMetro.addStation("Sarai Kale Khan", 28.5806, 77.2596, {"Pink Line"});
-delhiMetro.addStation("New Ashok Nagar", 28.6102, 77.2728, {"Pink Line"});
-delhiMetro.addStation("Noida City Centre", 28.5866, 77.3265, {"Pink Line"});
-delhiMetro.addStation("Sector 15", 28.5966, 77.3318, {"Pink Line"});
-delhiMetro.addStation("Sector 18", 28.5883, 77.3298, {"Pink Line"});
-delhiMetro.addStation("Botanical Garden", 28.5852, 77.3364, {"Pink Line"});
-delhiMetro.addStation("Sector 52", 28.5834, 77.3425, {"Pink Line"});
-delhiMetro.addStation("Sector 61", 28.5795, 77.3401, {"Pink Line"});
-delhiMetro.addStation("Sector 62", 28.5722, 77.3355, {"Pink Line"});
-delhiMetro.addStation("Sector 63", 28.5726, 77.3349, {"Pink Line"});
-delhiMetro.addStation("IIT Delhi", 28.5531, 77.1915, {"Pink Line"});
-delhiMetro.addStation("Hauz Khas", 28.5505, 77.2075, {"Pink Line"});
-delhiMetro.addStation("Green Park", 28.5476, 77.2046, {"Pink Line"});
-delhiMetro.addStation("Aurobindo Place", 28.5396, 77.2201, {"Pink Line"});
-delhiMetro.addStation("Sarai Jullena", 28.5616, 77.2514, {"Pink Line"});
-delhiMetro.addStation("Ashram", 28.5664, 77.2610, {"Pink Line"});
-delhiMetro.addStation("Bhikaji Cama Place", 28.5843, 77.1990, {"Pink Line"});
-delhiMetro.addStation("Durgabai Deshmukh South Campus", 28.5783, 77.2073, {"Pink Line"});
-delhiMetro.addStation("East Azad Nagar", 28.6422, 77.2810, {"Pink Line"});
-delhiMetro.addStation("East Vinod Nagar – Mayur Vihar-II", 28.6347, 77.2886, {"Pink Line"});
-delhiMetro.addStation("ESI Hospital", 28.6152, 77.2748, {"Pink Line"});
-delhiMetro.addStation("Gokulpuri", 28.6952, 77.2653, {"Pink Line"});
-delhiMetro.addStation("IP Extension", 28.6368, 77.2971, {"Pink Line"});
-delhiMetro.addStation("Jaffrabad", 28.6945, 77.2610, {"Pink Line"});
-delhiMetro.addStation("Kalindi Kunj", 28.5324, 77.2826, {"Pink Line"});
-
-
-delhiMetro.addStation("Janakpuri West", 28.586826, 77.057601, {"Magenta Line"});
-delhiMetro.addStation("Dabri Mor", 28.581026, 77.075396, {"Magenta Line"});
-delhiMetro.addStation("Dashrathpuri", 28.580927, 77.084861, {"Magenta Line"});
-delhiMetro.addStation("Palam", 28.573446, 77.099407, {"Magenta Line"});
-delhiMetro.addStation("Sadar Bazar Cantonment", 28.568754, 77.108571, {"Magenta Line"});
-delhiMetro.addStation("Terminal 1 IGI Airport", 28.558262, 77.095366, {"Magenta Line"});
-delhiMetro.addStation("Shankar Vihar", 28.552682, 77.093794, {"Magenta Line"});
-delhiMetro.addStation("Vasant Vihar", 28.558855, 77.112676, {"Magenta Line"});
-delhiMetro.addStation("Munirka", 28.561509, 77.104609, {"Magenta Line"});
-delhiMetro.addStation("RK Puram", 28.565783, 77.112351, {"Magenta Line"});
-delhiMetro.addStation("IIT", 28.553322, 77.164053, {"Magenta Line"});
-delhiMetro.addStation("Hauz Khas", 28.549788, 77.203232, {"Magenta Line"});
-delhiMetro.addStation("Panchsheel Park", 28.543213, 77.213477, {"Magenta Line"});
-delhiMetro.addStation("Chirag Delhi", 28.543213, 77.213477, {"Magenta Line"});
-delhiMetro.addStation("Greater Kailash", 28.533080, 77.240260, {"Magenta Line"});
-delhiMetro.addStation("Nehru Enclave", 28.533124, 77.251130, {"Magenta Line"});
-delhiMetro.addStation("Kalkaji Mandir", 28.531680, 77.259387, {"Magenta Line"});
-delhiMetro.addStation("Okhla NSIC", 28.531077, 77.279527, {"Magenta Line"});
-delhiMetro.addStation("Sukhdev Vihar", 28.529560, 77.291082, {"Magenta Line"});
-delhiMetro.addStation("Jamia Milia Islamiya", 28.530743, 77.306484, {"Magenta Line"});
-delhiMetro.addStation("Okhla Vihar", 28.529877, 77.319420, {"Magenta Line"});
-delhiMetro.addStation("Jasola Vihar Shaheen Bagh", 28.523699, 77.332795, {"Magenta Line"});
-delhiMetro.addStation("Kalindi Kunj", 28.510310, 77.336334, {"Magenta Line"});
-delhiMetro.addStation("Okhla Bird Sanctuary", 28.502383, 77.332879, {"Magenta Line"});
-delhiMetro.addStation("Botanical Garden", 28.506285, 77.334550, {"Magenta Line"});
-
-
-delhiMetro.addStation("New Delhi", 28.640196, 77.219638, {"Airport Express Line"});
-delhiMetro.addStation("Shivaji Stadium", 28.631508, 77.216059, {"Airport Express Line"});
-delhiMetro.addStation("Dhaula Kuan", 28.603580, 77.189060, {"Airport Express Line"});
-delhiMetro.addStation("Delhi Aerocity", 28.572211, 77.195070, {"Airport Express Line"});
-delhiMetro.addStation("Airport T3", 28.570166, 77.109497, {"Airport Express Line"});
-delhiMetro.addStation("Dwarka Sector 21", 28.561731, 77.023850, {"Airport Express Line"});
-delhiMetro.addStation("Yashobhoomi Dwarka Sector 25", 28.559616, 77.016670, {"Airport Express Line"});
-
-
-delhiMetro.addStation("Noida Electronic City", 28.5602, 77.3192, {"Blue Line"});
-delhiMetro.addStation("Noida Sector 62", 28.5933, 77.3324, {"Blue Line"});
-delhiMetro.addStation("Noida Sector 59", 28.5956, 77.3383, {"Blue Line"});
-delhiMetro.addStation("Noida Sector 61", 28.5976, 77.3398, {"Blue Line"});
-delhiMetro.addStation("Noida Sector 52", 28.5927, 77.3378, {"Blue Line"});
-delhiMetro.addStation("Noida Sector 34", 28.5941, 77.3284, {"Blue Line"});
-delhiMetro.addStation("Noida City Centre", 28.5964, 77.3265, {"Blue Line"});
-delhiMetro.addStation("Golf Course", 28.5940, 77.3585, {"Blue Line"});
-delhiMetro.addStation("Botanical Garden", 28.5727, 77.3290, {"Blue Line"});
-delhiMetro.addStation("Noida Sector 18", 28.5855, 77.3378, {"Blue Line"});
-delhiMetro.addStation("Noida Sector 16", 28.5960, 77.3307, {"Blue Line"});
-delhiMetro.addStation("Noida Sector 15", 28.5965, 77.3302, {"Blue Line"});
-delhiMetro.addStation("New Ashok Nagar", 28.5914, 77.3166, {"Blue Line"});
-delhiMetro.addStation("Mayur Vihar Extension", 28.5933, 77.3042, {"Blue Line"});
-delhiMetro.addStation("Mayur Vihar I", 28.5941, 77.3064, {"Blue Line"});
-delhiMetro.addStation("Akshardham", 28.6139, 77.2757, {"Blue Line"});
-delhiMetro.addStation("Yamuna Bank", 28.6133, 77.2928, {"Blue Line"});
-delhiMetro.addStation("Indraprastha", 28.6128, 77.2908, {"Blue Line"});
-delhiMetro.addStation("Supreme Court (Pragati Maidan)", 28.6115, 77.2616, {"Blue Line"});
-delhiMetro.addStation("Mandi House", 28.6215, 77.2321, {"Blue Line"});
-delhiMetro.addStation("Barakhambha Road", 28.6288, 77.2248, {"Blue Line"});
-delhiMetro.addStation("Rajiv Chowk", 28.6286, 77.2161, {"Blue Line"});
-delhiMetro.addStation("RK Ashram Marg", 28.6297, 77.2094, {"Blue Line"});
-delhiMetro.addStation("Jhandewalan", 28.6307, 77.2070, {"Blue Line"});
-delhiMetro.addStation("Karol Bagh", 28.6312, 77.1984, {"Blue Line"});
-delhiMetro.addStation("Rajendra Place", 28.6324, 77.1837, {"Blue Line"});
-delhiMetro.addStation("Patel Nagar", 28.6342, 77.1698, {"Blue Line"});
-delhiMetro.addStation("Shadipur", 28.6353, 77.1591, {"Blue Line"});
-delhiMetro.addStation("Kirti Nagar", 28.6358, 77.1466, {"Blue Line"});
-delhiMetro.addStation("Moti Nagar", 28.6356, 77.1366, {"Blue Line"});
-delhiMetro.addStation("Ramesh Nagar", 28.6352, 77.1252, {"Blue Line"});
-delhiMetro.addStation("Rajouri Garden", 28.6357, 77.1137, {"Blue Line"});
-delhiMetro.addStation("Tagore Garden", 28.6356, 77.1015, {"Blue Line"});
-delhiMetro.addStation("Subhash Nagar", 28.6341, 77.0890, {"Blue Line"});
-delhiMetro.addStation("Tilak Nagar", 28.6340, 77.0768, {"Blue Line"});
-delhiMetro.addStation("Janakpuri East", 28.6168, 77.0841, {"Blue Line"});
-delhiMetro.addStation("Janakpuri West", 28.5868, 77.0576, {"Blue Line"});
-delhiMetro.addStation("Uttam Nagar East", 28.5938, 77.0598, {"Blue Line"});
-delhiMetro.addStation("Uttam Nagar West", 28.5824, 77.0464, {"Blue Line"});
-delhiMetro.addStation("Nawada", 28.5702, 77.0347, {"Blue Line"});
-delhiMetro.addStation("Dwarka Mor", 28.5584, 77.0277, {"Blue Line"});
-delhiMetro.addStation("Dwarka", 28.5555, 77.0236, {"Blue Line"});
-delhiMetro.addStation("Dwarka Sector 14", 28.5583, 77.0166, {"Blue Line"});
-delhiMetro.addStation("Dwarka Sector 13", 28.5624, 77.0113, {"Blue Line"});
-delhiMetro.addStation("Dwarka Sector 12", 28.5664, 77.0072, {"Blue Line"});
-delhiMetro.addStation("Dwarka Sector 11", 28.5705, 77.0032, {"Blue Line"});
-delhiMetro.addStation("Dwarka Sector 10", 28.5755, 76.9986, {"Blue Line"});
-delhiMetro.addStation("Dwarka Sector 9", 28.5790, 76.9927, {"Blue Line"});
-delhiMetro.addStation("Dwarka Sector 8", 28.5831, 76.9869, {"Blue Line"});
-delhiMetro.addStation("Dwarka Sector 21", 28.5606, 77.0217, {"Blue Line"});
-
-    // Adding connections with calculated distances
-   double a1 = delhiMetro.calculateDistance("Samaypur Badli", "Rohini Sector 18, 19");
-double a2 = delhiMetro.calculateDistance("Rohini Sector 18, 19", "Haiderpur Badli Mor");
-double a3 = delhiMetro.calculateDistance("Haiderpur Badli Mor", "Jahangirpuri");
-double a4 = delhiMetro.calculateDistance("Jahangirpuri", "Adarsh Nagar");
-double a5 = delhiMetro.calculateDistance("Adarsh Nagar", "Azadpur");
-double a6 = delhiMetro.calculateDistance("Azadpur","Model Town");
-double a7 = delhiMetro.calculateDistance("Model Town", "GTB Nagar");
-double a8 = delhiMetro.calculateDistance("GTB Nagar", "Vishwavidyalaya");
-double a9 = delhiMetro.calculateDistance("Vishwavidyalaya", "Vidhan Sabha");
-double a10 = delhiMetro.calculateDistance("Vidhan Sabha", "Civil Lines");
-double a11 = delhiMetro.calculateDistance("Civil Lines", "Kashmere Gate");
-double a12 = delhiMetro.calculateDistance("Kashmere Gate", "Chandni Chowk");
-double a13 = delhiMetro.calculateDistance("Chandni Chowk", "Chawri Bazar");
-double a14 = delhiMetro.calculateDistance("Chawri Bazar", "New Delhi");
-double a15 = delhiMetro.calculateDistance("New Delhi", "Rajiv Chowk");
-double a16 = delhiMetro.calculateDistance("Rajiv Chowk", "Patel Chowk");
-double a17 = delhiMetro.calculateDistance("Patel Chowk", "Central Secretariat");
-double a18 = delhiMetro.calculateDistance("Central Secretariat", "Udyog Bhawan");
-double a19 = delhiMetro.calculateDistance("Udyog Bhawan", "Lok Kalyan Marg");
-double a20 = delhiMetro.calculateDistance("Lok Kalyan Marg", "Jor Bagh");
-double a21 = delhiMetro.calculateDistance("Jor Bagh", "INA");
-double a22 = delhiMetro.calculateDistance("INA", "AIIMS");
-double a23 = delhiMetro.calculateDistance("AIIMS", "Green Park");
-double a24 = delhiMetro.calculateDistance("Green Park", "Hauz Khas");
-double a25 = delhiMetro.calculateDistance("Hauz Khas", "Malviya Nagar");
-double a26 = delhiMetro.calculateDistance("Malviya Nagar", "Saket");
-double a27 = delhiMetro.calculateDistance("Saket", "Qutab Minar");
-double a28 = delhiMetro.calculateDistance("Qutab Minar", "Chhatarpur");
-double a29 = delhiMetro.calculateDistance("Chhatarpur", "Sultanpur");
-double a30 = delhiMetro.calculateDistance("Sultanpur", "Ghitorni");
-double a31 = delhiMetro.calculateDistance("Ghitorni", "Arjan Garh");
-double a32 = delhiMetro.calculateDistance("Arjan Garh", "Guru Dronacharya");
-double a33 = delhiMetro.calculateDistance("Guru Dronacharya", "Sikanderpur");
-double a34 = delhiMetro.calculateDistance("Sikanderpur", "MG Road");
-double a35 = delhiMetro.calculateDistance("MG Road", "IFFCO Chowk");
-double a36 = delhiMetro.calculateDistance("IFFCO Chowk", "HUDA City Centre");
-
-double b1 = delhiMetro.calculateDistance("Shaheed Sthal (New Bus Adda)", "Hindon River");
-double b2 = delhiMetro.calculateDistance("Hindon River", "Arthala");
-double b3 = delhiMetro.calculateDistance("Arthala", "Mohan Nagar");
-double b4 = delhiMetro.calculateDistance("Mohan Nagar", "Shyam Park");
-double b5 = delhiMetro.calculateDistance("Shyam Park", "Major Mohit Sharma Rajendra Nagar");
-double b6 = delhiMetro.calculateDistance("Major Mohit Sharma Rajendra Nagar", "Raj Bagh");
-double b7 = delhiMetro.calculateDistance("Raj Bagh", "Shaheed Nagar");
-double b8 = delhiMetro.calculateDistance("Shaheed Nagar", "Dilshad Garden");
-double b9 = delhiMetro.calculateDistance("Dilshad Garden", "Jhilmil");
-double b10 = delhiMetro.calculateDistance("Jhilmil", "Mansarovar Park");
-double b11 = delhiMetro.calculateDistance("Mansarovar Park", "Shahdara");
-double b12 = delhiMetro.calculateDistance("Shahdara", "Welcome");
-double b13 = delhiMetro.calculateDistance("Welcome", "Seelampur");
-double b14 = delhiMetro.calculateDistance("Seelampur", "Shastri Park");
-double b15 = delhiMetro.calculateDistance("Shastri Park", "Kashmere Gate");
-double b16 = delhiMetro.calculateDistance("Kashmere Gate", "Tis Hazari");
-double b17 = delhiMetro.calculateDistance("Tis Hazari", "Pulbangash");
-double b18 = delhiMetro.calculateDistance("Pulbangash", "Pratap Nagar");
-double b19 = delhiMetro.calculateDistance("Pratap Nagar", "Shastri Nagar");
-double b20 = delhiMetro.calculateDistance("Shastri Nagar", "Inderlok");
-double b21 = delhiMetro.calculateDistance("Inderlok", "Kanhaiya Nagar");
-double b22 = delhiMetro.calculateDistance("Kanhaiya Nagar", "Keshav Puram");
-double b23 = delhiMetro.calculateDistance("Keshav Puram", "Netaji Subhash Place");
-double b24 = delhiMetro.calculateDistance("Netaji Subhash Place", "Shakurpur");
-double b25 = delhiMetro.calculateDistance("Shakurpur", "Punjabi Bagh West");
-double b26 = delhiMetro.calculateDistance("Punjabi Bagh West", "Ashok Park Main");
-double b27 = delhiMetro.calculateDistance("Ashok Park Main", "Satguru Ram Singh Marg");
-double b28 = delhiMetro.calculateDistance("Satguru Ram Singh Marg", "Kirti Nagar");
-
-
-double d1 = delhiMetro.calculateDistance("Kashmere Gate", "Lal Qila");
-double d2 = delhiMetro.calculateDistance("Lal Qila", "Jama Masjid");
-double d3 = delhiMetro.calculateDistance("Jama Masjid", "Delhi Gate");
-double d4 = delhiMetro.calculateDistance("Delhi Gate", "ITO");
-double d5 = delhiMetro.calculateDistance("ITO", "Mandi House");
-double d6 = delhiMetro.calculateDistance("Mandi House", "Janpath");
-double d7 = delhiMetro.calculateDistance("Janpath", "Central Secretariat");
-double d8 = delhiMetro.calculateDistance("Central Secretariat", "Khan Market");
-double d9 = delhiMetro.calculateDistance("Khan Market", "Jawaharlal Nehru Stadium");
-double d10 = delhiMetro.calculateDistance("Jawaharlal Nehru Stadium", "Jangpura");
-double d11 = delhiMetro.calculateDistance("Jangpura", "Lajpat Nagar");
-double d12 = delhiMetro.calculateDistance("Lajpat Nagar", "Moolchand");
-double d13 = delhiMetro.calculateDistance("Moolchand", "Kailash Colony");
-double d14 = delhiMetro.calculateDistance("Kailash Colony", "Nehru Place");
-double d15 = delhiMetro.calculateDistance("Nehru Place", "Kalkaji Mandir");
-double d16 = delhiMetro.calculateDistance("Kalkaji Mandir", "Govind Puri");
-double d17 = delhiMetro.calculateDistance("Govind Puri", "Okhla NSIC");
-double d18 = delhiMetro.calculateDistance("Okhla NSIC", "Harkesh Nagar Okhla");
-double d19 = delhiMetro.calculateDistance("Harkesh Nagar Okhla", "Jasola Apollo");
-double d20 = delhiMetro.calculateDistance("Jasola Apollo", "Sarita Vihar");
-double d21 = delhiMetro.calculateDistance("Sarita Vihar", "Mohan Estate");
-double d22 = delhiMetro.calculateDistance("Mohan Estate", "Tughlakabad");
-double d23 = delhiMetro.calculateDistance("Tughlakabad", "Badarpur Border");
-double d24 = delhiMetro.calculateDistance("Badarpur Border", "Sarai");
-double d25 = delhiMetro.calculateDistance("Sarai", "NHPC Chowk");
-double d26 = delhiMetro.calculateDistance("NHPC Chowk", "Mewala Maharajpur");
-double d27 = delhiMetro.calculateDistance("Mewala Maharajpur", "Sector 28");
-double d28 = delhiMetro.calculateDistance("Sector 28", "Badkhal Mor");
-double d29 = delhiMetro.calculateDistance("Badkhal Mor", "Old Faridabad");
-double d30 = delhiMetro.calculateDistance("Old Faridabad", "Neelam Chowk Ajronda");
-double d31 = delhiMetro.calculateDistance("Neelam Chowk Ajronda", "Bata Chowk");
-double d32 = delhiMetro.calculateDistance("Bata Chowk", "Escorts Mujesar");
-
-
-double e1 = delhiMetro.calculateDistance("Majlis Park", "Keshav Puram");
-double e2 = delhiMetro.calculateDistance("Keshav Puram", "Kanhaiya Nagar");
-double e3 = delhiMetro.calculateDistance("Kanhaiya Nagar", "Shastri Nagar");
-double e4 = delhiMetro.calculateDistance("Shastri Nagar", "Tis Hazari");
-double e5 = delhiMetro.calculateDistance("Tis Hazari", "Karam Pura");
-double e6 = delhiMetro.calculateDistance("Karam Pura", "Maya Puri");
-double e7 = delhiMetro.calculateDistance("Maya Puri", "Patel Nagar");
-double e8 = delhiMetro.calculateDistance("Patel Nagar", "Kirti Nagar");
-double e9 = delhiMetro.calculateDistance("Kirti Nagar", "Rajouri Garden");
-double e10 = delhiMetro.calculateDistance("Rajouri Garden", "Maharani Bagh");
-double e11 = delhiMetro.calculateDistance("Maharani Bagh", "Hazrat Nizamuddin");
-double e12 = delhiMetro.calculateDistance("Hazrat Nizamuddin", "Jangpura");
-double e13 = delhiMetro.calculateDistance("Jangpura", "Sarai Kale Khan");
-double e14 = delhiMetro.calculateDistance("Sarai Kale Khan", "New Ashok Nagar");
-double e15 = delhiMetro.calculateDistance("New Ashok Nagar", "Noida City Centre");
-double e16 = delhiMetro.calculateDistance("Noida City Centre", "Sector 15");
-double e17 = delhiMetro.calculateDistance("Sector 15", "Sector 18");
-double e18 = delhiMetro.calculateDistance("Sector 18", "Botanical Garden");
-double e19 = delhiMetro.calculateDistance("Botanical Garden", "Sector 52");
-double e20 = delhiMetro.calculateDistance("Sector 52", "Sector 61");
-double e21 = delhiMetro.calculateDistance("Sector 61", "Sector 62");
-double e22 = delhiMetro.calculateDistance("Sector 62", "Sector 63");
-double e23 = delhiMetro.calculateDistance("Sector 63", "IIT Delhi");
-double e24 = delhiMetro.calculateDistance("IIT Delhi", "Hauz Khas");
-double e25 = delhiMetro.calculateDistance("Hauz Khas", "Green Park");
-double e26 = delhiMetro.calculateDistance("Green Park", "Aurobindo Place");
-double e27 = delhiMetro.calculateDistance("Aurobindo Place", "Sarai Jullena");
-double e28 = delhiMetro.calculateDistance("Sarai Jullena", "Ashram");
-double e29 = delhiMetro.calculateDistance("Ashram", "Bhikaji Cama Place");
-double e30 = delhiMetro.calculateDistance("Bhikaji Cama Place", "Durgabai Deshmukh South Campus");
-double e31 = delhiMetro.calculateDistance("Durgabai Deshmukh South Campus", "East Azad Nagar");
-double e32 = delhiMetro.calculateDistance("East Azad Nagar", "East Vinod Nagar – Mayur Vihar-II");
-double e33 = delhiMetro.calculateDistance("East Vinod Nagar – Mayur Vihar-II", "ESI Hospital");
-double e34 = delhiMetro.calculateDistance("ESI Hospital", "Gokulpuri");
-double e35 = delhiMetro.calculateDistance("Gokulpuri", "IP Extension");
-double e36 = delhiMetro.calculateDistance("IP Extension", "Jaffrabad");
-double e37 = delhiMetro.calculateDistance("Jaffrabad", "Kalindi Kunj");
-
-
-double f1 = delhiMetro.calculateDistance("Janakpuri West", "Dabri Mor");
-double f2 = delhiMetro.calculateDistance("Dabri Mor", "Dashrathpuri");
-double f3 = delhiMetro.calculateDistance("Dashrathpuri", "Palam");
-double f4 = delhiMetro.calculateDistance("Palam", "Sadar Bazar Cantonment");
-double f5 = delhiMetro.calculateDistance("Sadar Bazar Cantonment", "Terminal 1 IGI Airport");
-double f6 = delhiMetro.calculateDistance("Terminal 1 IGI Airport", "Shankar Vihar");
-double f7 = delhiMetro.calculateDistance("Shankar Vihar", "Vasant Vihar");
-double f8 = delhiMetro.calculateDistance("Vasant Vihar", "Munirka");
-double f9 = delhiMetro.calculateDistance("Munirka", "RK Puram");
-double f10 = delhiMetro.calculateDistance("RK Puram", "IIT");
-double f11 = delhiMetro.calculateDistance("IIT", "Hauz Khas");
-double f12 = delhiMetro.calculateDistance("Hauz Khas", "Panchsheel Park");
-double f13 = delhiMetro.calculateDistance("Panchsheel Park", "Chirag Delhi");
-double f14 = delhiMetro.calculateDistance("Chirag Delhi", "Greater Kailash");
-double f15 = delhiMetro.calculateDistance("Greater Kailash", "Nehru Enclave");
-double f16 = delhiMetro.calculateDistance("Nehru Enclave", "Kalkaji Mandir");
-double f17 = delhiMetro.calculateDistance("Kalkaji Mandir", "Okhla NSIC");
-double f18 = delhiMetro.calculateDistance("Okhla NSIC", "Sukhdev Vihar");
-double f19 = delhiMetro.calculateDistance("Sukhdev Vihar", "Jamia Milia Islamiya");
-double f20 = delhiMetro.calculateDistance("Jamia Milia Islamiya", "Okhla Vihar");
-double f21 = delhiMetro.calculateDistance("Okhla Vihar", "Jasola Vihar Shaheen Bagh");
-double f22 = delhiMetro.calculateDistance("Jasola Vihar Shaheen Bagh", "Kalindi Kunj");
-double f23 = delhiMetro.calculateDistance("Kalindi Kunj", "Okhla Bird Sanctuary");
-double f24 = delhiMetro.calculateDistance("Okhla Bird Sanctuary", "Botanical Garden");
-
-
-
-double g1 = delhiMetro.calculateDistance("New Delhi", "Shivaji Stadium");
-double g2 = delhiMetro.calculateDistance("Shivaji Stadium", "Dhaula Kuan");
-double g3 = delhiMetro.calculateDistance("Dhaula Kuan", "Delhi Aerocity");
-double g4 = delhiMetro.calculateDistance("Delhi Aerocity", "Airport T3");
-double g5 = delhiMetro.calculateDistance("Airport T3", "Dwarka Sector 21");
-double g6 = delhiMetro.calculateDistance("Dwarka Sector 21", "Yashobhoomi Dwarka Sector 25");
-
-
-// Distances between the stations on the Blue Line
-double i1 = delhiMetro.calculateDistance("Noida Electronic City", "Noida Sector 62");
-double i2 = delhiMetro.calculateDistance("Noida Sector 62", "Noida Sector 59");
-double i3 = delhiMetro.calculateDistance("Noida Sector 59", "Noida Sector 61");
-double i4 = delhiMetro.calculateDistance("Noida Sector 61", "Noida Sector 52");
-double i5 = delhiMetro.calculateDistance("Noida Sector 52", "Noida Sector 34");
-double i6 = delhiMetro.calculateDistance("Noida Sector 34", "Noida City Centre");
-double i7 = delhiMetro.calculateDistance("Noida City Centre", "Golf Course");
-double i8 = delhiMetro.calculateDistance("Golf Course", "Botanical Garden");
-double i9 = delhiMetro.calculateDistance("Botanical Garden", "Noida Sector 18");
-double i10 = delhiMetro.calculateDistance("Noida Sector 18", "Noida Sector 16");
-double i11 = delhiMetro.calculateDistance("Noida Sector 16", "Noida Sector 15");
-double i12 = delhiMetro.calculateDistance("Noida Sector 15", "New Ashok Nagar");
-double i13 = delhiMetro.calculateDistance("New Ashok Nagar", "Mayur Vihar Extension");
-double i14 = delhiMetro.calculateDistance("Mayur Vihar Extension", "Mayur Vihar I");
-double i15 = delhiMetro.calculateDistance("Mayur Vihar I", "Akshardham");
-double i16 = delhiMetro.calculateDistance("Akshardham", "Yamuna Bank");
-double i17 = delhiMetro.calculateDistance("Yamuna Bank", "Indraprastha");
-double i18 = delhiMetro.calculateDistance("Indraprastha", "Supreme Court (Pragati Maidan)");
-double i19 = delhiMetro.calculateDistance("Supreme Court (Pragati Maidan)", "Mandi House");
-double i20 = delhiMetro.calculateDistance("Mandi House", "Barakhambha Road");
-double i21 = delhiMetro.calculateDistance("Barakhambha Road", "Rajiv Chowk");
-double i22 = delhiMetro.calculateDistance("Rajiv Chowk", "RK Ashram Marg");
-double i23 = delhiMetro.calculateDistance("RK Ashram Marg", "Jhandewalan");
-double i24 = delhiMetro.calculateDistance("Jhandewalan", "Karol Bagh");
-double i25 = delhiMetro.calculateDistance("Karol Bagh", "Rajendra Place");
-double i26 = delhiMetro.calculateDistance("Rajendra Place", "Patel Nagar");
-double i27 = delhiMetro.calculateDistance("Patel Nagar", "Shadipur");
-double i28 = delhiMetro.calculateDistance("Shadipur", "Kirti Nagar");
-double i29 = delhiMetro.calculateDistance("Kirti Nagar", "Moti Nagar");
-double i30 = delhiMetro.calculateDistance("Moti Nagar", "Ramesh Nagar");
-double i31 = delhiMetro.calculateDistance("Ramesh Nagar", "Rajouri Garden");
-double i32 = delhiMetro.calculateDistance("Rajouri Garden", "Tagore Garden");
-double i33 = delhiMetro.calculateDistance("Tagore Garden", "Subhash Nagar");
-double i34 = delhiMetro.calculateDistance("Subhash Nagar", "Tilak Nagar");
-double i35 = delhiMetro.calculateDistance("Tilak Nagar", "Janakpuri East");
-double i36 = delhiMetro.calculateDistance("Janakpuri East", "Janakpuri West");
-double i37 = delhiMetro.calculateDistance("Janakpuri West", "Uttam Nagar East");
-double i38 = delhiMetro.calculateDistance("Uttam Nagar East", "Uttam Nagar West");
-double i39 = delhiMetro.calculateDistance("Uttam Nagar West", "Nawada");
-double i40 = delhiMetro.calculateDistance("Nawada", "Dwarka Mor");
-double i41 = delhiMetro.calculateDistance("Dwarka Mor", "Dwarka");
-double i42 = delhiMetro.calculateDistance("Dwarka", "Dwarka Sector 14");
-double i43 = delhiMetro.calculateDistance("Dwarka Sector 14", "Dwarka Sector 13");
-double i44 = delhiMetro.calculateDistance("Dwarka Sector 13", "Dwarka Sector 12");
-double i45 = delhiMetro.calculateDistance("Dwarka Sector 12", "Dwarka Sector 11");
-double i46 = delhiMetro.calculateDistance("Dwarka Sector 11", "Dwarka Sector 10");
-double i47 = delhiMetro.calculateDistance("Dwarka Sector 10", "Dwarka Sector 9");
-double i48 = delhiMetro.calculateDistance("Dwarka Sector 9", "Dwarka Sector 8");
-double i49 = delhiMetro.calculateDistance("Dwarka Sector 8", "Dwarka Sector 21");
-
-delhiMetro.addEdge("Samaypur Badli", "Rohini Sector 18, 19", static_cast<int>(a1), {"Yellow Line"});
-delhiMetro.addEdge("Rohini Sector 18, 19", "Samaypur Badli", static_cast<int>(a1), {"Yellow Line"});
-
-delhiMetro.addEdge("Rohini Sector 18, 19", "Haiderpur Badli Mor", static_cast<int>(a2), {"Yellow Line"});
-delhiMetro.addEdge("Haiderpur Badli Mor", "Rohini Sector 18, 19", static_cast<int>(a2), {"Yellow Line"});
-
-delhiMetro.addEdge("Haiderpur Badli Mor", "Jahangirpuri", static_cast<int>(a3), {"Yellow Line"});
-delhiMetro.addEdge("Jahangirpuri", "Haiderpur Badli Mor", static_cast<int>(a3), {"Yellow Line"});
-
-delhiMetro.addEdge("Jahangirpuri", "Adarsh Nagar", static_cast<int>(a4), {"Yellow Line"});
-delhiMetro.addEdge("Adarsh Nagar", "Jahangirpuri", static_cast<int>(a4), {"Yellow Line"});
-
-delhiMetro.addEdge("Adarsh Nagar", "Azadpur", static_cast<int>(a5), {"Yellow Line"});
-delhiMetro.addEdge("Azadpur", "Adarsh Nagar", static_cast<int>(a5), {"Yellow Line"});
-
-delhiMetro.addEdge("Azadpur", "Model Town", static_cast<int>(a6), {"Yellow Line"});
-delhiMetro.addEdge("Model Town", "Azadpur", static_cast<int>(a6), {"Yellow Line"});
-
-delhiMetro.addEdge("Model Town", "GTB Nagar", static_cast<int>(a7), {"Yellow Line"});
-delhiMetro.addEdge("GTB Nagar", "Model Town", static_cast<int>(a7), {"Yellow Line"});
-
-delhiMetro.addEdge("GTB Nagar", "Vishwavidyalaya", static_cast<int>(a8), {"Yellow Line"});
-delhiMetro.addEdge("Vishwavidyalaya", "GTB Nagar", static_cast<int>(a8), {"Yellow Line"});
-
-delhiMetro.addEdge("Vishwavidyalaya", "Vidhan Sabha", static_cast<int>(a9), {"Yellow Line"});
-delhiMetro.addEdge("Vidhan Sabha", "Vishwavidyalaya", static_cast<int>(a9), {"Yellow Line"});
-
-delhiMetro.addEdge("Vidhan Sabha", "Civil Lines", static_cast<int>(a10), {"Yellow Line"});
-delhiMetro.addEdge("Civil Lines", "Vidhan Sabha", static_cast<int>(a10), {"Yellow Line"});
+// Totals over the queries answered by one engine or other kind of search
+struct EngineStats {
+    uint64_t queries = 0;
+    uint64_t unreachable = 0;
+    uint64_t settled = 0;
+    uint64_t pushes = 0;
+    uint64_t stalePops = 0;
+    uint64_t relaxed = 0;
+    uint64_t pathStations = 0;      // stations on the routes (or in the zones) returned
+    LatencyHistogram latency;
+
+    void merge(const EngineStats& other) {
+        queries += other.queries;
+        unreachable += other.unreachable;
+        settled += other.settled;
+        pushes += other.pushes;
+        stalePops += other.stalePops;
+        relaxed += other.relaxed;
+        pathStations += other.pathStations;
+        latency.merge(other.latency);
+    }
+};
 
-delhiMetro.addEdge("Civil Lines", "Kashmere Gate", static_cast<int>(a11), {"Yellow Line"});
-delhiMetro.addEdge("Kashmere Gate", "Civil Lines", static_cast<int>(a11), {"Yellow Line"});
+// Process-wide route search statistics of METRO_SEARCH_STATS builds. Each
+// thread records into its own shard, created on first use and kept after the
+// thread exits, so recording never waits on another thread; its lock is only
+// contended while a dump merges the shards.
+class SearchStats {
+public:
+    // Account one query answered by engine: the counters of the workspace(s)
+    // it searched in, the stations on its path and how long it took
+    static void record(RouteEngine engine, const SearchWorkspace& forward, const SearchWorkspace* backward,
+                       size_t pathStations, int distance, chrono::steady_clock::duration elapsed) {
+        size_t settled = forward.settled;
+        SearchCounters counters = forward.counters;
+        if (backward) {
+            settled += backward->settled;
+            counters.add(backward->counters);
+        }
+        record(static_cast<SearchKind>(engine), settled, counters, pathStations, distance == SearchWorkspace::INF,
+               elapsed);
+    }
 
-delhiMetro.addEdge("Kashmere Gate", "Chandni Chowk", static_cast<int>(a12), {"Yellow Line"});
-delhiMetro.addEdge("Chandni Chowk", "Kashmere Gate", static_cast<int>(a12), {"Yellow Line"});
+    // Account one search of any kind from its totals
+    static void record(SearchKind kind, size_t settled, const SearchCounters& counters, size_t pathStations,
+                       bool unreachable, chrono::steady_clock::duration elapsed) {
+        Shard& shard = local();
+        lock_guard<mutex> lock(shard.lock);
+        EngineStats& stats = shard.engines[kind];
+        ++stats.queries;
+        stats.unreachable += unreachable;
+        stats.settled += settled;
+        stats.pushes += counters.pushes;
+        stats.stalePops += counters.stalePops;
+        stats.relaxed += counters.relaxed;
+        stats.pathStations += pathStations;
+        stats.latency.record(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(elapsed).count()));
+    }
 
-delhiMetro.addEdge("Chandni Chowk", "Chawri Bazar", static_cast<int>(a13), {"Yellow Line"});
-delhiMetro.addEdge("Chawri Bazar", "Chandni Chowk", static_cast<int>(a13), {"Yellow Line"});
+    // Totals of every engine and search kind over all threads so far
+    static void snapshot(vector<EngineStats>& totals) {
+        totals.assign(SEARCH_KIND_COUNT, EngineStats());
+        lock_guard<mutex> lock(registryLock);
+        for (Shard& shard : shards) {
+            lock_guard<mutex> shardLock(shard.lock);
+            for (int e = 0; e < SEARCH_KIND_COUNT; ++e) {
+                totals[e].merge(shard.engines[e]);
+            }
+        }
+    }
 
-delhiMetro.addEdge("Chawri Bazar", "New Delhi", static_cast<int>(a14), {"Yellow Line"});
-delhiMetro.addEdge("New Delhi", "Chawri Bazar", static_cast<int>(a14), {"Yellow Line"});
+    // Dump per-query averages and latency percentiles of every engine and
+    // search kind that ran at least once
+    static void print(ostream& out, bool json) {
+        vector<EngineStats> totals;
+        snapshot(totals);
+        const double PERCENTILES[] = {50, 90, 99, 99.9};
+        if (json) {
+            out << "{\"enabled\": " << (SEARCH_STATS ? "true" : "false") << ", \"engines\": {";
+            const char* separator = "";
+            for (int e = 0; e < SEARCH_KIND_COUNT; ++e) {
+                const EngineStats& stats = totals[e];
+                if (stats.queries == 0) continue;
+                out << separator << "\"" << SEARCH_KIND_NAMES[e] << "\": {\"queries\": " << stats.queries
+                    << ", \"unreachable\": " << stats.unreachable << ", \"settled\": " << stats.settled
+                    << ", \"pushes\": " << stats.pushes << ", \"stalePops\": " << stats.stalePops
+                    << ", \"edgesRelaxed\": " << stats.relaxed << ", \"pathStations\": " << stats.pathStations
+                    << ", \"latencyNs\": {\"count\": " << stats.latency.total
+                    << ", \"mean\": " << stats.latency.sum / max<uint64_t>(stats.latency.total, 1);
+                for (double pct : PERCENTILES) {
+                    out << ", \"p" << pct << "\": " << stats.latency.percentile(pct);
+                }
+                out << ", \"max\": " << stats.latency.maximum << ", \"buckets\": [";
+                const char* comma = "";
+                for (int b = 0; b < LatencyHistogram::BUCKETS; ++b) {
+                    if (stats.latency.counts[b] == 0) continue;
+                    out << comma << "[" << LatencyHistogram::lowest(b) << ", " << stats.latency.counts[b] << "]";
+                    comma = ", ";
+                }
+                out << "]}}";
+                separator = ", ";
+            }
+            out << "}}\n";
+            return;
+        }
 
-delhiMetro.addEdge("New Delhi", "Rajiv Chowk", static_cast<int>(a15), {"Yellow Line"});
-delhiMetro.addEdge("Rajiv Chowk", "New Delhi", static_cast<int>(a15), {"Yellow Line"});
+        if (!SEARCH_STATS) {
+            out << "Search stats are not compiled in, rebuild with -DMETRO_SEARCH_STATS=1\n";
+            return;
+        }
+        out << "Search stats, per query:\n";
+        bool any = false;
+        for (int e = 0; e < SEARCH_KIND_COUNT; ++e) {
+            const EngineStats& stats = totals[e];
+            if (stats.queries == 0) continue;
+            any = true;
+            double queries = double(stats.queries);
+            out << "  " << SEARCH_KIND_NAMES[e] << ": " << stats.queries << " queries (" << stats.unreachable
+                << " unreachable), " << stats.settled / queries << " settled, " << stats.pushes / queries
+                << " pushes, " << stats.stalePops / queries << " stale pops, " << stats.relaxed / queries
+                << " edges relaxed, " << stats.pathStations / queries << " stations returned\n";
+            out << "    latency:";
+            for (double pct : PERCENTILES) {
+                out << " p" << pct << " " << stats.latency.percentile(pct) / 1000.0 << " us,";
+            }
+            out << " max " << stats.latency.maximum / 1000.0 << " us\n";
+        }
+        if (!any) {
+            out << "  no route queries recorded\n";
+        }
+    }
 
-delhiMetro.addEdge("Rajiv Chowk", "Patel Chowk", static_cast<int>(a16), {"Yellow Line"});
-delhiMetro.addEdge("Patel Chowk", "Rajiv Chowk", static_cast<int>(a16), {"Yellow Line"});
+    // Dumps on demand: a signal handler may only raise the flag, and the
+    // query loops call serviceDump() between queries to act on it
+    static void requestDump() { dumpRequested = true; }
+    static void setDumpFormat(bool json) { dumpJson = json; }
+    static void serviceDump(ostream& out) {
+        if (dumpRequested && dumpRequested.exchange(false)) {
+            print(out, dumpJson);
+        }
+    }
 
-delhiMetro.addEdge("Patel Chowk", "Central Secretariat", static_cast<int>(a17), {"Yellow Line"});
-delhiMetro.addEdge("Central Secretariat", "Patel Chowk", static_cast<int>(a17), {"Yellow Line"});
+private:
+    struct Shard {
+        mutex lock;
+        EngineStats engines[SEARCH_KIND_COUNT];
+    };
+
+    static inline mutex registryLock;
+    static inline list<Shard> shards;
+    static inline atomic<bool> dumpRequested{false};
+    static inline bool dumpJson = false;
+
+    static Shard& local() {
+        static thread_local Shard* shard = nullptr;
+        if (!shard) {
+            lock_guard<mutex> lock(registryLock);
+            shard = &shards.emplace_back();
+        }
+        return *shard;
+    }
+};
 
-delhiMetro.addEdge("Central Secretariat", "Udyog Bhawan", static_cast<int>(a18), {"Yellow Line"});
-delhiMetro.addEdge("Udyog Bhawan", "Central Secretariat", static_cast<int>(a18), {"Yellow Line"});
+// Point-to-point Dijkstra over a CSR view. Fills path with ids from source
+// to destination and returns the distance (INF if unreachable).
+int searchPath(const GraphView& graph, uint32_t source, uint32_t destination, vector<uint32_t>& path, SearchWorkspace& ws) {
+    ws.prepare(graph.stationCount);
+    path.clear();
+    ws.update(source, 0, SearchWorkspace::NONE);
+    ws.push(0, source);
+
+    while (!ws.heapEmpty()) {
+        pair<int, uint32_t> top = ws.pop();
+        int dist = top.first;
+        uint32_t u = top.second;
+
+        if (dist > ws.distanceOf(u)) {
+            ws.countStale();
+            continue;
+        }
+        ++ws.settled;
+        if (u == destination) {
+            break;
+        }
 
-delhiMetro.addEdge("Udyog Bhawan", "Lok Kalyan Marg", static_cast<int>(a19), {"Yellow Line"});
-delhiMetro.addEdge("Lok Kalyan Marg", "Udyog Bhawan", static_cast<int>(a19), {"Yellow Line"});
+        ws.countRelaxed(graph.offsets[u + 1] - graph.offsets[u]);
+        for (uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e) {
+            if (!graph.open(e)) {
+                continue;
+            }
+            uint32_t v = graph.targets[e];
+            int new_dist = dist + graph.weights[e];
+            if (new_dist < ws.distanceOf(v)) {
+                ws.update(v, new_dist, u);
+                ws.push(new_dist, v);
+            }
+        }
+    }
 
-delhiMetro.addEdge("Lok Kalyan Marg", "Jor Bagh", static_cast<int>(a20), {"Yellow Line"});
-delhiMetro.addEdge("Jor Bagh", "Lok Kalyan Marg", static_cast<int>(a20), {"Yellow Line"});
+    int totalDistance = ws.distanceOf(destination);
+    if (totalDistance == SearchWorkspace::INF) {
+        return totalDistance; // No path found
+    }
+    ws.tracePath(source, destination, path);
+    return totalDistance;
+}
+
+// searchPath() with the binary heap replaced by a radix heap. Weights are
+// small non-negative integers (metres), so the queue is monotone and pushes
+// cost no sifting; same contract and results as searchPath().
+int searchPathRadix(const GraphView& graph, uint32_t source, uint32_t destination, vector<uint32_t>& path,
+                    SearchWorkspace& ws) {
+    ws.prepare(graph.stationCount);
+    path.clear();
+    ws.update(source, 0, SearchWorkspace::NONE);
+    ws.radix.push(0, source);
+    ws.countPush();
+
+    while (!ws.radix.empty()) {
+        pair<int, uint32_t> top = ws.radix.pop();
+        int dist = top.first;
+        uint32_t u = top.second;
+
+        if (dist > ws.distanceOf(u)) {
+            ws.countStale();
+            continue;
+        }
+        ++ws.settled;
+        if (u == destination) {
+            break;
+        }
 
-delhiMetro.addEdge("Jor Bagh", "INA", static_cast<int>(a21), {"Yellow Line"});
-delhiMetro.addEdge("INA", "Jor Bagh", static_cast<int>(a21), {"Yellow Line"});
+        ws.countRelaxed(graph.offsets[u + 1] - graph.offsets[u]);
+        for (uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e) {
+            if (!graph.open(e)) {
+                continue;
+            }
+            uint32_t v = graph.targets[e];
+            int new_dist = dist + graph.weights[e];
+            if (new_dist < ws.distanceOf(v)) {
+                ws.update(v, new_dist, u);
+                ws.radix.push(new_dist, v);
+                ws.countPush();
+            }
+        }
+    }
 
-delhiMetro.addEdge("INA", "AIIMS", static_cast<int>(a22), {"Yellow Line"});
-delhiMetro.addEdge("AIIMS", "INA", static_cast<int>(a22), {"Yellow Line"});
+    int totalDistance = ws.distanceOf(destination);
+    if (totalDistance == SearchWorkspace::INF) {
+        return totalDistance; // No path found
+    }
+    ws.tracePath(source, destination, path);
+    return totalDistance;
+}
+
+// One-to-all Dijkstra over a CSR view, distances and parents stay in the workspace
+void searchTree(const GraphView& graph, uint32_t source, SearchWorkspace& ws) {
+    chrono::steady_clock::time_point start;
+    if constexpr (SEARCH_STATS) {
+        start = chrono::steady_clock::now();
+    }
+    ws.prepare(graph.stationCount);
+    ws.update(source, 0, SearchWorkspace::NONE);
+    ws.push(0, source);
+
+    while (!ws.heapEmpty()) {
+        pair<int, uint32_t> top = ws.pop();
+        int dist = top.first;
+        uint32_t u = top.second;
+        if (dist > ws.distanceOf(u)) {
+            ws.countStale();
+            continue;
+        }
+        ++ws.settled;
+        ws.countRelaxed(graph.offsets[u + 1] - graph.offsets[u]);
+        for (uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e) {
+            if (!graph.open(e)) {
+                continue;
+            }
+            uint32_t v = graph.targets[e];
+            int new_dist = dist + graph.weights[e];
+            if (new_dist < ws.distanceOf(v)) {
+                ws.update(v, new_dist, u);
+                ws.push(new_dist, v);
+            }
+        }
+    }
+    if constexpr (SEARCH_STATS) {
+        SearchStats::record(SEARCH_TREE, ws.settled, ws.counters, 0, false, chrono::steady_clock::now() - start);
+    }
+}
 
-delhiMetro.addEdge("AIIMS", "Green Park", static_cast<int>(a23), {"Yellow Line"});
-delhiMetro.addEdge("Green Park", "AIIMS", static_cast<int>(a23), {"Yellow Line"});
+// A route found by kShortestPaths(), with the distance to each of its stations
+struct RankedPath {
+    vector<uint32_t> stations;
+    vector<int> reached;    // reached[i] = distance from the source to stations[i]
+    int distance = 0;
+};
 
-delhiMetro.addEdge("Green Park", "Hauz Khas", static_cast<int>(a24), {"Yellow Line"});
-delhiMetro.addEdge("Hauz Khas", "Green Park", static_cast<int>(a24), {"Yellow Line"});
+// Scratch space for k-shortest path queries. Every spur search reuses the
+// same SearchWorkspace; stations of the current root path are blocked by
+// stamping them, so unblocking is free.
+struct PathsWorkspace {
+    SearchWorkspace search;
+    vector<uint32_t> blockedStamp;
+    uint32_t blockEpoch = 0;
+    vector<uint32_t> bannedNext;        // first hops out of the spur station already taken
+    vector<uint32_t> spur;
+    vector<RankedPath> candidates;      // sorted by distance, never more than still needed
+    size_t spurSearches = 0;            // searches run by the last query
+    size_t settled = 0;                 // stations settled over all of them
+    SearchCounters counters;            // and the rest of their work, see METRO_SEARCH_STATS
+
+    void unblockAll(uint32_t n) {
+        if (blockedStamp.size() < n) {
+            blockedStamp.resize(n, 0);
+        }
+        if (++blockEpoch == 0) {
+            fill(blockedStamp.begin(), blockedStamp.end(), 0);
+            blockEpoch = 1;
+        }
+    }
 
-delhiMetro.addEdge("Hauz Khas", "Malviya Nagar", static_cast<int>(a25), {"Yellow Line"});
-delhiMetro.addEdge("Malviya Nagar", "Hauz Khas", static_cast<int>(a25), {"Yellow Line"});
+    void block(uint32_t v) { blockedStamp[v] = blockEpoch; }
+    bool blocked(uint32_t v) const { return blockedStamp[v] == blockEpoch; }
+};
 
-delhiMetro.addEdge("Malviya Nagar", "Saket", static_cast<int>(a26), {"Yellow Line"});
-delhiMetro.addEdge("Saket", "Malviya Nagar", static_cast<int>(a26), {"Yellow Line"});
+// Dijkstra from spur to destination that avoids blocked stations and the
+// banned first hops, and gives up on anything not shorter than limit.
+// Leaves the path in ws.spur and returns its length (INF if none).
+int searchSpur(const GraphView& graph, uint32_t spur, uint32_t destination, int limit, PathsWorkspace& ws) {
+    SearchWorkspace& search = ws.search;
+    search.prepare(graph.stationCount);
+    search.update(spur, 0, SearchWorkspace::NONE);
+    search.push(0, spur);
+    ++ws.spurSearches;
+
+    while (!search.heapEmpty()) {
+        pair<int, uint32_t> top = search.pop();
+        int dist = top.first;
+        uint32_t u = top.second;
+        if (dist > search.distanceOf(u)) {
+            search.countStale();
+            continue;
+        }
+        ++search.settled;
+        if (u == destination) {
+            break;
+        }
+        search.countRelaxed(graph.offsets[u + 1] - graph.offsets[u]);
+        for (uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e) {
+            if (!graph.open(e)) {
+                continue;
+            }
+            uint32_t v = graph.targets[e];
+            int new_dist = dist + graph.weights[e];
+            if (new_dist >= limit || ws.blocked(v) ||
+                (u == spur && find(ws.bannedNext.begin(), ws.bannedNext.end(), v) != ws.bannedNext.end())) {
+                continue;
+            }
+            if (new_dist < search.distanceOf(v)) {
+                search.update(v, new_dist, u);
+                search.push(new_dist, v);
+            }
+        }
+    }
+    ws.settled += search.settled;
+    if constexpr (SEARCH_STATS) {
+        ws.counters.add(search.counters);
+    }
 
-delhiMetro.addEdge("Saket", "Qutab Minar", static_cast<int>(a27), {"Yellow Line"});
-delhiMetro.addEdge("Qutab Minar", "Saket", static_cast<int>(a27), {"Yellow Line"});
+    int spurDistance = search.distanceOf(destination);
+    if (spurDistance != SearchWorkspace::INF) {
+        search.tracePath(spur, destination, ws.spur);
+    }
+    return spurDistance;
+}
+
+// Yen's k shortest loopless paths, shortest first. Each accepted path is
+// deviated from at every station (the spur) with the stations before it
+// blocked. Only as many candidates as are still needed are kept, and once
+// that many are known a spur search stops at the worst of them, since a
+// longer path could never be picked. prune = false drops that bound, for
+// comparison. Returns the number of paths found.
+size_t yenPaths(const GraphView& graph, uint32_t source, uint32_t destination, size_t k, vector<RankedPath>& paths,
+                PathsWorkspace& ws, bool prune) {
+    paths.clear();
+    ws.candidates.clear();
+    ws.spurSearches = 0;
+    ws.settled = 0;
+    ws.counters = SearchCounters();
+    if (k == 0) {
+        return 0;
+    }
+    ws.unblockAll(graph.stationCount);
+    ws.bannedNext.clear();
+    if (searchSpur(graph, source, destination, SearchWorkspace::INF, ws) == SearchWorkspace::INF) {
+        return 0;
+    }
+    paths.emplace_back();
+    paths.back().stations = ws.spur;
+    for (uint32_t v : ws.spur) {
+        paths.back().reached.push_back(ws.search.distanceOf(v));
+    }
+    paths.back().distance = paths.back().reached.back();
+
+    while (paths.size() < k) {
+        size_t needed = k - paths.size();
+        size_t last = paths.size() - 1;
+        for (size_t j = 0; j + 1 < paths[last].stations.size(); ++j) {
+            const RankedPath& previous = paths[last];
+            uint32_t spur = previous.stations[j];
+            int rootDistance = previous.reached[j];
+            int limit = SearchWorkspace::INF;
+            if (prune && ws.candidates.size() >= needed) {
+                limit = ws.candidates.back().distance - rootDistance;
+                if (limit <= 0) {
+                    break; // longer roots further along cannot do better either
+                }
+            }
 
-delhiMetro.addEdge("Qutab Minar", "Chhatarpur", static_cast<int>(a28), {"Yellow Line"});
-delhiMetro.addEdge("Chhatarpur", "Qutab Minar", static_cast<int>(a28), {"Yellow Line"});
+            // Block the root, and every first hop an accepted path with this root already took
+            ws.unblockAll(graph.stationCount);
+            for (size_t r = 0; r < j; ++r) {
+                ws.block(previous.stations[r]);
+            }
+            ws.bannedNext.clear();
+            for (const RankedPath& accepted : paths) {
+                if (accepted.stations.size() > j + 1 &&
+                    equal(previous.stations.begin(), previous.stations.begin() + j + 1, accepted.stations.begin())) {
+                    ws.bannedNext.push_back(accepted.stations[j + 1]);
+                }
+            }
 
-delhiMetro.addEdge("Chhatarpur", "Sultanpur", static_cast<int>(a29), {"Yellow Line"});
-delhiMetro.addEdge("Sultanpur", "Chhatarpur", static_cast<int>(a29), {"Yellow Line"});
+            int spurDistance = searchSpur(graph, spur, destination, limit, ws);
+            if (spurDistance == SearchWorkspace::INF) {
+                continue;
+            }
+            RankedPath candidate;
+            candidate.stations.assign(previous.stations.begin(), previous.stations.begin() + j);
+            candidate.reached.assign(previous.reached.begin(), previous.reached.begin() + j);
+            for (uint32_t v : ws.spur) {
+                candidate.stations.push_back(v);
+                candidate.reached.push_back(rootDistance + ws.search.distanceOf(v));
+            }
+            candidate.distance = candidate.reached.back();
 
-delhiMetro.addEdge("Sultanpur", "Ghitorni", static_cast<int>(a30), {"Yellow Line"});
-delhiMetro.addEdge("Ghitorni", "Sultanpur", static_cast<int>(a30), {"Yellow Line"});
+            bool duplicate = false;
+            for (const RankedPath& other : ws.candidates) {
+                duplicate = duplicate || other.stations == candidate.stations;
+            }
+            if (duplicate) {
+                continue;
+            }
+            auto at = upper_bound(ws.candidates.begin(), ws.candidates.end(), candidate.distance,
+                                  [](int distance, const RankedPath& other) { return distance < other.distance; });
+            ws.candidates.insert(at, move(candidate));
+            if (ws.candidates.size() > needed) {
+                ws.candidates.pop_back();
+            }
+        }
 
-delhiMetro.addEdge("Ghitorni", "Arjan Garh", static_cast<int>(a31), {"Yellow Line"});
-delhiMetro.addEdge("Arjan Garh", "Ghitorni", static_cast<int>(a31), {"Yellow Line"});
+        if (ws.candidates.empty()) {
+            break;
+        }
+        paths.push_back(move(ws.candidates.front()));
+        ws.candidates.erase(ws.candidates.begin());
+    }
+    return paths.size();
+}
+
+// yenPaths(), accounted as one SEARCH_K_SHORTEST query in METRO_SEARCH_STATS builds
+size_t kShortestPaths(const GraphView& graph, uint32_t source, uint32_t destination, size_t k,
+                      vector<RankedPath>& paths, PathsWorkspace& ws, bool prune = true) {
+    chrono::steady_clock::time_point start;
+    if constexpr (SEARCH_STATS) {
+        start = chrono::steady_clock::now();
+    }
+    size_t found = yenPaths(graph, source, destination, k, paths, ws, prune);
+    if constexpr (SEARCH_STATS) {
+        size_t stations = 0;
+        for (const RankedPath& path : paths) {
+            stations += path.stations.size();
+        }
+        SearchStats::record(SEARCH_K_SHORTEST, ws.settled, ws.counters, stations, found == 0,
+                            chrono::steady_clock::now() - start);
+    }
+    return found;
+}
+
+// Delhi Metro fare bands: a trip of up to FARE_BAND_LIMITS[b] metres costs
+// FARE_BAND_PRICES[b], anything longer than the last limit costs the last price
+const int FARE_BANDS = 6;
+const int FARE_BAND_LIMITS[FARE_BANDS - 1] = {2 * METRES_PER_KM, 5 * METRES_PER_KM, 12 * METRES_PER_KM,
+                                              21 * METRES_PER_KM, 32 * METRES_PER_KM};
+const double FARE_BAND_PRICES[FARE_BANDS] = {10.0, 20.0, 30.0, 40.0, 50.0, 60.0};
+
+int fareBand(int distance) {
+    int band = 0;
+    while (band < FARE_BANDS - 1 && distance > FARE_BAND_LIMITS[band]) {
+        ++band;
+    }
+    return band;
+}
+
+// Longest distance whose fare is within budget: -1 if even the cheapest band
+// costs more, INF if every band fits
+int fareDistanceBudget(double fare) {
+    int budget = -1;
+    for (int band = 0; band < FARE_BANDS; ++band) {
+        if (FARE_BAND_PRICES[band] <= fare) {
+            budget = band < FARE_BANDS - 1 ? FARE_BAND_LIMITS[band] : SearchWorkspace::INF;
+        }
+    }
+    return budget;
+}
 
-delhiMetro.addEdge("Arjan Garh", "Guru Dronacharya", static_cast<int>(a32), {"Yellow Line"});
-delhiMetro.addEdge("Guru Dronacharya", "Arjan Garh", static_cast<int>(a32), {"Yellow Line"});
+// Stations reachable from one origin, nearest first, in one flat buffer.
+// Fare band b is stations[bandStart[b]] up to stations[bandStart[b + 1]].
+struct FareZones {
+    vector<uint32_t> stations;
+    vector<int> distances;
+    uint32_t bandStart[FARE_BANDS + 1] = {};
 
-delhiMetro.addEdge("Guru Dronacharya", "Sikanderpur", static_cast<int>(a33), {"Yellow Line"});
-delhiMetro.addEdge("Sikanderpur", "Guru Dronacharya", static_cast<int>(a33), {"Yellow Line"});
+    uint32_t bandSize(int band) const { return bandStart[band + 1] - bandStart[band]; }
+};
 
-delhiMetro.addEdge("Sikanderpur", "MG Road", static_cast<int>(a34), {"Yellow Line"});
-delhiMetro.addEdge("MG Road", "Sikanderpur", static_cast<int>(a34), {"Yellow Line"});
+// One-to-all Dijkstra that never expands past budget metres. Stations are
+// appended as they settle, so they come out sorted by distance and therefore
+// already grouped by fare band.
+void reachableWithin(const GraphView& graph, uint32_t source, int budget, FareZones& zones, SearchWorkspace& ws) {
+    chrono::steady_clock::time_point start;
+    if constexpr (SEARCH_STATS) {
+        start = chrono::steady_clock::now();
+    }
+    zones.stations.clear();
+    zones.distances.clear();
+    ws.prepare(graph.stationCount);
+    if (budget >= 0) {
+        ws.update(source, 0, SearchWorkspace::NONE);
+        ws.push(0, source);
+    }
 
-delhiMetro.addEdge("MG Road", "IFFCO Chowk", static_cast<int>(a35), {"Yellow Line"});
-delhiMetro.addEdge("IFFCO Chowk", "MG Road", static_cast<int>(a35), {"Yellow Line"});
+    while (!ws.heapEmpty()) {
+        pair<int, uint32_t> top = ws.pop();
+        int dist = top.first;
+        uint32_t u = top.second;
+        if (dist > ws.distanceOf(u)) {
+            ws.countStale();
+            continue;
+        }
+        ++ws.settled;
+        zones.stations.push_back(u);
+        zones.distances.push_back(dist);
+        ws.countRelaxed(graph.offsets[u + 1] - graph.offsets[u]);
+        for (uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e) {
+            if (!graph.open(e)) {
+                continue;
+            }
+            uint32_t v = graph.targets[e];
+            int new_dist = dist + graph.weights[e];
+            if (new_dist <= budget && new_dist < ws.distanceOf(v)) {
+                ws.update(v, new_dist, u);
+                ws.push(new_dist, v);
+            }
+        }
+    }
 
-delhiMetro.addEdge("IFFCO Chowk", "HUDA City Centre", static_cast<int>(a36), {"Yellow Line"});
-delhiMetro.addEdge("HUDA City Centre", "IFFCO Chowk", static_cast<int>(a36), {"Yellow Line"});
-
-
-delhiMetro.addEdge("Shaheed Sthal (New Bus Adda)", "Hindon River", static_cast<int>(b1), {"Red Line"});
-delhiMetro.addEdge("Hindon River", "Shaheed Sthal (New Bus Adda)", static_cast<int>(b1), {"Red Line"});
+    uint32_t at = 0;
+    for (int band = 0; band < FARE_BANDS; ++band) {
+        zones.bandStart[band] = at;
+        while (at < zones.distances.size() && fareBand(zones.distances[at]) == band) {
+            ++at;
+        }
+    }
+    zones.bandStart[FARE_BANDS] = at;
+    if constexpr (SEARCH_STATS) {
+        SearchStats::record(SEARCH_FARE_BAND, ws.settled, ws.counters, zones.stations.size(), zones.stations.empty(),
+                            chrono::steady_clock::now() - start);
+    }
+}
+
+// Per-edge state flags of a LiveNetwork; an edge is open when no flag is set
+const uint8_t EDGE_CLOSED = 1;          // the segment itself is closed
+const uint8_t EDGE_STATION_CLOSED = 2;  // a station at either end is closed
+
+// One directed edge whose effective weight changed, INF while closed
+struct EdgeChange {
+    uint32_t from;
+    uint32_t to;
+    uint32_t edge;
+    int before;
+    int after;
+};
 
-delhiMetro.addEdge("Hindon River", "Arthala", static_cast<int>(b2), {"Red Line"});
-delhiMetro.addEdge("Arthala", "Hindon River", static_cast<int>(b2), {"Red Line"});
+// Closures and re-weighting on top of a frozen CompactGraph, without a
+// rebuild: the network keeps its own copy of the weights and one state byte
+// per edge, and view() hands both to the GraphView searches, which skip
+// edges with any flag set. Segments are changed in both directions at once.
+// Every call reports the directed edges whose effective weight changed, for
+// AllPairsTable::repair(). MetroGraph owns one and routes every search
+// through it; reset() reopens everything.
+class LiveNetwork {
+public:
+    void reset(const CompactGraph& compact) {
+        graph = &compact;
+        weights = compact.weights;
+        state.assign(compact.edgeCount(), 0);
+        reverseEdge.assign(compact.edgeCount(), SearchWorkspace::NONE);
+        sourceOf.assign(compact.edgeCount(), 0);
+        closedStations.assign(compact.stationCount(), false);
+        flagged = reweighted = shortened = 0;
+        for (uint32_t u = 0; u < compact.stationCount(); ++u) {
+            for (uint32_t e = compact.offsets[u]; e < compact.offsets[u + 1]; ++e) {
+                sourceOf[e] = u;
+                reverseEdge[e] = findEdge(compact.targets[e], u);
+            }
+        }
+    }
 
-delhiMetro.addEdge("Arthala", "Mohan Nagar", static_cast<int>(b3), {"Red Line"});
-delhiMetro.addEdge("Mohan Nagar", "Arthala", static_cast<int>(b3), {"Red Line"});
+    // The live network as searches see it: no closure flags while nothing is closed
+    GraphView view() const {
+        GraphView live = graph->view();
+        live.weights = weights.data();
+        live.edgeState = flagged > 0 ? state.data() : nullptr;
+        return live;
+    }
 
-delhiMetro.addEdge("Mohan Nagar", "Shyam Park", static_cast<int>(b4), {"Red Line"});
-delhiMetro.addEdge("Shyam Park", "Mohan Nagar", static_cast<int>(b4), {"Red Line"});
+    // Anything closed or re-weighted, so preprocessing done on the frozen
+    // network (CH shortcuts) no longer holds
+    bool modified() const { return flagged > 0 || reweighted > 0; }
+    // Some edge is shorter than frozen, so bounds derived from the frozen weights (A*) may overestimate
+    bool shortenedAny() const { return shortened > 0; }
 
-delhiMetro.addEdge("Shyam Park", "Major Mohit Sharma Rajendra Nagar", static_cast<int>(b5), {"Red Line"});
-delhiMetro.addEdge("Major Mohit Sharma Rajendra Nagar", "Shyam Park", static_cast<int>(b5), {"Red Line"});
+    int weight(uint32_t e) const { return state[e] ? SearchWorkspace::INF : weights[e]; }
+    uint32_t reverse(uint32_t e) const { return reverseEdge[e]; }
+    uint32_t source(uint32_t e) const { return sourceOf[e]; }
 
-delhiMetro.addEdge("Major Mohit Sharma Rajendra Nagar", "Raj Bagh", static_cast<int>(b6), {"Red Line"});
-delhiMetro.addEdge("Raj Bagh", "Major Mohit Sharma Rajendra Nagar", static_cast<int>(b6), {"Red Line"});
+    // Close or reopen the segment between adjacent stations a and b; false if they are not adjacent
+    bool closeSegment(uint32_t a, uint32_t b, vector<EdgeChange>& changed) {
+        return updateSegment(a, b, EDGE_CLOSED, true, -1, changed);
+    }
 
-delhiMetro.addEdge("Raj Bagh", "Shaheed Nagar", static_cast<int>(b7), {"Red Line"});
-delhiMetro.addEdge("Shaheed Nagar", "Raj Bagh", static_cast<int>(b7), {"Red Line"});
+    bool openSegment(uint32_t a, uint32_t b, vector<EdgeChange>& changed) {
+        return updateSegment(a, b, EDGE_CLOSED, false, -1, changed);
+    }
 
-delhiMetro.addEdge("Shaheed Nagar", "Dilshad Garden", static_cast<int>(b8), {"Red Line"});
-delhiMetro.addEdge("Dilshad Garden", "Shaheed Nagar", static_cast<int>(b8), {"Red Line"});
+    // New length in metres for the segment between a and b (a slow zone, a
+    // diversion); false unless metres is positive. Closing is closeSegment().
+    bool setSegmentWeight(uint32_t a, uint32_t b, int metres, vector<EdgeChange>& changed) {
+        if (metres <= 0) {
+            return false;
+        }
+        return updateSegment(a, b, 0, false, metres, changed);
+    }
 
-delhiMetro.addEdge("Dilshad Garden", "Jhilmil", static_cast<int>(b9), {"Red Line"});
-delhiMetro.addEdge("Jhilmil", "Dilshad Garden", static_cast<int>(b9), {"Red Line"});
+    // A closed station can be neither boarded nor passed through: every edge at it closes
+    bool closeStation(uint32_t s, vector<EdgeChange>& changed) {
+        if (s >= closedStations.size()) {
+            return false;
+        }
+        closedStations[s] = true;
+        for (uint32_t e = graph->offsets[s]; e < graph->offsets[s + 1]; ++e) {
+            setFlag(e, EDGE_STATION_CLOSED, true, changed);
+            setFlag(reverseEdge[e], EDGE_STATION_CLOSED, true, changed);
+        }
+        return true;
+    }
 
-delhiMetro.addEdge("Jhilmil", "Mansarovar Park", static_cast<int>(b10), {"Red Line"});
-delhiMetro.addEdge("Mansarovar Park", "Jhilmil", static_cast<int>(b10), {"Red Line"});
+    // Reopen s; edges whose other end is still closed stay closed
+    bool openStation(uint32_t s, vector<EdgeChange>& changed) {
+        if (s >= closedStations.size()) {
+            return false;
+        }
+        closedStations[s] = false;
+        for (uint32_t e = graph->offsets[s]; e < graph->offsets[s + 1]; ++e) {
+            if (!stationClosed(graph->targets[e])) {
+                setFlag(e, EDGE_STATION_CLOSED, false, changed);
+                setFlag(reverseEdge[e], EDGE_STATION_CLOSED, false, changed);
+            }
+        }
+        return true;
+    }
 
-delhiMetro.addEdge("Mansarovar Park", "Shahdara", static_cast<int>(b11), {"Red Line"});
-delhiMetro.addEdge("Shahdara", "Mansarovar Park", static_cast<int>(b11), {"Red Line"});
+    bool stationClosed(uint32_t s) const {
+        return s < closedStations.size() && closedStations[s];
+    }
 
-delhiMetro.addEdge("Shahdara", "Welcome", static_cast<int>(b12), {"Red Line"});
-delhiMetro.addEdge("Welcome", "Shahdara", static_cast<int>(b12), {"Red Line"});
+private:
+    const CompactGraph* graph = nullptr;
+    vector<int> weights;
+    vector<uint8_t> state;
+    vector<uint32_t> reverseEdge;   // v -> u for every u -> v
+    vector<uint32_t> sourceOf;      // u for every u -> v
+    vector<bool> closedStations;
+    uint32_t flagged = 0;           // edges with any state flag
+    uint32_t reweighted = 0;        // edges whose weight differs from the frozen one
+    uint32_t shortened = 0;         // ...and of those, the shorter ones
+
+    uint32_t findEdge(uint32_t a, uint32_t b) const {
+        for (uint32_t e = graph->offsets[a]; e < graph->offsets[a + 1]; ++e) {
+            if (graph->targets[e] == b) {
+                return e;
+            }
+        }
+        return SearchWorkspace::NONE;
+    }
 
-delhiMetro.addEdge("Welcome", "Seelampur", static_cast<int>(b13), {"Red Line"});
-delhiMetro.addEdge("Seelampur", "Welcome", static_cast<int>(b13), {"Red Line"});
+    bool updateSegment(uint32_t a, uint32_t b, uint8_t flag, bool raise, int metres, vector<EdgeChange>& changed) {
+        uint32_t e = a < closedStations.size() ? findEdge(a, b) : SearchWorkspace::NONE;
+        if (e == SearchWorkspace::NONE || reverseEdge[e] == SearchWorkspace::NONE) {
+            return false;
+        }
+        for (uint32_t edge : {e, reverseEdge[e]}) {
+            if (flag) {
+                setFlag(edge, flag, raise, changed);
+            } else {
+                setWeight(edge, metres, changed);
+            }
+        }
+        return true;
+    }
 
-delhiMetro.addEdge("Seelampur", "Shastri Park", static_cast<int>(b14), {"Red Line"});
-delhiMetro.addEdge("Shastri Park", "Seelampur", static_cast<int>(b14), {"Red Line"});
+    void setFlag(uint32_t e, uint8_t flag, bool raise, vector<EdgeChange>& changed) {
+        int before = weight(e);
+        flagged -= state[e] != 0;
+        state[e] = raise ? state[e] | flag : state[e] & ~flag;
+        flagged += state[e] != 0;
+        record(e, before, changed);
+    }
 
-delhiMetro.addEdge("Shastri Park", "Kashmere Gate", static_cast<int>(b15), {"Red Line"});
-delhiMetro.addEdge("Kashmere Gate", "Shastri Park", static_cast<int>(b15), {"Red Line"});
+    void setWeight(uint32_t e, int metres, vector<EdgeChange>& changed) {
+        int before = weight(e);
+        int frozen = graph->weights[e];
+        reweighted -= weights[e] != frozen;
+        shortened -= weights[e] < frozen;
+        weights[e] = metres;
+        reweighted += weights[e] != frozen;
+        shortened += weights[e] < frozen;
+        record(e, before, changed);
+    }
 
-delhiMetro.addEdge("Kashmere Gate", "Tis Hazari", static_cast<int>(b16), {"Red Line"});
-delhiMetro.addEdge("Tis Hazari", "Kashmere Gate", static_cast<int>(b16), {"Red Line"});
+    void record(uint32_t e, int before, vector<EdgeChange>& changed) const {
+        if (weight(e) != before) {
+            changed.push_back(EdgeChange{sourceOf[e], graph->targets[e], e, before, weight(e)});
+        }
+    }
+};
 
-delhiMetro.addEdge("Tis Hazari", "Pulbangash", static_cast<int>(b17), {"Red Line"});
-delhiMetro.addEdge("Pulbangash", "Tis Hazari", static_cast<int>(b17), {"Red Line"});
+// What the build stage folded away on the way from the declared network to
+// the graph the searches run on. Edge counts are directed: addEdge() adds two.
+struct BuildReport {
+    size_t declarations = 0;        // addStation() calls
+    size_t mergedDeclarations = 0;  // repeat declarations folded into the first one
+    double coordinateSpreadKm = 0;  // farthest a repeat declaration lay from the kept coordinate
+    size_t edgesAdded = 0;
+    size_t duplicateEdges = 0;      // same endpoints and lines as an edge already kept
+    size_t parallelEdges = 0;       // same endpoints on other lines, merged into the kept edge
+    size_t selfLoops = 0;           // hops from a station to itself
+    size_t stations = 0;
+    size_t edges = 0;               // directed edges left after the build
+    double milliseconds = 0;        // time of the last freeze()
+};
 
-delhiMetro.addEdge("Pulbangash", "Pratap Nagar", static_cast<int>(b18), {"Red Line"});
-delhiMetro.addEdge("Pratap Nagar", "Pulbangash", static_cast<int>(b18), {"Red Line"});
+// Graph class using adjacency list representation
+class MetroGraph {
+private:
+    unordered_map<string, vector<Edge>> adjacencyList;
+    unordered_map<string, Station> stations;
+    LineRegistry lineRegistry;
+    CompactGraph compact;
+    LiveNetwork closures;   // live state of the compact graph, every search goes through its view
+    bool frozen = false;
+    uint64_t version = 0;   // bumped by every mutation, cached results from older versions are stale
+    BuildReport buildStats;
 
-delhiMetro.addEdge("Pratap Nagar", "Shastri Nagar", static_cast<int>(b19), {"Red Line"});
-delhiMetro.addEdge("Shastri Nagar", "Pratap Nagar", static_cast<int>(b19), {"Red Line"});
+public:
+    // Function to add an undirected edge between two stations
+    void addEdge(string station1, string station2, int distance, vector<string> lines) {
+        addEdge(station1, station2, distance, lineRegistry.internAll(lines));
+    }
 
-delhiMetro.addEdge("Shastri Nagar", "Inderlok", static_cast<int>(b20), {"Red Line"});
-delhiMetro.addEdge("Inderlok", "Shastri Nagar", static_cast<int>(b20), {"Red Line"});
+    // Same as above with the lines already interned
+    void addEdge(const string& station1, const string& station2, int distance, const LineSet& lines) {
+        adjacencyList[station1].emplace_back(station2, distance, lines);
+        adjacencyList[station2].emplace_back(station1, distance, lines);
+        buildStats.edgesAdded += 2;
+        frozen = false;
+        ++version;
+    }
 
-delhiMetro.addEdge("Inderlok", "Kanhaiya Nagar", static_cast<int>(b21), {"Red Line"});
-delhiMetro.addEdge("Kanhaiya Nagar", "Inderlok", static_cast<int>(b21), {"Red Line"});
+    // Build stage: reduce the adjacency list to the minimal graph and lay out
+    // the CSR copy of the network. Every station keeps one edge per
+    // neighbour: repeats of a hop (a line listed twice, or several lines
+    // sharing a segment) collapse into the shortest of them, serving the union
+    // of their lines, and hops from a station to itself are dropped. Call once
+    // loading is done; any later addEdge/addStation drops back to the
+    // map-based search until the next freeze, which also reopens everything
+    // closed on the old layout.
+    void freeze() {
+        auto start = chrono::steady_clock::now();
+        for (auto& entry : adjacencyList) {
+            collapseEdges(entry.first, entry.second);
+        }
+        compact.clear();
 
-delhiMetro.addEdge("Kanhaiya Nagar", "Keshav Puram", static_cast<int>(b22), {"Red Line"});
-delhiMetro.addEdge("Keshav Puram", "Kanhaiya Nagar", static_cast<int>(b22), {"Red Line"});
+        // Intern every station name, in sorted order so ids are stable between runs
+        vector<string> names;
+        names.reserve(adjacencyList.size() + stations.size());
+        for (const auto& entry : adjacencyList) {
+            names.push_back(entry.first);
+        }
+        for (const auto& entry : stations) {
+            if (adjacencyList.find(entry.first) == adjacencyList.end()) {
+                names.push_back(entry.first);
+            }
+        }
+        sort(names.begin(), names.end());
+        compact.names = names;
+        compact.ids.reserve(names.size());
+        for (uint32_t id = 0; id < names.size(); ++id) {
+            compact.ids[names[id]] = id;
+        }
 
-delhiMetro.addEdge("Keshav Puram", "Netaji Subhash Place", static_cast<int>(b23), {"Red Line"});
-delhiMetro.addEdge("Netaji Subhash Place", "Keshav Puram", static_cast<int>(b23), {"Red Line"});
+        // Lay the edges out contiguously, one slice per station
+        compact.offsets.assign(names.size() + 1, 0);
+        for (uint32_t id = 0; id < names.size(); ++id) {
+            auto it = adjacencyList.find(names[id]);
+            size_t degree = it == adjacencyList.end() ? 0 : it->second.size();
+            compact.offsets[id + 1] = compact.offsets[id] + static_cast<uint32_t>(degree);
+        }
+        compact.targets.resize(compact.offsets.back());
+        compact.weights.resize(compact.offsets.back());
+        compact.edgeLines.resize(compact.offsets.back());
+        for (uint32_t id = 0; id < names.size(); ++id) {
+            auto it = adjacencyList.find(names[id]);
+            if (it == adjacencyList.end()) {
+                continue;
+            }
+            uint32_t slot = compact.offsets[id];
+            for (const auto& edge : it->second) {
+                compact.targets[slot] = compact.ids[edge.to];
+                compact.weights[slot] = edge.distance;
+                compact.edgeLines[slot] = edge.metroLines;
+                ++slot;
+            }
+        }
+        buildStats.stations = compact.stationCount();
+        buildStats.edges = compact.edgeCount();
+        buildStats.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        closures.reset(compact);
+        frozen = true;
+    }
 
-delhiMetro.addEdge("Netaji Subhash Place", "Shakurpur", static_cast<int>(b24), {"Red Line"});
-delhiMetro.addEdge("Shakurpur", "Netaji Subhash Place", static_cast<int>(b24), {"Red Line"});
+    const BuildReport& buildReport() const { return buildStats; }
+
+    bool isFrozen() const { return frozen; }
+    uint64_t graphVersion() const { return version; }
+    const CompactGraph& compactGraph() const { return compact; }
+
+    // The frozen graph with its closures and re-weighted segments applied:
+    // what every search of a frozen graph runs on
+    GraphView view() const { return closures.view(); }
+    const LiveNetwork& liveNetwork() const { return closures; }
+
+    // Close, reopen or re-weight a segment or station of the frozen graph in
+    // place (see LiveNetwork). A change that moves any edge weight bumps
+    // graphVersion() and appends the directed edges it moved to changed, for
+    // AllPairsTable::repair(). Returns false for stations that are not
+    // adjacent or unknown, and for segment lengths that are not positive.
+    // Not safe while queries run.
+    bool closeSegment(uint32_t a, uint32_t b, vector<EdgeChange>& changed) {
+        size_t before = changed.size();
+        return bumpOn(closures.closeSegment(a, b, changed), changed, before);
+    }
 
-delhiMetro.addEdge("Shakurpur", "Punjabi Bagh West", static_cast<int>(b25), {"Red Line"});
-delhiMetro.addEdge("Punjabi Bagh West", "Shakurpur", static_cast<int>(b25), {"Red Line"});
+    bool openSegment(uint32_t a, uint32_t b, vector<EdgeChange>& changed) {
+        size_t before = changed.size();
+        return bumpOn(closures.openSegment(a, b, changed), changed, before);
+    }
 
-delhiMetro.addEdge("Punjabi Bagh West", "Ashok Park Main", static_cast<int>(b26), {"Red Line"});
-delhiMetro.addEdge("Ashok Park Main", "Punjabi Bagh West", static_cast<int>(b26), {"Red Line"});
+    bool setSegmentWeight(uint32_t a, uint32_t b, int metres, vector<EdgeChange>& changed) {
+        size_t before = changed.size();
+        return bumpOn(closures.setSegmentWeight(a, b, metres, changed), changed, before);
+    }
 
-delhiMetro.addEdge("Ashok Park Main", "Satguru Ram Singh Marg", static_cast<int>(b27), {"Red Line"});
-delhiMetro.addEdge("Satguru Ram Singh Marg", "Ashok Park Main", static_cast<int>(b27), {"Red Line"});
+    bool closeStation(uint32_t s, vector<EdgeChange>& changed) {
+        size_t before = changed.size();
+        return bumpOn(closures.closeStation(s, changed), changed, before);
+    }
 
-delhiMetro.addEdge("Satguru Ram Singh Marg", "Kirti Nagar", static_cast<int>(b28), {"Red Line"});
-delhiMetro.addEdge("Kirti Nagar", "Satguru Ram Singh Marg", static_cast<int>(b28), {"Red Line"});
+    bool openStation(uint32_t s, vector<EdgeChange>& changed) {
+        size_t before = changed.size();
+        return bumpOn(closures.openStation(s, changed), changed, before);
+    }
 
+    // Dijkstra's algorithm on the CSR graph, working purely on station ids.
+    // Fills path with ids from source to destination and returns the distance.
+    // All scratch memory comes from the workspace, so repeated calls do not allocate.
+    int dijkstraIds(uint32_t source, uint32_t destination, vector<uint32_t>& path, SearchWorkspace& ws) const {
+        return searchPath(view(), source, destination, path, ws);
+    }
 
-delhiMetro.addEdge("Kashmere Gate", "Lal Qila", static_cast<int>(d1), {"Violet Line"});
-delhiMetro.addEdge("Lal Qila", "Kashmere Gate", static_cast<int>(d1), {"Violet Line"});
+    // One-to-all Dijkstra: settles every station reachable from source and
+    // leaves the distances and parent links in the workspace
+    void dijkstraAll(uint32_t source, SearchWorkspace& ws) const {
+        searchTree(view(), source, ws);
+    }
 
-delhiMetro.addEdge("Lal Qila", "Jama Masjid", static_cast<int>(d2), {"Violet Line"});
-delhiMetro.addEdge("Jama Masjid", "Lal Qila", static_cast<int>(d2), {"Violet Line"});
+    // Convenience overload with a throwaway workspace
+    int dijkstraIds(uint32_t source, uint32_t destination, vector<uint32_t>& path) const {
+        SearchWorkspace ws;
+        return dijkstraIds(source, destination, path, ws);
+    }
 
-delhiMetro.addEdge("Jama Masjid", "Delhi Gate", static_cast<int>(d3), {"Violet Line"});
-delhiMetro.addEdge("Delhi Gate", "Jama Masjid", static_cast<int>(d3), {"Violet Line"});
+    // Dijkstra's algorithm to find shortest path from source to destination.
+    // Runs on the CSR graph once frozen, otherwise on the adjacency list.
+    // Read-only and safe to call from several threads, each thread gets its own scratch space.
+    pair<vector<string>, int> dijkstra(const string& source, const string& destination) const {
+        static thread_local SearchWorkspace ws;
+        return dijkstra(source, destination, ws);
+    }
 
-delhiMetro.addEdge("Delhi Gate", "ITO", static_cast<int>(d4), {"Violet Line"});
-delhiMetro.addEdge("ITO", "Delhi Gate", static_cast<int>(d4), {"Violet Line"});
+    // Same as above with caller-owned scratch space
+    pair<vector<string>, int> dijkstra(const string& source, const string& destination, SearchWorkspace& ws) const {
+        if (!frozen) {
+            return dijkstraMap(source, destination);
+        }
 
-delhiMetro.addEdge("ITO", "Mandi House", static_cast<int>(d5), {"Violet Line"});
-delhiMetro.addEdge("Mandi House", "ITO", static_cast<int>(d5), {"Violet Line"});
+        vector<string> path;
+        uint32_t from, to;
+        if (!compact.lookup(source, from) || !compact.lookup(destination, to)) {
+            return {path, numeric_limits<int>::max()};
+        }
+        static thread_local vector<uint32_t> ids;
+        chrono::steady_clock::time_point start;
+        if constexpr (SEARCH_STATS) {
+            start = chrono::steady_clock::now();
+        }
+        int totalDistance = dijkstraIds(from, to, ids, ws);
+        if constexpr (SEARCH_STATS) {
+            SearchStats::record(ENGINE_DIJKSTRA, ws, nullptr, ids.size(), totalDistance,
+                                chrono::steady_clock::now() - start);
+        }
+        path.reserve(ids.size());
+        for (uint32_t id : ids) {
+            path.push_back(compact.names[id]);
+        }
+        return {path, totalDistance};
+    }
 
-delhiMetro.addEdge("Mandi House", "Janpath", static_cast<int>(d6), {"Violet Line"});
-delhiMetro.addEdge("Janpath", "Mandi House", static_cast<int>(d6), {"Violet Line"});
+    // Up to k loopless alternatives from source to destination, shortest first,
+    // each shaped like the result of dijkstra(). Needs a frozen graph.
+    vector<pair<vector<string>, int>> kShortestPaths(const string& source, const string& destination, size_t k) const {
+        static thread_local PathsWorkspace ws;
+        static thread_local vector<RankedPath> paths;
+        vector<pair<vector<string>, int>> routes;
+        uint32_t from, to;
+        if (!frozen || !compact.lookup(source, from) || !compact.lookup(destination, to)) {
+            return routes;
+        }
+        ::kShortestPaths(view(), from, to, k, paths, ws);
+        for (const RankedPath& path : paths) {
+            routes.emplace_back();
+            for (uint32_t id : path.stations) {
+                routes.back().first.push_back(compact.names[id]);
+            }
+            routes.back().second = path.distance;
+        }
+        return routes;
+    }
 
-delhiMetro.addEdge("Janpath", "Central Secretariat", static_cast<int>(d7), {"Violet Line"});
-delhiMetro.addEdge("Central Secretariat", "Janpath", static_cast<int>(d7), {"Violet Line"});
+    // Dijkstra's algorithm over the string-keyed adjacency list
+    pair<vector<string>, int> dijkstraMap(const string& source, const string& destination) const {
+        // Priority queue for Dijkstra's algorithm (min-heap)
+        priority_queue<pair<int, string>, vector<pair<int, string>>, greater<pair<int, string>>> pq;
 
-delhiMetro.addEdge("Central Secretariat", "Khan Market", static_cast<int>(d8), {"Violet Line"});
-delhiMetro.addEdge("Khan Market", "Central Secretariat", static_cast<int>(d8), {"Violet Line"});
+        // Distance map
+        unordered_map<string, int> distance;
+        for (auto& pair : adjacencyList) {
+            distance[pair.first] = numeric_limits<int>::max();
+        }
+        distance[source] = 0;
 
-delhiMetro.addEdge("Khan Market", "Jawaharlal Nehru Stadium", static_cast<int>(d9), {"Violet Line"});
-delhiMetro.addEdge("Jawaharlal Nehru Stadium", "Khan Market", static_cast<int>(d9), {"Violet Line"});
+        // Previous station map for path reconstruction
+        unordered_map<string, string> previous;
 
-delhiMetro.addEdge("Jawaharlal Nehru Stadium", "Jangpura", static_cast<int>(d10), {"Violet Line"});
-delhiMetro.addEdge("Jangpura", "Jawaharlal Nehru Stadium", static_cast<int>(d10), {"Violet Line"});
+        // Insert source into priority queue
+        pq.push({0, source});
 
-delhiMetro.addEdge("Jangpura", "Lajpat Nagar", static_cast<int>(d11), {"Violet Line"});
-delhiMetro.addEdge("Lajpat Nagar", "Jangpura", static_cast<int>(d11), {"Violet Line"});
+        while (!pq.empty()) {
+            string u = pq.top().second;
+            int dist = pq.top().first;
+            pq.pop();
 
-delhiMetro.addEdge("Lajpat Nagar", "Moolchand", static_cast<int>(d12), {"Violet Line"});
-delhiMetro.addEdge("Moolchand", "Lajpat Nagar", static_cast<int>(d12), {"Violet Line"});
+            // Stop early if we reach the destination
+            if (u == destination) {
+                break;
+            }
 
-delhiMetro.addEdge("Moolchand", "Kailash Colony", static_cast<int>(d13), {"Violet Line"});
-delhiMetro.addEdge("Kailash Colony", "Moolchand", static_cast<int>(d13), {"Violet Line"});
+            // If current distance is greater than known distance, skip
+            if (dist > distance[u]) {
+                continue;
+            }
 
-delhiMetro.addEdge("Kailash Colony", "Nehru Place", static_cast<int>(d14), {"Violet Line"});
-delhiMetro.addEdge("Nehru Place", "Kailash Colony", static_cast<int>(d14), {"Violet Line"});
+            // Explore neighbors
+            auto neighbors = adjacencyList.find(u);
+            if (neighbors == adjacencyList.end()) {
+                continue;
+            }
+            for (const auto& edge : neighbors->second) {
+                string v = edge.to;
+                int weight = edge.distance;
+                int new_dist = dist + weight;
 
-delhiMetro.addEdge("Nehru Place", "Kalkaji Mandir", static_cast<int>(d15), {"Violet Line"});
-delhiMetro.addEdge("Kalkaji Mandir", "Nehru Place", static_cast<int>(d15), {"Violet Line"});
+                // Update shortest path to neighbor if found a shorter path
+                if (new_dist < distance[v]) {
+                    distance[v] = new_dist;
+                    previous[v] = u;
+                    pq.push({new_dist, v});
+                }
+            }
+        }
 
-delhiMetro.addEdge("Kalkaji Mandir", "Govind Puri", static_cast<int>(d16), {"Violet Line"});
-delhiMetro.addEdge("Govind Puri", "Kalkaji Mandir", static_cast<int>(d16), {"Violet Line"});
+        // Reconstruct path
+        vector<string> path;
+        int totalDistance = distance[destination];
+        if (totalDistance == numeric_limits<int>::max()) {
+            return {path, totalDistance}; // No path found
+        }
+        for (string at = destination; !at.empty(); at = previous[at]) {
+            path.push_back(at);
+            if (at == source) break;
+        }
+        reverse(path.begin(), path.end());
 
-delhiMetro.addEdge("Govind Puri", "Okhla NSIC", static_cast<int>(d17), {"Violet Line"});
-delhiMetro.addEdge("Okhla NSIC", "Govind Puri", static_cast<int>(d17), {"Violet Line"});
+        return {path, totalDistance};
+    }
 
-delhiMetro.addEdge("Okhla NSIC", "Harkesh Nagar Okhla", static_cast<int>(d18), {"Violet Line"});
-delhiMetro.addEdge("Harkesh Nagar Okhla", "Okhla NSIC", static_cast<int>(d18), {"Violet Line"});
+    // Function to calculate Euclidean distance between two stations (based on latitude and longitude)
+    static double toRadians(double degree) {
+        return degree * M_PI / 180.0;
+    }
 
-delhiMetro.addEdge("Harkesh Nagar Okhla", "Jasola Apollo", static_cast<int>(d19), {"Violet Line"});
-delhiMetro.addEdge("Jasola Apollo", "Harkesh Nagar Okhla", static_cast<int>(d19), {"Violet Line"});
+    double calculateDistance(const string& station1, const string& station2) const {
+        static const Station unknown;
+        const Station* first = findStation(station1);
+        const Station* second = findStation(station2);
+        if (!first) first = &unknown;
+        if (!second) second = &unknown;
+        return haversine(first->latitude, first->longitude, second->latitude, second->longitude);
+    }
 
-delhiMetro.addEdge("Jasola Apollo", "Sarita Vihar", static_cast<int>(d20), {"Violet Line"});
-delhiMetro.addEdge("Sarita Vihar", "Jasola Apollo", static_cast<int>(d20), {"Violet Line"});
+    // Haversine distance in kilometres between two coordinates
+    static double haversine(double lat1, double lon1, double lat2, double lon2) {
+        double lat1Rad = toRadians(lat1);
+        double lon1Rad = toRadians(lon1);
+        double lat2Rad = toRadians(lat2);
+        double lon2Rad = toRadians(lon2);
 
-delhiMetro.addEdge("Sarita Vihar", "Mohan Estate", static_cast<int>(d21), {"Violet Line"});
-delhiMetro.addEdge("Mohan Estate", "Sarita Vihar", static_cast<int>(d21), {"Violet Line"});
+        // Using Haversine formula for simplicity (considering Earth as a perfect sphere)
+        double dlat = lat2Rad - lat1Rad;
+        double dlon = lon2Rad - lon1Rad;
 
-delhiMetro.addEdge("Mohan Estate", "Tughlakabad", static_cast<int>(d22), {"Violet Line"});
-delhiMetro.addEdge("Tughlakabad", "Mohan Estate", static_cast<int>(d22), {"Violet Line"});
+        double a = sin(dlat / 2) * sin(dlat / 2) +
+                   cos(lat1Rad) * cos(lat2Rad) *
+                   sin(dlon / 2) * sin(dlon / 2);
+        double c = 2 * atan2(sqrt(a), sqrt(1 - a));
 
-delhiMetro.addEdge("Tughlakabad", "Badarpur Border", static_cast<int>(d23), {"Violet Line"});
-delhiMetro.addEdge("Badarpur Border", "Tughlakabad", static_cast<int>(d23), {"Violet Line"});
+        // Radius of Earth in kilometers (approximate)
+        const double radius = 6371.0;
 
-delhiMetro.addEdge("Badarpur Border", "Sarai", static_cast<int>(d24), {"Violet Line"});
-delhiMetro.addEdge("Sarai", "Badarpur Border", static_cast<int>(d24), {"Violet Line"});
+        // Distance in kilometers
+        double distance = radius * c;
 
-delhiMetro.addEdge("Sarai", "NHPC Chowk", static_cast<int>(d25), {"Violet Line"});
-delhiMetro.addEdge("NHPC Chowk", "Sarai", static_cast<int>(d25), {"Violet Line"});
+        return distance;
+    }
 
-delhiMetro.addEdge("NHPC Chowk", "Mewala Maharajpur", static_cast<int>(d26), {"Violet Line"});
-delhiMetro.addEdge("Mewala Maharajpur", "NHPC Chowk", static_cast<int>(d26), {"Violet Line"});
+    // Function to calculate fare based on distance
+    static double calculateFare(int distance) {
+        // Example fare calculation based on Delhi Metro fare structure
+        return FARE_BAND_PRICES[fareBand(distance)];
+    }
 
-delhiMetro.addEdge("Mewala Maharajpur", "Sector 28", static_cast<int>(d27), {"Violet Line"});
-delhiMetro.addEdge("Sector 28", "Mewala Maharajpur", static_cast<int>(d27), {"Violet Line"});
+    // Function to add a station with details including latitude and longitude
+    void addStation(string name, double latitude, double longitude, vector<string> metroLines) {
+        addStation(name, latitude, longitude, lineRegistry.internAll(metroLines));
+    }
 
-delhiMetro.addEdge("Sector 28", "Badkhal Mor", static_cast<int>(d28), {"Violet Line"});
-delhiMetro.addEdge("Badkhal Mor", "Sector 28", static_cast<int>(d28), {"Violet Line"});
+    // Same as above with the lines already interned. Interchanges are declared
+    // once per line: a repeat declaration adds its lines to the station, and
+    // the first declaration's coordinate stays canonical so every edge at the
+    // station is measured from the same point.
+    void addStation(const string& name, double latitude, double longitude, const LineSet& metroLines) {
+        auto it = stations.find(name);
+        if (it == stations.end()) {
+            Station& station = stations[name];
+            station = Station(name, latitude, longitude);
+            station.metroLines = metroLines;
+        } else {
+            Station& station = it->second;
+            station.metroLines = station.metroLines | metroLines;
+            buildStats.coordinateSpreadKm = max(buildStats.coordinateSpreadKm,
+                                                haversine(station.latitude, station.longitude, latitude, longitude));
+            ++buildStats.mergedDeclarations;
+        }
+        ++buildStats.declarations;
+        frozen = false;
+        ++version;
+    }
 
-delhiMetro.addEdge("Badkhal Mor", "Old Faridabad", static_cast<int>(d29), {"Violet Line"});
-delhiMetro.addEdge("Old Faridabad", "Badkhal Mor", static_cast<int>(d29), {"Violet Line"});
+    // Every declared station, keyed by name
+    const unordered_map<string, Station>& getStations() const {
+        return stations;
+    }
 
-delhiMetro.addEdge("Old Faridabad", "Neelam Chowk Ajronda", static_cast<int>(d30), {"Violet Line"});
-delhiMetro.addEdge("Neelam Chowk Ajronda", "Old Faridabad", static_cast<int>(d30), {"Violet Line"});
+    // Function to get the id of a metro line, registering it on first use
+    uint16_t internLine(const string& line) {
+        return lineRegistry.intern(line);
+    }
 
-delhiMetro.addEdge("Neelam Chowk Ajronda", "Bata Chowk", static_cast<int>(d31), {"Violet Line"});
-delhiMetro.addEdge("Bata Chowk", "Neelam Chowk Ajronda", static_cast<int>(d31), {"Violet Line"});
+    const LineRegistry& lines() const { return lineRegistry; }
 
-delhiMetro.addEdge("Bata Chowk", "Escorts Mujesar", static_cast<int>(d32), {"Violet Line"});
-delhiMetro.addEdge("Escorts Mujesar", "Bata Chowk", static_cast<int>(d32), {"Violet Line"});
+    // Function to look up a station record, nullptr if the station was never added
+    const Station* findStation(const string& name) const {
+        auto it = stations.find(name);
+        return it == stations.end() ? nullptr : &it->second;
+    }
 
+    // Function to get the line set of a station (empty for unknown stations)
+    const LineSet& getLineSet(const string& station) const {
+        static const LineSet none;
+        auto it = stations.find(station);
+        return it == stations.end() ? none : it->second.metroLines;
+    }
 
+    // Function to get the metro lines common to two stations, as a bitmask
+    LineSet getCommonLineSet(const string& station1, const string& station2) const {
+        return getLineSet(station1) & getLineSet(station2);
+    }
 
-delhiMetro.addEdge("Majlis Park", "Keshav Puram", static_cast<int>(e1), {"Pink Line"});
-delhiMetro.addEdge("Keshav Puram", "Majlis Park", static_cast<int>(e1), {"Pink Line"});
+    // Function to get the metro lines common to two stations
+    vector<string> getCommonLines(const string& station1, const string& station2) const {
+        return lineRegistry.namesOf(getCommonLineSet(station1, station2));
+    }
 
-delhiMetro.addEdge("Keshav Puram", "Kanhaiya Nagar", static_cast<int>(e2), {"Pink Line"});
-delhiMetro.addEdge("Kanhaiya Nagar", "Keshav Puram", static_cast<int>(e2), {"Pink Line"});
+    // Function to get metro lines for a station
+    vector<string> getMetroLines(const string& station) const {
+        return lineRegistry.namesOf(stations.at(station).metroLines);
+    }
 
-delhiMetro.addEdge("Kanhaiya Nagar", "Shastri Nagar", static_cast<int>(e3), {"Pink Line"});
-delhiMetro.addEdge("Shastri Nagar", "Kanhaiya Nagar", static_cast<int>(e3), {"Pink Line"});
+private:
+    // A closure that moved any edge weight makes answers cached for this version stale
+    bool bumpOn(bool applied, const vector<EdgeChange>& changed, size_t before) {
+        if (changed.size() > before) {
+            ++version;
+        }
+        return applied;
+    }
 
-delhiMetro.addEdge("Shastri Nagar", "Tis Hazari", static_cast<int>(e4), {"Pink Line"});
-delhiMetro.addEdge("Tis Hazari", "Shastri Nagar", static_cast<int>(e4), {"Pink Line"});
+    // Keep one edge per neighbour of station, in first-seen order. Stations
+    // have a handful of neighbours, so the kept prefix is scanned linearly.
+    void collapseEdges(const string& station, vector<Edge>& edges) {
+        size_t count = 0;
+        for (size_t i = 0; i < edges.size(); ++i) {
+            Edge& edge = edges[i];
+            if (edge.to == station) {
+                ++buildStats.selfLoops;
+                continue;
+            }
+            size_t k = 0;
+            while (k < count && edges[k].to != edge.to) {
+                ++k;
+            }
+            if (k == count) {
+                if (count != i) {
+                    edges[count] = move(edge);
+                }
+                ++count;
+                continue;
+            }
+            Edge& first = edges[k];
+            if (!edge.metroLines.without(first.metroLines).any()) {
+                ++buildStats.duplicateEdges;
+            } else {
+                ++buildStats.parallelEdges;
+            }
+            first.distance = min(first.distance, edge.distance);
+            first.metroLines = first.metroLines | edge.metroLines;
+        }
+        edges.erase(edges.begin() + count, edges.end());
+    }
+};
 
-delhiMetro.addEdge("Tis Hazari", "Karam Pura", static_cast<int>(e5), {"Pink Line"});
-delhiMetro.addEdge("Karam Pura", "Tis Hazari", static_cast<int>(e5), {"Pink Line"});
+// Lower-case letters and digits, every other run of characters (spaces,
+// punctuation, non-ASCII bytes) collapsed to one space: "Rohini Sector 18, 19"
+// and "rohini  sector 18 19" normalize the same
+void normalizeName(string_view name, string& normalized) {
+    normalized.clear();
+    bool gap = false;
+    for (char c : name) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (u < 128 && isalnum(u)) {
+            if (gap && !normalized.empty()) {
+                normalized.push_back(' ');
+            }
+            normalized.push_back(static_cast<char>(tolower(u)));
+            gap = false;
+        } else {
+            gap = true;
+        }
+    }
+}
+
+// Distinct trigrams of a normalized name, padded so short names and word starts count
+void nameTrigrams(const string& key, vector<uint32_t>& grams) {
+    grams.clear();
+    string padded = "  " + key + " ";
+    for (size_t i = 0; i + 3 <= padded.size(); ++i) {
+        grams.push_back(uint32_t(uint8_t(padded[i])) << 16 | uint32_t(uint8_t(padded[i + 1])) << 8 |
+                        uint8_t(padded[i + 2]));
+    }
+    sort(grams.begin(), grams.end());
+    grams.erase(unique(grams.begin(), grams.end()), grams.end());
+}
+
+// A station a name resolved to, with how closely it matched (1 = exact)
+struct NameMatch {
+    uint32_t station;
+    float score;
+};
 
-delhiMetro.addEdge("Karam Pura", "Maya Puri", static_cast<int>(e6), {"Pink Line"});
-delhiMetro.addEdge("Maya Puri", "Karam Pura", static_cast<int>(e6), {"Pink Line"});
+// Scratch space for StationIndex lookups, reset lazily like SearchWorkspace
+struct NameWorkspace {
+    string normalized;
+    vector<uint32_t> grams;
+    vector<uint16_t> shared;        // trigrams each entry has in common with the query
+    vector<uint32_t> stamp;
+    vector<uint32_t> touched;
+    uint32_t epoch = 0;
+
+    void prepare(size_t entries) {
+        if (stamp.size() < entries) {
+            shared.resize(entries);
+            stamp.resize(entries, 0);
+        }
+        if (++epoch == 0) {
+            fill(stamp.begin(), stamp.end(), 0);
+            epoch = 1;
+        }
+        touched.clear();
+    }
+};
 
-delhiMetro.addEdge("Maya Puri", "Patel Nagar", static_cast<int>(e7), {"Pink Line"});
-delhiMetro.addEdge("Patel Nagar", "Maya Puri", static_cast<int>(e7), {"Pink Line"});
+// Resolves what riders type to station ids. Every station name and alias is
+// normalized into an entry; exact entries are a hash lookup, a prefix trie
+// keeps the best completions at every node, and a trigram index ranks near
+// misses by Dice similarity. Each lookup touches only the trie path or the
+// posting lists of the query's trigrams, so its cost is set by the query,
+// not by the number of stations.
+class StationIndex {
+public:
+    static constexpr size_t COMPLETIONS = 6;        // kept per trie node
+    static constexpr float MIN_SCORE = 0.45f;       // weakest fuzzy match resolve() accepts
+    static constexpr size_t COMMON_GRAM = 1024;     // longer posting lists are skipped while others remain
+
+    // Index the station names of a frozen graph plus (alias, station) pairs;
+    // aliases naming unknown stations are skipped and counted
+    size_t build(const CompactGraph& graph, const vector<pair<string, string>>& aliases) {
+        entryKeys.clear();
+        entryStation.clear();
+        exact.clear();
+        string key;
+        for (uint32_t id = 0; id < graph.stationCount(); ++id) {
+            normalizeName(graph.names[id], key);
+            addEntry(key, id);
+        }
+        size_t unknown = 0;
+        for (const auto& alias : aliases) {
+            uint32_t id;
+            if (!graph.lookup(alias.second, id)) {
+                ++unknown;
+                continue;
+            }
+            normalizeName(alias.first, key);
+            addEntry(key, id);
+        }
+        buildTrie();
+        buildTrigrams();
+        return unknown;
+    }
 
-delhiMetro.addEdge("Patel Nagar", "Kirti Nagar", static_cast<int>(e8), {"Pink Line"});
-delhiMetro.addEdge("Kirti Nagar", "Patel Nagar", static_cast<int>(e8), {"Pink Line"});
+    size_t entryCount() const { return entryKeys.size(); }
 
-delhiMetro.addEdge("Kirti Nagar", "Rajouri Garden", static_cast<int>(e9), {"Pink Line"});
-delhiMetro.addEdge("Rajouri Garden", "Kirti Nagar", static_cast<int>(e9), {"Pink Line"});
+    // Best station for a name: an exact normalized match, else the best fuzzy
+    // match scoring at least MIN_SCORE. Returns false if nothing is close enough.
+    bool resolve(string_view name, NameMatch& match, NameWorkspace& ws) const {
+        normalizeName(name, ws.normalized);
+        auto it = exact.find(ws.normalized);
+        if (it != exact.end()) {
+            match = NameMatch{entryStation[it->second], 1.0f};
+            return true;
+        }
+        static thread_local vector<NameMatch> ranked;
+        suggest(name, ranked, 1, ws);
+        if (ranked.empty() || ranked[0].score < MIN_SCORE) {
+            return false;
+        }
+        match = ranked[0];
+        return true;
+    }
 
-delhiMetro.addEdge("Rajouri Garden", "Maharani Bagh", static_cast<int>(e10), {"Pink Line"});
-delhiMetro.addEdge("Maharani Bagh", "Rajouri Garden", static_cast<int>(e10), {"Pink Line"});
+    // Stations whose name or alias starts with prefix, shortest names first
+    size_t complete(string_view prefix, vector<uint32_t>& stations, NameWorkspace& ws) const {
+        stations.clear();
+        normalizeName(prefix, ws.normalized);
+        uint32_t node = 0;
+        for (char c : ws.normalized) {
+            node = child(node, c);
+            if (node == NO_NODE) {
+                return 0;
+            }
+        }
+        const TrieNode& found = trie[node];
+        stations.assign(found.top, found.top + found.count);
+        return stations.size();
+    }
 
-delhiMetro.addEdge("Maharani Bagh", "Hazrat Nizamuddin", static_cast<int>(e11), {"Pink Line"});
-delhiMetro.addEdge("Hazrat Nizamuddin", "Maharani Bagh", static_cast<int>(e11), {"Pink Line"});
+    // Up to limit stations ranked by trigram similarity to name, best first
+    size_t suggest(string_view name, vector<NameMatch>& matches, size_t limit, NameWorkspace& ws) const {
+        matches.clear();
+        normalizeName(name, ws.normalized);
+        nameTrigrams(ws.normalized, ws.grams);
+        ws.prepare(entryKeys.size());
+
+        // Count shared trigrams per entry, skipping very common ones if rarer ones exist
+        size_t usable = 0;
+        for (uint32_t gram : ws.grams) {
+            auto it = postings.find(gram);
+            usable += it != postings.end() && it->second.second - it->second.first <= COMMON_GRAM;
+        }
+        for (uint32_t gram : ws.grams) {
+            auto it = postings.find(gram);
+            if (it == postings.end() || (usable > 0 && it->second.second - it->second.first > COMMON_GRAM)) {
+                continue;
+            }
+            for (uint32_t p = it->second.first; p < it->second.second; ++p) {
+                uint32_t entry = postingEntries[p];
+                if (ws.stamp[entry] != ws.epoch) {
+                    ws.stamp[entry] = ws.epoch;
+                    ws.shared[entry] = 0;
+                    ws.touched.push_back(entry);
+                }
+                ++ws.shared[entry];
+            }
+        }
 
-delhiMetro.addEdge("Hazrat Nizamuddin", "Jangpura", static_cast<int>(e12), {"Pink Line"});
-delhiMetro.addEdge("Jangpura", "Hazrat Nizamuddin", static_cast<int>(e12), {"Pink Line"});
+        // Dice similarity, then the best entry of each station
+        vector<NameMatch>& scored = rankScratch();
+        scored.clear();
+        for (uint32_t entry : ws.touched) {
+            float score = 2.0f * ws.shared[entry] / float(ws.grams.size() + entryGrams[entry]);
+            scored.push_back(NameMatch{entryStation[entry], score});
+        }
+        // Only the head needs ordering; a station has few entries, so limit ones are in it
+        size_t head = min(scored.size(), limit * 4 + 4);
+        partial_sort(scored.begin(), scored.begin() + head, scored.end(), [](const NameMatch& a, const NameMatch& b) {
+            return a.score != b.score ? a.score > b.score : a.station < b.station;
+        });
+        scored.resize(head);
+        for (const NameMatch& candidate : scored) {
+            if (matches.size() == limit) {
+                break;
+            }
+            bool seen = false;
+            for (const NameMatch& kept : matches) {
+                seen = seen || kept.station == candidate.station;
+            }
+            if (!seen) {
+                matches.push_back(candidate);
+            }
+        }
+        size_t keep = matches.size();
+        return keep;
+    }
 
-delhiMetro.addEdge("Jangpura", "Sarai Kale Khan", static_cast<int>(e13), {"Pink Line"});
-delhiMetro.addEdge("Sarai Kale Khan", "Jangpura", static_cast<int>(e13), {"Pink Line"});
+private:
+    static constexpr uint32_t NO_NODE = numeric_limits<uint32_t>::max();
+
+    struct TrieNode {
+        uint32_t firstChild = NO_NODE;
+        uint32_t sibling = NO_NODE;
+        char label = 0;
+        uint8_t count = 0;
+        uint32_t top[COMPLETIONS];  // best completions below this node
+    };
+
+    vector<string> entryKeys;               // normalized names and aliases
+    vector<uint32_t> entryStation;
+    vector<uint16_t> entryGrams;            // distinct trigrams per entry
+    unordered_map<string, uint32_t> exact;  // normalized key -> entry
+    vector<TrieNode> trie;
+    unordered_map<uint32_t, pair<uint32_t, uint32_t>> postings;    // trigram -> range of postingEntries
+    vector<uint32_t> postingEntries;
+
+    static vector<NameMatch>& rankScratch() {
+        static thread_local vector<NameMatch> ranked;
+        return ranked;
+    }
 
-delhiMetro.addEdge("Sarai Kale Khan", "Sarai Kale Khan Metro Station", static_cast<int>(e14), {"Pink Line"});
-delhiMetro.addEdge("Sarai Kale Khan Metro Station", "Sarai Kale Khan", static_cast<int>(e14), {"Pink Line"});
+    void addEntry(const string& key, uint32_t station) {
+        if (key.empty() || !exact.emplace(key, static_cast<uint32_t>(entryKeys.size())).second) {
+            return; // a name already taken keeps its first station
+        }
+        entryKeys.push_back(key);
+        entryStation.push_back(station);
+    }
 
-delhiMetro.addEdge("Sarai Kale Khan Metro Station", "IIT Delhi", static_cast<int>(e15), {"Pink Line"});
-delhiMetro.addEdge("IIT Delhi", "Sarai Kale Khan Metro Station", static_cast<int>(e15), {"Pink Line"});
+    uint32_t child(uint32_t node, char label) const {
+        for (uint32_t c = trie[node].firstChild; c != NO_NODE; c = trie[c].sibling) {
+            if (trie[c].label == label) {
+                return c;
+            }
+        }
+        return NO_NODE;
+    }
 
-delhiMetro.addEdge("IIT Delhi", "Hauz Khas", static_cast<int>(e16), {"Pink Line"});
-delhiMetro.addEdge("Hauz Khas", "IIT Delhi", static_cast<int>(e16), {"Pink Line"});
+    // Entries go in shortest first, so each node keeps the shortest completions
+    void buildTrie() {
+        trie.assign(1, TrieNode());
+        vector<uint32_t> order(entryKeys.size());
+        for (uint32_t e = 0; e < order.size(); ++e) {
+            order[e] = e;
+        }
+        sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return entryKeys[a].size() != entryKeys[b].size() ? entryKeys[a].size() < entryKeys[b].size()
+                                                               : entryKeys[a] < entryKeys[b];
+        });
+        for (uint32_t entry : order) {
+            uint32_t station = entryStation[entry];
+            uint32_t node = 0;
+            offer(node, station);
+            for (char c : entryKeys[entry]) {
+                uint32_t next = child(node, c);
+                if (next == NO_NODE) {
+                    next = static_cast<uint32_t>(trie.size());
+                    trie.emplace_back();
+                    trie[next].label = c;
+                    trie[next].sibling = trie[node].firstChild;
+                    trie[node].firstChild = next;
+                }
+                node = next;
+                offer(node, station);
+            }
+        }
+    }
 
-delhiMetro.addEdge("Hauz Khas", "Green Park", static_cast<int>(e17), {"Pink Line"});
-delhiMetro.addEdge("Green Park", "Hauz Khas", static_cast<int>(e17), {"Pink Line"});
+    void offer(uint32_t node, uint32_t station) {
+        TrieNode& n = trie[node];
+        if (n.count < COMPLETIONS && find(n.top, n.top + n.count, station) == n.top + n.count) {
+            n.top[n.count++] = station;
+        }
+    }
 
-delhiMetro.addEdge("Green Park", "Safdarjung", static_cast<int>(e18), {"Pink Line"});
-delhiMetro.addEdge("Safdarjung", "Green Park", static_cast<int>(e18), {"Pink Line"});
+    void buildTrigrams() {
+        vector<pair<uint32_t, uint32_t>> pairs;     // (trigram, entry)
+        vector<uint32_t> grams;
+        entryGrams.assign(entryKeys.size(), 0);
+        for (uint32_t e = 0; e < entryKeys.size(); ++e) {
+            nameTrigrams(entryKeys[e], grams);
+            entryGrams[e] = static_cast<uint16_t>(min<size_t>(grams.size(), numeric_limits<uint16_t>::max()));
+            for (uint32_t gram : grams) {
+                pairs.emplace_back(gram, e);
+            }
+        }
+        sort(pairs.begin(), pairs.end());
+        postings.clear();
+        postingEntries.resize(pairs.size());
+        for (uint32_t i = 0; i < pairs.size(); ++i) {
+            postingEntries[i] = pairs[i].second;
+            auto it = postings.emplace(pairs[i].first, make_pair(i, i)).first;
+            it->second.second = i + 1;
+        }
+    }
+};
 
-delhiMetro.addEdge("Safdarjung", "Lajpat Nagar", static_cast<int>(e19), {"Pink Line"});
-delhiMetro.addEdge("Lajpat Nagar", "Safdarjung", static_cast<int>(e19), {"Pink Line"});
+// A station near a point, with its Haversine distance in km
+struct SpatialMatch {
+    uint32_t station;
+    double km;
+};
 
-delhiMetro.addEdge("Lajpat Nagar", "Moolchand", static_cast<int>(e20), {"Pink Line"});
-delhiMetro.addEdge("Moolchand", "Lajpat Nagar", static_cast<int>(e20), {"Pink Line"});
+// Static k-d tree over station coordinates. Points are stored as unit
+// vectors, where straight-line (chord) distance orders stations exactly as
+// great-circle distance does, so pruning is exact anywhere on the globe;
+// distances reported back are refined with the Haversine formula. The tree is
+// implicit: each range is split at its median along its widest axis,
+// which nth_element finds in linear time, so the build is O(n log n).
+class SpatialIndex {
+public:
+    // Index every station of a frozen graph that has coordinates
+    void build(const MetroGraph& graph) {
+        const CompactGraph& compact = graph.compactGraph();
+        points.clear();
+        for (uint32_t id = 0; id < compact.stationCount(); ++id) {
+            const Station* station = graph.findStation(compact.names[id]);
+            if (station) {
+                points.push_back(makePoint(station->latitude, station->longitude, id));
+            }
+        }
+        axis.assign(points.size(), 0);
+        split(0, points.size());
+    }
 
-delhiMetro.addEdge("Moolchand", "Hazarat Nizamuddin Metro Station", static_cast<int>(e21), {"Pink Line"});
-delhiMetro.addEdge("Hazarat Nizamuddin Metro Station", "Moolchand", static_cast<int>(e21), {"Pink Line"});
+    size_t size() const { return points.size(); }
 
-delhiMetro.addEdge("Hazarat Nizamuddin Metro Station", "Sarai Kale Khan", static_cast<int>(e22), {"Pink Line"});
-delhiMetro.addEdge("Sarai Kale Khan", "Hazarat Nizamuddin Metro Station", static_cast<int>(e22), {"Pink Line"});
+    // The k stations closest to (latitude, longitude), nearest first
+    size_t nearest(double latitude, double longitude, size_t k, vector<SpatialMatch>& matches) const {
+        matches.clear();
+        if (k == 0 || points.empty()) {
+            return 0;
+        }
+        Point query = makePoint(latitude, longitude, 0);
+        vector<pair<double, uint32_t>>& best = heapScratch();   // max-heap on squared chord
+        best.clear();
+        searchNearest(0, points.size(), query, k, best);
+        sort_heap(best.begin(), best.end());
+        for (const auto& found : best) {
+            matches.push_back(refine(latitude, longitude, points[found.second]));
+        }
+        return matches.size();
+    }
 
-delhiMetro.addEdge("Sarai Kale Khan", "Sarai Kale Khan Metro Station", static_cast<int>(e23), {"Pink Line"});
-delhiMetro.addEdge("Sarai Kale Khan Metro Station", "Sarai Kale Khan", static_cast<int>(e23), {"Pink Line"});
+    // Every station within km of (latitude, longitude), nearest first
+    size_t within(double latitude, double longitude, double km, vector<SpatialMatch>& matches) const {
+        matches.clear();
+        if (points.empty() || km < 0) {
+            return 0;
+        }
+        // Chord length subtending km of arc; the small margin keeps boundary stations in
+        double chord = 2.0 * sin(min(km / EARTH_RADIUS_KM, M_PI) / 2.0) * (1.0 + 1e-9);
+        Point query = makePoint(latitude, longitude, 0);
+        searchRadius(0, points.size(), query, chord * chord, latitude, longitude, km, matches);
+        sort(matches.begin(), matches.end(),
+             [](const SpatialMatch& a, const SpatialMatch& b) { return a.km != b.km ? a.km < b.km : a.station < b.station; });
+        return matches.size();
+    }
 
-delhiMetro.addEdge("Sarai Kale Khan Metro Station", "Jangpura", static_cast<int>(e24), {"Pink Line"});
-delhiMetro.addEdge("Jangpura", "Sarai Kale Khan Metro Station", static_cast<int>(e24), {"Pink Line"});
+private:
+    static constexpr double EARTH_RADIUS_KM = 6371.0;   // as in MetroGraph::haversine()
 
-delhiMetro.addEdge("Jangpura", "Hazrat Nizamuddin", static_cast<int>(e25), {"Pink Line"});
-delhiMetro.addEdge("Hazrat Nizamuddin", "Jangpura", static_cast<int>(e25), {"Pink Line"});
+    struct Point {
+        double coord[3];    // unit vector
+        double latitude;
+        double longitude;
+        uint32_t station;
+    };
 
-delhiMetro.addEdge("Hazrat Nizamuddin", "Maharani Bagh", static_cast<int>(e26), {"Pink Line"});
-delhiMetro.addEdge("Maharani Bagh", "Hazrat Nizamuddin", static_cast<int>(e26), {"Pink Line"});
+    vector<Point> points;   // tree order: the node of range [lo, hi) sits at its midpoint
+    vector<uint8_t> axis;   // split axis of the node at each position
 
-delhiMetro.addEdge("Maharani Bagh", "Rajouri Garden", static_cast<int>(e27), {"Pink Line"});
-delhiMetro.addEdge("Rajouri Garden", "Maharani Bagh", static_cast<int>(e27), {"Pink Line"});
+    static vector<pair<double, uint32_t>>& heapScratch() {
+        static thread_local vector<pair<double, uint32_t>> best;
+        return best;
+    }
 
-delhiMetro.addEdge("Rajouri Garden", "Kirti Nagar", static_cast<int>(e28), {"Pink Line"});
-delhiMetro.addEdge("Kirti Nagar", "Rajouri Garden", static_cast<int>(e28), {"Pink Line"});
+    static Point makePoint(double latitude, double longitude, uint32_t station) {
+        double lat = MetroGraph::toRadians(latitude), lon = MetroGraph::toRadians(longitude);
+        return Point{{cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat)}, latitude, longitude, station};
+    }
 
-delhiMetro.addEdge("Kirti Nagar", "Patel Nagar", static_cast<int>(e29), {"Pink Line"});
-delhiMetro.addEdge("Patel Nagar", "Kirti Nagar", static_cast<int>(e29), {"Pink Line"});
+    static double chord2(const Point& a, const Point& b) {
+        double dx = a.coord[0] - b.coord[0], dy = a.coord[1] - b.coord[1], dz = a.coord[2] - b.coord[2];
+        return dx * dx + dy * dy + dz * dz;
+    }
 
-delhiMetro.addEdge("Patel Nagar", "Maya Puri", static_cast<int>(e30), {"Pink Line"});
-delhiMetro.addEdge("Maya Puri", "Patel Nagar", static_cast<int>(e30), {"Pink Line"});
+    static SpatialMatch refine(double latitude, double longitude, const Point& point) {
+        return SpatialMatch{point.station, MetroGraph::haversine(latitude, longitude, point.latitude, point.longitude)};
+    }
 
-delhiMetro.addEdge("Maya Puri", "Karam Pura", static_cast<int>(e31), {"Pink Line"});
-delhiMetro.addEdge("Karam Pura", "Maya Puri", static_cast<int>(e31), {"Pink Line"});
-
-delhiMetro.addEdge("Karam Pura", "Tis Hazari", static_cast<int>(e32), {"Pink Line"});
-delhiMetro.addEdge("Tis Hazari", "Karam Pura", static_cast<int>(e32), {"Pink Line"});
-
-delhiMetro.addEdge("Tis Hazari", "Shastri Nagar", static_cast<int>(e33), {"Pink Line"});
-delhiMetro.addEdge("Shastri Nagar", "Tis Hazari", static_cast<int>(e33), {"Pink Line"});
+    void split(size_t lo, size_t hi) {
+        if (hi - lo <= 1) {
+            return;
+        }
+        double low[3] = {2, 2, 2}, high[3] = {-2, -2, -2};
+        for (size_t i = lo; i < hi; ++i) {
+            for (int a = 0; a < 3; ++a) {
+                low[a] = min(low[a], points[i].coord[a]);
+                high[a] = max(high[a], points[i].coord[a]);
+            }
+        }
+        int widest = 0;
+        for (int a = 1; a < 3; ++a) {
+            if (high[a] - low[a] > high[widest] - low[widest]) {
+                widest = a;
+            }
+        }
+        size_t mid = lo + (hi - lo) / 2;
+        nth_element(points.begin() + lo, points.begin() + mid, points.begin() + hi,
+                    [widest](const Point& a, const Point& b) { return a.coord[widest] < b.coord[widest]; });
+        axis[mid] = static_cast<uint8_t>(widest);
+        split(lo, mid);
+        split(mid + 1, hi);
+    }
 
-delhiMetro.addEdge("Shastri Nagar", "Kanhaiya Nagar", static_cast<int>(e34), {"Pink Line"});
-delhiMetro.addEdge("Kanhaiya Nagar", "Shastri Nagar", static_cast<int>(e34), {"Pink Line"});
+    void searchNearest(size_t lo, size_t hi, const Point& query, size_t k, vector<pair<double, uint32_t>>& best) const {
+        if (lo >= hi) {
+            return;
+        }
+        size_t mid = lo + (hi - lo) / 2;
+        double d = chord2(query, points[mid]);
+        if (best.size() < k) {
+            best.emplace_back(d, static_cast<uint32_t>(mid));
+            push_heap(best.begin(), best.end());
+        } else if (d < best.front().first) {
+            pop_heap(best.begin(), best.end());
+            best.back() = make_pair(d, static_cast<uint32_t>(mid));
+            push_heap(best.begin(), best.end());
+        }
+        // Near side first, far side only if the splitting plane is closer than the kth best
+        double delta = query.coord[axis[mid]] - points[mid].coord[axis[mid]];
+        bool left = delta < 0;
+        searchNearest(left ? lo : mid + 1, left ? mid : hi, query, k, best);
+        if (best.size() < k || delta * delta < best.front().first) {
+            searchNearest(left ? mid + 1 : lo, left ? hi : mid, query, k, best);
+        }
+    }
 
-delhiMetro.addEdge("Kanhaiya Nagar", "Keshav Puram", static_cast<int>(e35), {"Pink Line"});
-delhiMetro.addEdge("Keshav Puram", "Kanhaiya Nagar", static_cast<int>(e35), {"Pink Line"});
+    void searchRadius(size_t lo, size_t hi, const Point& query, double limit2, double latitude, double longitude,
+                      double km, vector<SpatialMatch>& matches) const {
+        if (lo >= hi) {
+            return;
+        }
+        size_t mid = lo + (hi - lo) / 2;
+        if (chord2(query, points[mid]) <= limit2) {
+            SpatialMatch match = refine(latitude, longitude, points[mid]);
+            if (match.km <= km) {
+                matches.push_back(match);
+            }
+        }
+        double delta = query.coord[axis[mid]] - points[mid].coord[axis[mid]];
+        if (delta < 0 || delta * delta <= limit2) {
+            searchRadius(lo, mid, query, limit2, latitude, longitude, km, matches);
+        }
+        if (delta >= 0 || delta * delta <= limit2) {
+            searchRadius(mid + 1, hi, query, limit2, latitude, longitude, km, matches);
+        }
+    }
+};
 
-delhiMetro.addEdge("Keshav Puram", "Majlis Park", static_cast<int>(e36), {"Pink Line"});
-delhiMetro.addEdge("Majlis Park", "Keshav Puram", static_cast<int>(e36), {"Pink Line"});
+// FNV-1a hash of a byte range, pass the previous result as seed to hash several ranges
+uint64_t fnv1a64(const char* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Identifies a network version: hash of the CSR topology and weights
+uint64_t graphFingerprint(const CompactGraph& graph) {
+    uint64_t hash = fnv1a64(reinterpret_cast<const char*>(graph.offsets.data()), graph.offsets.size() * sizeof(uint32_t));
+    hash = fnv1a64(reinterpret_cast<const char*>(graph.targets.data()), graph.targets.size() * sizeof(uint32_t), hash);
+    return fnv1a64(reinterpret_cast<const char*>(graph.weights.data()), graph.weights.size() * sizeof(int), hash);
+}
+
+// Station coordinates laid out as structure-of-arrays by compact id, with the
+// trigonometry done once at build time: radians and cos(latitude) for the
+// scalar formula, and the point on the unit sphere for the batch kernel. The
+// haversine term sin^2(angle / 2) is a quarter of the squared chord between
+// the two points, so a batched pair needs only differences, a dot product and
+// one asin, which the AVX2 kernel evaluates four pairs at a time with a
+// polynomial. The chord form has no cancellation for close stations and
+// agrees with MetroGraph::haversine() to well under a millimetre. The scalar
+// path (used without AVX2, for batch tails and single pairs) is the same
+// formula as MetroGraph::haversine() on the stored radians.
+class CoordinateStore {
+public:
+    static constexpr double EARTH_RADIUS_KM = 6371.0;   // as in MetroGraph::haversine()
+
+    // Place every compact station; unknown stations sit at (0, 0) as in calculateDistance()
+    void build(const MetroGraph& metro) {
+        const CompactGraph& graph = metro.compactGraph();
+        uint32_t n = graph.stationCount();
+        latRad.assign(n, 0.0);
+        lonRad.assign(n, 0.0);
+        for (uint32_t id = 0; id < n; ++id) {
+            if (const Station* station = metro.findStation(graph.names[id])) {
+                latRad[id] = MetroGraph::toRadians(station->latitude);
+                lonRad[id] = MetroGraph::toRadians(station->longitude);
+            }
+        }
+        cosLat.resize(n);
+        unitX.resize(n);
+        unitY.resize(n);
+        unitZ.resize(n);
+        for (uint32_t id = 0; id < n; ++id) {
+            cosLat[id] = cos(latRad[id]);
+            unitX[id] = cosLat[id] * cos(lonRad[id]);
+            unitY[id] = cosLat[id] * sin(lonRad[id]);
+            unitZ[id] = sin(latRad[id]);
+        }
+    }
 
-delhiMetro.addEdge("Majlis Park", "Keshav Puram", static_cast<int>(e37), {"Pink Line"});
-delhiMetro.addEdge("Keshav Puram", "Majlis Park", static_cast<int>(e37), {"Pink Line"});
+    uint32_t size() const { return static_cast<uint32_t>(latRad.size()); }
 
+    // True when batch calls run the AVX2 kernel; false forces the scalar path
+    bool vectorized() const { return useVector; }
+    void setVectorized(bool enabled) { useVector = enabled && avx2Supported(); }
 
-delhiMetro.addEdge("Janakpuri West", "Dabri Mor", static_cast<int>(f1), {"Magenta Line"});
-delhiMetro.addEdge("Dabri Mor", "Janakpuri West", static_cast<int>(f1), {"Magenta Line"});
+    // Haversine distance in km between two stations
+    double distance(uint32_t a, uint32_t b) const {
+        double sinHalfLat = sin((latRad[b] - latRad[a]) / 2);
+        double sinHalfLon = sin((lonRad[b] - lonRad[a]) / 2);
+        double h = sinHalfLat * sinHalfLat + cosLat[a] * cosLat[b] * sinHalfLon * sinHalfLon;
+        return 2 * EARTH_RADIUS_KM * atan2(sqrt(h), sqrt(1 - h));
+    }
 
-delhiMetro.addEdge("Dabri Mor", "Dashrathpuri", static_cast<int>(f2), {"Magenta Line"});
-delhiMetro.addEdge("Dashrathpuri", "Dabri Mor", static_cast<int>(f2), {"Magenta Line"});
+    // out[i] = distance(from[i], to[i]) for i < count
+    void distances(const uint32_t* from, const uint32_t* to, size_t count, double* out) const {
+        size_t done = 0;
+#if defined(__x86_64__)
+        if (useVector) {
+            done = pairsAvx2(from, to, count, out);
+        }
+#endif
+        for (size_t i = done; i < count; ++i) {
+            out[i] = distance(from[i], to[i]);
+        }
+    }
 
-delhiMetro.addEdge("Dashrathpuri", "Palam", static_cast<int>(f3), {"Magenta Line"});
-delhiMetro.addEdge("Palam", "Dashrathpuri", static_cast<int>(f3), {"Magenta Line"});
+    // out[i] = distance(from, to[i]), or distance(from, i) when to is null
+    void oneToMany(uint32_t from, const uint32_t* to, size_t count, double* out) const {
+        size_t done = 0;
+#if defined(__x86_64__)
+        if (useVector) {
+            done = oneToManyAvx2(from, to, count, out);
+        }
+#endif
+        for (size_t i = done; i < count; ++i) {
+            out[i] = distance(from, to ? to[i] : static_cast<uint32_t>(i));
+        }
+    }
 
-delhiMetro.addEdge("Palam", "Sadar Bazar Cantonment", static_cast<int>(f4), {"Magenta Line"});
-delhiMetro.addEdge("Sadar Bazar Cantonment", "Palam", static_cast<int>(f4), {"Magenta Line"});
+    static bool avx2Supported() {
+#if defined(__x86_64__)
+        static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        return supported;
+#else
+        return false;
+#endif
+    }
 
-delhiMetro.addEdge("Sadar Bazar Cantonment", "Terminal 1 IGI Airport", static_cast<int>(f5), {"Magenta Line"});
-delhiMetro.addEdge("Terminal 1 IGI Airport", "Sadar Bazar Cantonment", static_cast<int>(f5), {"Magenta Line"});
+private:
+    vector<double> latRad, lonRad, cosLat;
+    vector<double> unitX, unitY, unitZ;
+    bool useVector = avx2Supported();
+
+#if defined(__x86_64__)
+    // asin(x) for four x in [0, 1]. Above 0.5 it uses asin(x) = pi/2 - 2 asin(sqrt((1 - x) / 2)),
+    // then halves the angle once, y = x / sqrt(2 (1 + sqrt(1 - x^2))), so the Taylor
+    // series only runs on |y| <= sin(pi/12) where 12 terms reach double precision.
+    __attribute__((target("avx2,fma"))) static __m256d asinAvx2(__m256d x) {
+        const __m256d one = _mm256_set1_pd(1.0), half = _mm256_set1_pd(0.5), two = _mm256_set1_pd(2.0);
+        __m256d high = _mm256_cmp_pd(x, half, _CMP_GT_OQ);
+        __m256d reduced = _mm256_blendv_pd(x, _mm256_sqrt_pd(_mm256_mul_pd(_mm256_sub_pd(one, x), half)), high);
+        __m256d cosine = _mm256_sqrt_pd(_mm256_fnmadd_pd(reduced, reduced, one));
+        __m256d y = _mm256_div_pd(reduced, _mm256_sqrt_pd(_mm256_mul_pd(two, _mm256_add_pd(one, cosine))));
+        __m256d z = _mm256_mul_pd(y, y);
+
+        // c_n = c_(n-1) (2n - 1)^2 / (2n (2n + 1)), highest order first
+        static const double COEFFICIENTS[12] = {
+            0.006447210311889649, 0.0073125258735988454, 0.008390335809616815, 0.009761609529194078,
+            0.011551800896139705, 0.01396484375,         0.017352764423076924, 0.022372159090909092,
+            0.030381944444444444, 0.044642857142857144,  0.075,                0.16666666666666666};
+        __m256d series = _mm256_set1_pd(COEFFICIENTS[0]);
+        for (int i = 1; i < 12; ++i) {
+            series = _mm256_fmadd_pd(series, z, _mm256_set1_pd(COEFFICIENTS[i]));
+        }
+        __m256d angle = _mm256_mul_pd(two, _mm256_fmadd_pd(_mm256_mul_pd(y, z), series, y));
+        __m256d complement = _mm256_fnmadd_pd(two, angle, _mm256_set1_pd(M_PI / 2));
+        return _mm256_blendv_pd(angle, complement, high);
+    }
 
-delhiMetro.addEdge("Terminal 1 IGI Airport", "Shankar Vihar", static_cast<int>(f6), {"Magenta Line"});
-delhiMetro.addEdge("Shankar Vihar", "Terminal 1 IGI Airport", static_cast<int>(f6), {"Magenta Line"});
+    // 2R asin(chord / 2) for four pairs of unit vectors
+    __attribute__((target("avx2,fma"))) static __m256d chordDistanceAvx2(__m256d x1, __m256d y1, __m256d z1,
+                                                                          __m256d x2, __m256d y2, __m256d z2) {
+        __m256d dx = _mm256_sub_pd(x1, x2), dy = _mm256_sub_pd(y1, y2), dz = _mm256_sub_pd(z1, z2);
+        __m256d squared = _mm256_fmadd_pd(dz, dz, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dx, dx)));
+        __m256d halfChord = _mm256_mul_pd(_mm256_sqrt_pd(squared), _mm256_set1_pd(0.5));
+        halfChord = _mm256_min_pd(halfChord, _mm256_set1_pd(1.0));
+        return _mm256_mul_pd(_mm256_set1_pd(2 * EARTH_RADIUS_KM), asinAvx2(halfChord));
+    }
 
-delhiMetro.addEdge("Shankar Vihar", "Vasant Vihar", static_cast<int>(f7), {"Magenta Line"});
-delhiMetro.addEdge("Vasant Vihar", "Shankar Vihar", static_cast<int>(f7), {"Magenta Line"});
+    // Gather with an explicit source and mask, which the plain intrinsic leaves undefined
+    __attribute__((target("avx2,fma"))) static __m256d gatherAvx2(const vector<double>& values, __m128i ids) {
+        __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), values.data(), ids, all, 8);
+    }
 
-delhiMetro.addEdge("Vasant Vihar", "Munirka", static_cast<int>(f8), {"Magenta Line"});
-delhiMetro.addEdge("Munirka", "Vasant Vihar", static_cast<int>(f8), {"Magenta Line"});
+    // Both kernels return how many leading entries they filled, a multiple of 4
+    __attribute__((target("avx2,fma"))) size_t pairsAvx2(const uint32_t* from, const uint32_t* to, size_t count,
+                                                          double* out) const {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(to + i));
+            _mm256_storeu_pd(out + i, chordDistanceAvx2(gatherAvx2(unitX, a), gatherAvx2(unitY, a), gatherAvx2(unitZ, a),
+                                                        gatherAvx2(unitX, b), gatherAvx2(unitY, b), gatherAvx2(unitZ, b)));
+        }
+        return i;
+    }
 
-delhiMetro.addEdge("Munirka", "RK Puram", static_cast<int>(f9), {"Magenta Line"});
-delhiMetro.addEdge("RK Puram", "Munirka", static_cast<int>(f9), {"Magenta Line"});
+    __attribute__((target("avx2,fma"))) size_t oneToManyAvx2(uint32_t from, const uint32_t* to, size_t count,
+                                                              double* out) const {
+        __m256d x1 = _mm256_set1_pd(unitX[from]), y1 = _mm256_set1_pd(unitY[from]), z1 = _mm256_set1_pd(unitZ[from]);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m256d x2, y2, z2;
+            if (to) {
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(to + i));
+                x2 = gatherAvx2(unitX, b);
+                y2 = gatherAvx2(unitY, b);
+                z2 = gatherAvx2(unitZ, b);
+            } else {
+                x2 = _mm256_loadu_pd(unitX.data() + i);
+                y2 = _mm256_loadu_pd(unitY.data() + i);
+                z2 = _mm256_loadu_pd(unitZ.data() + i);
+            }
+            _mm256_storeu_pd(out + i, chordDistanceAvx2(x1, y1, z1, x2, y2, z2));
+        }
+        return i;
+    }
+#endif
+};
 
-delhiMetro.addEdge("RK Puram", "IIT", static_cast<int>(f10), {"Magenta Line"});
-delhiMetro.addEdge("IIT", "RK Puram", static_cast<int>(f10), {"Magenta Line"});
+// A* search guided by straight-line (Haversine) distance to the destination.
+// Edge weights are whole metres rounded from the Haversine length of each
+// hop, so the raw straight-line distance is NOT quite a lower bound: a path
+// of k hops can weigh up to k / 2 metres less than its geometric length. The
+// bound is therefore scaled by the smallest weight/length ratio over all
+// edges (about 1000 metres per km), which makes scale * straight-line
+// distance a lower bound on every path, then floored to an integer (still
+// consistent, since weights are integers). A network whose edges are shorter
+// than their endpoints' distance, e.g. loaded with zero weights, drops the
+// scale towards 0 and A* degenerates to Dijkstra.
+class AStarEngine {
+public:
+    explicit AStarEngine(const MetroGraph& metro) : metro(metro), graph(metro.compactGraph()) {
+        uint32_t n = graph.stationCount();
+        coordinates.build(metro);
+        bool allPlaced = true;
+        for (uint32_t id = 0; id < n && allPlaced; ++id) {
+            allPlaced = metro.findStation(graph.names[id]) != nullptr;
+        }
 
-delhiMetro.addEdge("IIT", "Hauz Khas", static_cast<int>(f11), {"Magenta Line"});
-delhiMetro.addEdge("Hauz Khas", "IIT", static_cast<int>(f11), {"Magenta Line"});
+        // Largest scale that keeps the bound below every edge weight, with
+        // every edge length from one batched call
+        vector<uint32_t> sources(graph.targets.size());
+        for (uint32_t u = 0; u < n; ++u) {
+            fill(sources.begin() + graph.offsets[u], sources.begin() + graph.offsets[u + 1], u);
+        }
+        vector<double> lengths(sources.size());
+        coordinates.distances(sources.data(), graph.targets.data(), sources.size(), lengths.data());
+        scale = allPlaced ? numeric_limits<double>::infinity() : 0.0;
+        for (size_t e = 0; e < lengths.size() && scale > 0; ++e) {
+            if (lengths[e] > 0) {
+                scale = min(scale, graph.weights[e] / lengths[e]);
+            }
+        }
+        if (!isfinite(scale)) {
+            scale = 0.0; // no edge with a measurable length
+        }
+        // Leave headroom for floating point error in the bound itself and for
+        // the batched edge lengths, which may differ from distance() in the last bits
+        scale *= 1.0 - 1e-9;
+    }
 
-delhiMetro.addEdge("Hauz Khas", "Panchsheel Park", static_cast<int>(f12), {"Magenta Line"});
-delhiMetro.addEdge("Panchsheel Park", "Hauz Khas", static_cast<int>(f12), {"Magenta Line"});
+    double boundScale() const { return scale; }
+
+    // Shortest path from source to destination over the live network, same
+    // contract as searchPath(). The bound is scaled to the frozen weights, so
+    // it is dropped while any segment is shorter than that.
+    int route(uint32_t source, uint32_t destination, vector<uint32_t>& path, SearchWorkspace& ws) const {
+        GraphView view = metro.view();
+        double liveScale = metro.liveNetwork().shortenedAny() ? 0.0 : scale;
+        ws.prepare(graph.stationCount());
+        path.clear();
+        ws.update(source, 0, SearchWorkspace::NONE);
+        ws.potential[source] = bound(source, destination, liveScale);
+        ws.push(ws.potential[source], source);
+
+        while (!ws.heapEmpty()) {
+            pair<int, uint32_t> top = ws.pop();
+            uint32_t u = top.second;
+            int dist = ws.distanceOf(u);
+            if (top.first > dist + ws.potential[u]) {
+                ws.countStale();
+                continue;
+            }
+            ++ws.settled;
+            if (u == destination) {
+                break;
+            }
 
-delhiMetro.addEdge("Panchsheel Park", "Chirag Delhi", static_cast<int>(f13), {"Magenta Line"});
-delhiMetro.addEdge("Chirag Delhi", "Panchsheel Park", static_cast<int>(f13), {"Magenta Line"});
+            ws.countRelaxed(view.offsets[u + 1] - view.offsets[u]);
+            for (uint32_t e = view.offsets[u]; e < view.offsets[u + 1]; ++e) {
+                if (!view.open(e)) {
+                    continue;
+                }
+                uint32_t v = view.targets[e];
+                int new_dist = dist + view.weights[e];
+                if (new_dist < ws.distanceOf(v)) {
+                    if (!ws.reached(v)) {
+                        ws.potential[v] = bound(v, destination, liveScale);
+                    }
+                    ws.update(v, new_dist, u);
+                    ws.push(new_dist + ws.potential[v], v);
+                }
+            }
+        }
 
-delhiMetro.addEdge("Chirag Delhi", "Greater Kailash", static_cast<int>(f14), {"Magenta Line"});
-delhiMetro.addEdge("Greater Kailash", "Chirag Delhi", static_cast<int>(f14), {"Magenta Line"});
+        int totalDistance = ws.distanceOf(destination);
+        if (totalDistance == SearchWorkspace::INF) {
+            return totalDistance; // No path found
+        }
+        ws.tracePath(source, destination, path);
+        return totalDistance;
+    }
 
-delhiMetro.addEdge("Greater Kailash", "Nehru Enclave", static_cast<int>(f15), {"Magenta Line"});
-delhiMetro.addEdge("Nehru Enclave", "Greater Kailash", static_cast<int>(f15), {"Magenta Line"});
+private:
+    const MetroGraph& metro;
+    const CompactGraph& graph;
+    CoordinateStore coordinates;
+    double scale = 0;
 
-delhiMetro.addEdge("Nehru Enclave", "Kalkaji Mandir", static_cast<int>(f16), {"Magenta Line"});
-delhiMetro.addEdge("Kalkaji Mandir", "Nehru Enclave", static_cast<int>(f16), {"Magenta Line"});
+    int bound(uint32_t v, uint32_t destination, double boundScale) const {
+        return boundScale > 0 ? static_cast<int>(boundScale * coordinates.distance(v, destination)) : 0;
+    }
+};
 
-delhiMetro.addEdge("Kalkaji Mandir", "Okhla NSIC", static_cast<int>(f17), {"Magenta Line"});
-delhiMetro.addEdge("Okhla NSIC", "Kalkaji Mandir", static_cast<int>(f17), {"Magenta Line"});
+// Compare settled stations and time of A* against plain Dijkstra over every station pair
+void benchmarkAStar(const MetroGraph& graph) {
+    const CompactGraph& compact = graph.compactGraph();
+    uint32_t n = compact.stationCount();
+    AStarEngine astar(graph);
+    SearchWorkspace ws;
+    vector<uint32_t> path;
+    size_t pairs = size_t(n) * n, dijkstraSettled = 0, astarSettled = 0, mismatches = 0;
+
+    vector<int> expected(pairs);
+    auto start = chrono::steady_clock::now();
+    for (uint32_t s = 0; s < n; ++s) {
+        for (uint32_t t = 0; t < n; ++t) {
+            expected[size_t(s) * n + t] = graph.dijkstraIds(s, t, path, ws);
+            dijkstraSettled += ws.settled;
+        }
+    }
+    auto middle = chrono::steady_clock::now();
+    for (uint32_t s = 0; s < n; ++s) {
+        for (uint32_t t = 0; t < n; ++t) {
+            if (astar.route(s, t, path, ws) != expected[size_t(s) * n + t]) {
+                ++mismatches;
+            }
+            astarSettled += ws.settled;
+        }
+    }
+    auto end = chrono::steady_clock::now();
+
+    double dijkstraMs = chrono::duration<double, milli>(middle - start).count();
+    double astarMs = chrono::duration<double, milli>(end - middle).count();
+    cout << "Queries: " << pairs << " (all ordered pairs), bound scale: " << astar.boundScale() << "\n";
+    cout << "Dijkstra: " << dijkstraSettled << " settled (" << double(dijkstraSettled) / pairs << "/query), "
+         << dijkstraMs << " ms\n";
+    cout << "A*: " << astarSettled << " settled (" << double(astarSettled) / pairs << "/query), "
+         << astarMs << " ms\n";
+    cout << "Distance mismatches: " << mismatches << "\n";
+}
+
+// Bidirectional Dijkstra: grows a forward frontier from the source and a
+// backward frontier from the destination, always advancing the side with the
+// smaller heap top, and stops once the two tops sum to at least the best
+// meeting distance seen. Every edge is stored in both directions (addEdge
+// inserts both) and closed or re-weighted in both at once, so the backward
+// search runs on the same live CSR arrays.
+class BidirectionalEngine {
+public:
+    explicit BidirectionalEngine(const MetroGraph& metro) : metro(metro) {}
+
+    // Same contract as searchPath(); settled counts end up split over the two workspaces
+    int route(uint32_t source, uint32_t destination, vector<uint32_t>& path,
+              SearchWorkspace& forward, SearchWorkspace& backward) const {
+        const int INF = SearchWorkspace::INF;
+        GraphView graph = metro.view();
+        forward.prepare(graph.stationCount);
+        backward.prepare(graph.stationCount);
+        path.clear();
+        forward.update(source, 0, SearchWorkspace::NONE);
+        forward.push(0, source);
+        backward.update(destination, 0, SearchWorkspace::NONE);
+        backward.push(0, destination);
+
+        int best = source == destination ? 0 : INF;
+        uint32_t meet = source;
+        while (!forward.heapEmpty() && !backward.heapEmpty()) {
+            int topForward = forward.top().first;
+            int topBackward = backward.top().first;
+            if (best != INF && topForward + topBackward >= best) {
+                break;
+            }
 
-delhiMetro.addEdge("Okhla NSIC", "Sukhdev Vihar", static_cast<int>(f18), {"Magenta Line"});
-delhiMetro.addEdge("Sukhdev Vihar", "Okhla NSIC", static_cast<int>(f18), {"Magenta Line"});
+            bool forwardStep = topForward <= topBackward;
+            SearchWorkspace& self = forwardStep ? forward : backward;
+            SearchWorkspace& other = forwardStep ? backward : forward;
+            pair<int, uint32_t> top = self.pop();
+            int dist = top.first;
+            uint32_t u = top.second;
+            if (dist > self.distanceOf(u)) {
+                self.countStale();
+                continue;
+            }
+            ++self.settled;
+            self.countRelaxed(graph.offsets[u + 1] - graph.offsets[u]);
 
-delhiMetro.addEdge("Sukhdev Vihar", "Jamia Milia Islamiya", static_cast<int>(f19), {"Magenta Line"});
-delhiMetro.addEdge("Jamia Milia Islamiya", "Sukhdev Vihar", static_cast<int>(f19), {"Magenta Line"});
+            for (uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e) {
+                if (!graph.open(e)) {
+                    continue;
+                }
+                uint32_t v = graph.targets[e];
+                int new_dist = dist + graph.weights[e];
+                if (new_dist < self.distanceOf(v)) {
+                    self.update(v, new_dist, u);
+                    self.push(new_dist, v);
+                }
+                // Any station reached from both sides is a candidate meeting point
+                if (other.reached(v) && self.distanceOf(v) + other.distanceOf(v) < best) {
+                    best = self.distanceOf(v) + other.distanceOf(v);
+                    meet = v;
+                }
+            }
+        }
 
-delhiMetro.addEdge("Jamia Milia Islamiya", "Okhla Vihar", static_cast<int>(f20), {"Magenta Line"});
-delhiMetro.addEdge("Okhla Vihar", "Jamia Milia Islamiya", static_cast<int>(f20), {"Magenta Line"});
+        if (best == INF) {
+            return best; // No path found
+        }
+        forward.tracePath(source, meet, path);
+        for (uint32_t at = backward.previousOf(meet); at != SearchWorkspace::NONE; at = backward.previousOf(at)) {
+            path.push_back(at);
+        }
+        return best;
+    }
 
-delhiMetro.addEdge("Okhla Vihar", "Jasola Vihar Shaheen Bagh", static_cast<int>(f21), {"Magenta Line"});
-delhiMetro.addEdge("Jasola Vihar Shaheen Bagh", "Okhla Vihar", static_cast<int>(f21), {"Magenta Line"});
+private:
+    const MetroGraph& metro;
+};
 
-delhiMetro.addEdge("Jasola Vihar Shaheen Bagh", "Kalindi Kunj", static_cast<int>(f22), {"Magenta Line"});
-delhiMetro.addEdge("Kalindi Kunj", "Jasola Vihar Shaheen Bagh", static_cast<int>(f22), {"Magenta Line"});
+// Contraction Hierarchies. Preprocessing contracts stations one at a time in
+// order of importance (edge difference plus contracted neighbours, updated
+// lazily), adding a shortcut u-w through v whenever a bounded witness search
+// finds no path u-w avoiding v that is as short. A query is then a
+// bidirectional search that only climbs to higher-ranked stations, and
+// shortcuts are unpacked back into the stations they skip. Edges are
+// symmetric, so one upward graph serves both search directions.
+class ContractionHierarchy {
+public:
+    static constexpr uint32_t NO_MIDDLE = SearchWorkspace::NONE;
+
+    // Contract the whole graph in rounds. Each round takes every station whose
+    // priority is lower than that of every station within two hops: no two of
+    // them share a neighbour, so their shortcuts are found and inserted in
+    // parallel without touching the same arcs. Witness searches avoid every
+    // station of the round, since none of them will be left to witness for
+    // the others. Stations next to a contracted one are only marked stale, and
+    // re-simulated (in parallel) once they are about to be picked.
+    void build(const CompactGraph& graph, unsigned threads = 0) {
+        auto start = chrono::steady_clock::now();
+        n = graph.stationCount();
+        fingerprint = graphFingerprint(graph);
+
+        vector<vector<Arc>> remaining(n);
+        for (uint32_t u = 0; u < n; ++u) {
+            for (uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e) {
+                if (graph.targets[e] != u) {
+                    addArc(remaining[u], graph.targets[e], graph.weights[e], NO_MIDDLE);
+                }
+            }
+        }
 
-delhiMetro.addEdge("Kalindi Kunj", "Okhla Bird Sanctuary", static_cast<int>(f23), {"Magenta Line"});
-delhiMetro.addEdge("Okhla Bird Sanctuary", "Kalindi Kunj", static_cast<int>(f23), {"Magenta Line"});
+        if (threads == 0) {
+            threads = max(1u, thread::hardware_concurrency());
+        }
+        threads = min<unsigned>(threads, max<uint32_t>(n, 1));
+        vector<SearchWorkspace> workspaces(threads);
+        vector<vector<Shortcut>> scratch(threads);
+
+        vector<uint32_t> contractedNeighbors(n, 0);
+        vector<int> priority(n);
+        vector<char> contracting(n, 0);
+        vector<uint32_t> alive(n);
+        for (uint32_t v = 0; v < n; ++v) {
+            alive[v] = v;
+        }
+        parallelFor(alive.size(), threads, [&](unsigned w, size_t i) {
+            priority[alive[i]] = computePriority(remaining, alive[i], contractedNeighbors, contracting,
+                                                 workspaces[w], scratch[w]);
+        });
+
+        vector<vector<Arc>> upward(n);
+        vector<char> selected(n, 0), stale(n, 0);
+        vector<uint32_t> round, refresh;
+        vector<vector<Shortcut>> shortcuts;
+        rank.assign(n, 0);
+        uint32_t order = 0;
+        rounds = 0;
+        while (!alive.empty()) {
+            // Lazy update: only candidates are re-simulated, and checked again,
+            // until every station picked is up to date. Any subset checked
+            // against one set of priorities is independent.
+            round.assign(alive.begin(), alive.end());
+            for (;;) {
+                parallelFor(round.size(), threads, [&](unsigned, size_t i) {
+                    selected[round[i]] = lowestWithinTwoHops(remaining, priority, round[i]);
+                });
+                round.erase(remove_if(round.begin(), round.end(), [&](uint32_t v) { return !selected[v]; }),
+                            round.end());
+                if (round.empty()) {
+                    round.assign(alive.begin(), alive.end()); // every candidate was overtaken, look everywhere
+                    continue;
+                }
+                refresh.clear();
+                for (uint32_t v : round) {
+                    if (stale[v]) {
+                        refresh.push_back(v);
+                    }
+                }
+                if (refresh.empty()) {
+                    break;
+                }
+                parallelFor(refresh.size(), threads, [&](unsigned w, size_t i) {
+                    priority[refresh[i]] = computePriority(remaining, refresh[i], contractedNeighbors, contracting,
+                                                           workspaces[w], scratch[w]);
+                    stale[refresh[i]] = 0;
+                });
+            }
+            for (uint32_t v : round) {
+                contracting[v] = 1;
+            }
 
-delhiMetro.addEdge("Okhla Bird Sanctuary", "Botanical Garden", static_cast<int>(f24), {"Magenta Line"});
-delhiMetro.addEdge("Botanical Garden", "Okhla Bird Sanctuary", static_cast<int>(f24), {"Magenta Line"});
+            if (shortcuts.size() < round.size()) {
+                shortcuts.resize(round.size());
+            }
+            parallelFor(round.size(), threads, [&](unsigned w, size_t i) {
+                findShortcuts(remaining, round[i], contracting, workspaces[w], shortcuts[i]);
+            });
+            parallelFor(round.size(), threads, [&](unsigned, size_t i) {
+                uint32_t v = round[i];
+                upward[v] = remaining[v];
+                for (const Arc& arc : remaining[v]) {
+                    removeArc(remaining[arc.to], v);
+                    ++contractedNeighbors[arc.to];
+                    stale[arc.to] = 1;
+                }
+                for (const Shortcut& shortcut : shortcuts[i]) {
+                    addArc(remaining[shortcut.from], shortcut.to, shortcut.weight, v);
+                    addArc(remaining[shortcut.to], shortcut.from, shortcut.weight, v);
+                }
+            });
 
+            for (uint32_t v : round) {
+                rank[v] = order++;
+                vector<Arc>().swap(remaining[v]);
+                selected[v] = 0;
+            }
+            alive.erase(remove_if(alive.begin(), alive.end(), [&](uint32_t v) { return contracting[v] != 0; }),
+                        alive.end());
+            for (uint32_t v : round) {
+                contracting[v] = 0;
+            }
+            ++rounds;
+        }
 
-delhiMetro.addEdge("New Delhi", "Shivaji Stadium", static_cast<int>(g1), {"Airport Express Line"});
-delhiMetro.addEdge("Shivaji Stadium", "New Delhi", static_cast<int>(g1), {"Airport Express Line"});
+        // Freeze the upward graph into CSR arrays
+        upOffsets.assign(n + 1, 0);
+        for (uint32_t v = 0; v < n; ++v) {
+            upOffsets[v + 1] = upOffsets[v] + static_cast<uint32_t>(upward[v].size());
+        }
+        upTargets.resize(upOffsets[n]);
+        upWeights.resize(upOffsets[n]);
+        upMiddle.resize(upOffsets[n]);
+        shortcutArcs = 0;
+        for (uint32_t v = 0; v < n; ++v) {
+            uint32_t slot = upOffsets[v];
+            for (const Arc& arc : upward[v]) {
+                upTargets[slot] = arc.to;
+                upWeights[slot] = arc.weight;
+                upMiddle[slot] = arc.middle;
+                shortcutArcs += arc.middle != NO_MIDDLE;
+                ++slot;
+            }
+        }
+        buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
 
-delhiMetro.addEdge("Shivaji Stadium", "Dhaula Kuan", static_cast<int>(g2), {"Airport Express Line"});
-delhiMetro.addEdge("Dhaula Kuan", "Shivaji Stadium", static_cast<int>(g2), {"Airport Express Line"});
+    bool ready() const { return n > 0 && !rank.empty(); }
+    double buildTimeMs() const { return buildMs; }
+    size_t arcCount() const { return upTargets.size(); }
+    size_t shortcutCount() const { return shortcutArcs; }
+    size_t roundCount() const { return rounds; }     // contraction rounds of the last build()
+
+    // Same contract as searchPath(); settled counts end up split over the two workspaces
+    int route(uint32_t source, uint32_t destination, vector<uint32_t>& path,
+              SearchWorkspace& forward, SearchWorkspace& backward) const {
+        const int INF = SearchWorkspace::INF;
+        forward.prepare(n);
+        backward.prepare(n);
+        path.clear();
+        forward.update(source, 0, SearchWorkspace::NONE);
+        forward.push(0, source);
+        backward.update(destination, 0, SearchWorkspace::NONE);
+        backward.push(0, destination);
+
+        int best = INF;
+        uint32_t meet = SearchWorkspace::NONE;
+        while (!forward.heapEmpty() || !backward.heapEmpty()) {
+            bool forwardStep = !forward.heapEmpty() &&
+                               (backward.heapEmpty() || forward.top().first <= backward.top().first);
+            SearchWorkspace& self = forwardStep ? forward : backward;
+            const SearchWorkspace& other = forwardStep ? backward : forward;
+            pair<int, uint32_t> top = self.pop();
+            int dist = top.first;
+            uint32_t u = top.second;
+            if (dist > self.distanceOf(u)) {
+                self.countStale();
+                continue;
+            }
+            if (dist >= best) {
+                self.heap.clear(); // nothing left on this side can improve the answer
+                continue;
+            }
+            ++self.settled;
+            if (other.reached(u) && dist + other.distanceOf(u) < best) {
+                best = dist + other.distanceOf(u);
+                meet = u;
+            }
+            self.countRelaxed(upOffsets[u + 1] - upOffsets[u]);
+            for (uint32_t e = upOffsets[u]; e < upOffsets[u + 1]; ++e) {
+                uint32_t v = upTargets[e];
+                int new_dist = dist + upWeights[e];
+                if (new_dist < self.distanceOf(v)) {
+                    self.update(v, new_dist, u);
+                    self.push(new_dist, v);
+                }
+            }
+        }
 
-delhiMetro.addEdge("Dhaula Kuan", "Delhi Aerocity", static_cast<int>(g3), {"Airport Express Line"});
-delhiMetro.addEdge("Delhi Aerocity", "Dhaula Kuan", static_cast<int>(g3), {"Airport Express Line"});
+        if (best == INF) {
+            return best; // No path found
+        }
+        vector<uint32_t>& hops = hopScratch();
+        forward.tracePath(source, meet, hops);
+        for (uint32_t at = backward.previousOf(meet); at != SearchWorkspace::NONE; at = backward.previousOf(at)) {
+            hops.push_back(at);
+        }
+        path.push_back(hops[0]);
+        for (size_t i = 1; i < hops.size(); ++i) {
+            unpack(hops[i - 1], hops[i], path);
+        }
+        return best;
+    }
 
-delhiMetro.addEdge("Delhi Aerocity", "Airport T3", static_cast<int>(g4), {"Airport Express Line"});
-delhiMetro.addEdge("Airport T3", "Delhi Aerocity", static_cast<int>(g4), {"Airport Express Line"});
+    // Write the hierarchy to a file, tagged with the fingerprint of the network it was built for
+    bool save(const string& file, string& error) const {
+        Header header = {};
+        memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.stationCount = n;
+        header.arcCount = upTargets.size();
+        header.fingerprint = fingerprint;
+        header.checksum = payloadChecksum();
+
+        string temporary = file + ".tmp";
+        ofstream out(temporary, ios::binary | ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writeArray(out, rank);
+        writeArray(out, upOffsets);
+        writeArray(out, upTargets);
+        writeArray(out, upWeights);
+        writeArray(out, upMiddle);
+        out.close();
+        if (!out) {
+            error = "cannot write " + temporary;
+            return false;
+        }
+        if (rename(temporary.c_str(), file.c_str()) != 0) {
+            error = "cannot rename " + temporary + " to " + file;
+            return false;
+        }
+        return true;
+    }
 
-delhiMetro.addEdge("Airport T3", "Dwarka Sector 21", static_cast<int>(g5), {"Airport Express Line"});
-delhiMetro.addEdge("Dwarka Sector 21", "Airport T3", static_cast<int>(g5), {"Airport Express Line"});
+    // Read a hierarchy back; fails if it was built for a different network version
+    bool load(const string& file, const CompactGraph& graph, string& error) {
+        ifstream in(file, ios::binary);
+        if (!in) {
+            error = "cannot open " + file;
+            return false;
+        }
+        Header header;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+            error = file + " is not a contraction hierarchy";
+            return false;
+        }
+        if (header.version != VERSION) {
+            error = file + " has version " + to_string(header.version) + ", expected " + to_string(VERSION);
+            return false;
+        }
+        if (header.stationCount != graph.stationCount() || header.fingerprint != graphFingerprint(graph)) {
+            error = file + " was built for a different network";
+            return false;
+        }
+        // Size the arrays only once the file is known to hold them
+        in.seekg(0, ios::end);
+        uint64_t length = static_cast<uint64_t>(in.tellg());
+        in.seekg(sizeof(Header));
+        uint64_t stationBytes = (uint64_t(header.stationCount) * 2 + 1) * sizeof(uint32_t);
+        uint64_t arcBytes = sizeof(uint32_t) + sizeof(int) + sizeof(uint32_t);
+        if (!in || length < sizeof(Header) + stationBytes ||
+            header.arcCount != (length - sizeof(Header) - stationBytes) / arcBytes ||
+            (length - sizeof(Header) - stationBytes) % arcBytes != 0) {
+            error = file + " is truncated or corrupt";
+            return false;
+        }
+        n = header.stationCount;
+        rank.resize(n);
+        upOffsets.resize(n + 1);
+        upTargets.resize(header.arcCount);
+        upWeights.resize(header.arcCount);
+        upMiddle.resize(header.arcCount);
+        readArray(in, rank);
+        readArray(in, upOffsets);
+        readArray(in, upTargets);
+        readArray(in, upWeights);
+        readArray(in, upMiddle);
+        if (!in || payloadChecksum() != header.checksum || !arraysValid()) {
+            n = 0;
+            rank.clear();
+            error = file + " is truncated or corrupt";
+            return false;
+        }
+        fingerprint = header.fingerprint;
+        shortcutArcs = 0;
+        for (uint32_t middle : upMiddle) {
+            shortcutArcs += middle != NO_MIDDLE;
+        }
+        buildMs = 0;
+        rounds = 0;
+        return true;
+    }
 
-delhiMetro.addEdge("Dwarka Sector 21", "Yashobhoomi Dwarka Sector 25", static_cast<int>(g6), {"Airport Express Line"});
-delhiMetro.addEdge("Yashobhoomi Dwarka Sector 25", "Dwarka Sector 21", static_cast<int>(g6), {"Airport Express Line"});
+private:
+    static constexpr char MAGIC[8] = {'D', 'M', 'E', 'T', 'R', 'O', 'C', 'H'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t WITNESS_SETTLE_LIMIT = 64;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t stationCount;
+        uint64_t arcCount;
+        uint64_t fingerprint;   // graphFingerprint() of the network
+        uint64_t checksum;      // FNV-1a over the arrays
+    };
+
+    struct Arc {
+        uint32_t to;
+        int weight;
+        uint32_t middle;        // contracted station a shortcut skips, NO_MIDDLE for a real edge
+    };
+
+    struct Shortcut {
+        uint32_t from;
+        uint32_t to;
+        int weight;
+    };
+
+    uint32_t n = 0;
+    uint64_t fingerprint = 0;
+    vector<uint32_t> rank;      // contraction order of each station
+    vector<uint32_t> upOffsets; // upward arcs of v are [upOffsets[v], upOffsets[v + 1])
+    vector<uint32_t> upTargets;
+    vector<int> upWeights;
+    vector<uint32_t> upMiddle;
+    size_t shortcutArcs = 0;
+    size_t rounds = 0;
+    double buildMs = 0;
+
+    static vector<uint32_t>& hopScratch() {
+        static thread_local vector<uint32_t> hops;
+        return hops;
+    }
 
+    // Keep one arc per neighbour, the shortest
+    static void addArc(vector<Arc>& arcs, uint32_t to, int weight, uint32_t middle) {
+        for (Arc& arc : arcs) {
+            if (arc.to == to) {
+                if (weight < arc.weight) {
+                    arc.weight = weight;
+                    arc.middle = middle;
+                }
+                return;
+            }
+        }
+        arcs.push_back(Arc{to, weight, middle});
+    }
 
-// Adding edges between the stations on the Blue Line
-delhiMetro.addEdge("Noida Electronic City", "Noida Sector 62", static_cast<int>(i1), {"Blue Line"});
-delhiMetro.addEdge("Noida Sector 62", "Noida Electronic City", static_cast<int>(i1), {"Blue Line"});
+    static void removeArc(vector<Arc>& arcs, uint32_t to) {
+        for (size_t i = 0; i < arcs.size(); ++i) {
+            if (arcs[i].to == to) {
+                arcs[i] = arcs.back();
+                arcs.pop_back();
+                return;
+            }
+        }
+    }
 
-delhiMetro.addEdge("Noida Sector 62", "Noida Sector 59", static_cast<int>(i2), {"Blue Line"});
-delhiMetro.addEdge("Noida Sector 59", "Noida Sector 62", static_cast<int>(i2), {"Blue Line"});
+    // Shortcuts contracting v would need right now. For each neighbour u a
+    // bounded Dijkstra that skips v looks for witnesses to the later neighbours;
+    // when it gives up early the shortcut is added anyway, which is always safe.
+    static void findShortcuts(const vector<vector<Arc>>& remaining, uint32_t v, const vector<char>& contracting,
+                              SearchWorkspace& ws, vector<Shortcut>& shortcuts) {
+        shortcuts.clear();
+        const vector<Arc>& arcs = remaining[v];
+        for (size_t i = 0; i < arcs.size(); ++i) {
+            uint32_t u = arcs[i].to;
+            int limit = 0;
+            for (size_t j = i + 1; j < arcs.size(); ++j) {
+                limit = max(limit, arcs[i].weight + arcs[j].weight);
+            }
+            if (i + 1 == arcs.size()) {
+                break;
+            }
 
-delhiMetro.addEdge("Noida Sector 59", "Noida Sector 61", static_cast<int>(i3), {"Blue Line"});
-delhiMetro.addEdge("Noida Sector 61", "Noida Sector 59", static_cast<int>(i3), {"Blue Line"});
+            ws.prepare(static_cast<uint32_t>(remaining.size()));
+            ws.update(u, 0, SearchWorkspace::NONE);
+            ws.push(0, u);
+            size_t settled = 0;
+            while (!ws.heapEmpty()) {
+                pair<int, uint32_t> top = ws.pop();
+                int dist = top.first;
+                uint32_t a = top.second;
+                if (dist > ws.distanceOf(a)) {
+                    continue;
+                }
+                if (dist > limit || ++settled > WITNESS_SETTLE_LIMIT) {
+                    break;
+                }
+                for (const Arc& arc : remaining[a]) {
+                    if (arc.to == v || contracting[arc.to]) {
+                        continue;
+                    }
+                    int new_dist = dist + arc.weight;
+                    if (new_dist < ws.distanceOf(arc.to)) {
+                        ws.update(arc.to, new_dist, a);
+                        ws.push(new_dist, arc.to);
+                    }
+                }
+            }
 
-delhiMetro.addEdge("Noida Sector 61", "Noida Sector 52", static_cast<int>(i4), {"Blue Line"});
-delhiMetro.addEdge("Noida Sector 52", "Noida Sector 61", static_cast<int>(i4), {"Blue Line"});
+            for (size_t j = i + 1; j < arcs.size(); ++j) {
+                int via = arcs[i].weight + arcs[j].weight;
+                if (ws.distanceOf(arcs[j].to) > via) {
+                    shortcuts.push_back(Shortcut{u, arcs[j].to, via});
+                }
+            }
+        }
+    }
 
-delhiMetro.addEdge("Noida Sector 52", "Noida Sector 34", static_cast<int>(i5), {"Blue Line"});
-delhiMetro.addEdge("Noida Sector 34", "Noida Sector 52", static_cast<int>(i5), {"Blue Line"});
+    // Edge difference (shortcuts added minus arcs removed) plus contracted neighbours,
+    // which spreads contraction evenly over the network
+    static int computePriority(const vector<vector<Arc>>& remaining, uint32_t v,
+                               const vector<uint32_t>& contractedNeighbors, const vector<char>& contracting,
+                               SearchWorkspace& ws, vector<Shortcut>& shortcuts) {
+        findShortcuts(remaining, v, contracting, ws, shortcuts);
+        return static_cast<int>(shortcuts.size()) - static_cast<int>(remaining[v].size()) +
+               static_cast<int>(contractedNeighbors[v]);
+    }
 
-delhiMetro.addEdge("Noida Sector 34", "Noida City Centre", static_cast<int>(i6), {"Blue Line"});
-delhiMetro.addEdge("Noida City Centre", "Noida Sector 34", static_cast<int>(i6), {"Blue Line"});
+    // True if v comes before every station within two hops in (priority, id) order
+    static bool lowestWithinTwoHops(const vector<vector<Arc>>& remaining, const vector<int>& priority, uint32_t v) {
+        pair<int, uint32_t> own(priority[v], v);
+        for (const Arc& arc : remaining[v]) {
+            if (pair<int, uint32_t>(priority[arc.to], arc.to) < own) {
+                return false;
+            }
+            for (const Arc& next : remaining[arc.to]) {
+                if (next.to != v && pair<int, uint32_t>(priority[next.to], next.to) < own) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
 
-delhiMetro.addEdge("Noida City Centre", "Golf Course", static_cast<int>(i7), {"Blue Line"});
-delhiMetro.addEdge("Golf Course", "Noida City Centre", static_cast<int>(i7), {"Blue Line"});
+    // Run work(worker, i) for every i below count, split round-robin over the
+    // workers; small batches run inline, where starting threads costs more
+    template <typename Work>
+    static void parallelFor(size_t count, unsigned threads, Work work) {
+        const size_t MIN_PER_THREAD = 64;
+        unsigned used = static_cast<unsigned>(min<size_t>(threads, count / MIN_PER_THREAD));
+        if (used <= 1) {
+            for (size_t i = 0; i < count; ++i) {
+                work(0u, i);
+            }
+            return;
+        }
+        vector<thread> workers;
+        for (unsigned w = 0; w < used; ++w) {
+            workers.emplace_back([&, w]() {
+                for (size_t i = w; i < count; i += used) {
+                    work(w, i);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
 
-delhiMetro.addEdge("Golf Course", "Botanical Garden", static_cast<int>(i8), {"Blue Line"});
-delhiMetro.addEdge("Botanical Garden", "Golf Course", static_cast<int>(i8), {"Blue Line"});
+    // A loaded hierarchy is one build() could have made: ranks are a
+    // permutation, the CSR offsets run from 0 to the arc count without going
+    // backwards, every arc climbs to a station, and every shortcut's middle
+    // ranks below its start with both halves present, so queries and
+    // unpacking stay in bounds and terminate
+    bool arraysValid() const {
+        vector<bool> seen(n, false);
+        for (uint32_t r : rank) {
+            if (r >= n || seen[r]) return false;
+            seen[r] = true;
+        }
+        if (upOffsets[0] != 0 || upOffsets[n] != upTargets.size()) {
+            return false;
+        }
+        for (uint32_t u = 0; u < n; ++u) {
+            if (upOffsets[u] > upOffsets[u + 1]) return false;
+        }
+        for (uint32_t u = 0; u < n; ++u) {
+            for (uint32_t e = upOffsets[u]; e < upOffsets[u + 1]; ++e) {
+                uint32_t t = upTargets[e], middle = upMiddle[e];
+                if (t >= n || rank[t] <= rank[u] || upWeights[e] < 0) {
+                    return false;
+                }
+                if (middle != NO_MIDDLE && (middle >= n || rank[middle] >= rank[u] ||
+                                            findArc(u, middle) == SearchWorkspace::NONE ||
+                                            findArc(middle, t) == SearchWorkspace::NONE)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
 
-delhiMetro.addEdge("Botanical Garden", "Noida Sector 18", static_cast<int>(i9), {"Blue Line"});
-delhiMetro.addEdge("Noida Sector 18", "Botanical Garden", static_cast<int>(i9), {"Blue Line"});
+    // Upward arc between two stations, stored on the lower-ranked one
+    uint32_t findArc(uint32_t a, uint32_t b) const {
+        uint32_t low = rank[a] < rank[b] ? a : b;
+        uint32_t high = low == a ? b : a;
+        uint32_t found = SearchWorkspace::NONE;
+        for (uint32_t e = upOffsets[low]; e < upOffsets[low + 1]; ++e) {
+            if (upTargets[e] == high && (found == SearchWorkspace::NONE || upWeights[e] < upWeights[found])) {
+                found = e;
+            }
+        }
+        return found;
+    }
 
-delhiMetro.addEdge("Noida Sector 18", "Noida Sector 16", static_cast<int>(i10), {"Blue Line"});
-delhiMetro.addEdge("Noida Sector 16", "Noida Sector 18", static_cast<int>(i10), {"Blue Line"});
+    // Append the stations after a on the hop a -> b, expanding shortcuts
+    void unpack(uint32_t a, uint32_t b, vector<uint32_t>& path) const {
+        vector<pair<uint32_t, uint32_t>> stack;
+        stack.emplace_back(a, b);
+        while (!stack.empty()) {
+            pair<uint32_t, uint32_t> hop = stack.back();
+            stack.pop_back();
+            uint32_t middle = upMiddle[findArc(hop.first, hop.second)];
+            if (middle == NO_MIDDLE) {
+                path.push_back(hop.second);
+            } else {
+                // Second half goes on the stack first so the first half is expanded first
+                stack.emplace_back(middle, hop.second);
+                stack.emplace_back(hop.first, middle);
+            }
+        }
+    }
 
-delhiMetro.addEdge("Noida Sector 16", "Noida Sector 15", static_cast<int>(i11), {"Blue Line"});
-delhiMetro.addEdge("Noida Sector 15", "Noida Sector 16", static_cast<int>(i11), {"Blue Line"});
+    uint64_t payloadChecksum() const {
+        uint64_t hash = fnv1a64(reinterpret_cast<const char*>(rank.data()), rank.size() * sizeof(uint32_t));
+        hash = fnv1a64(reinterpret_cast<const char*>(upOffsets.data()), upOffsets.size() * sizeof(uint32_t), hash);
+        hash = fnv1a64(reinterpret_cast<const char*>(upTargets.data()), upTargets.size() * sizeof(uint32_t), hash);
+        hash = fnv1a64(reinterpret_cast<const char*>(upWeights.data()), upWeights.size() * sizeof(int), hash);
+        return fnv1a64(reinterpret_cast<const char*>(upMiddle.data()), upMiddle.size() * sizeof(uint32_t), hash);
+    }
 
-delhiMetro.addEdge("Noida Sector 15", "New Ashok Nagar", static_cast<int>(i12), {"Blue Line"});
-delhiMetro.addEdge("New Ashok Nagar", "Noida Sector 15", static_cast<int>(i12), {"Blue Line"});
+    template <typename T>
+    static void writeArray(ofstream& out, const vector<T>& values) {
+        out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
 
-delhiMetro.addEdge("New Ashok Nagar", "Mayur Vihar Extension", static_cast<int>(i13), {"Blue Line"});
-delhiMetro.addEdge("Mayur Vihar Extension", "New Ashok Nagar", static_cast<int>(i13), {"Blue Line"});
+    template <typename T>
+    static void readArray(ifstream& in, vector<T>& values) {
+        in.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T));
+    }
+};
 
-delhiMetro.addEdge("Mayur Vihar Extension", "Mayur Vihar I", static_cast<int>(i14), {"Blue Line"});
-delhiMetro.addEdge("Mayur Vihar I", "Mayur Vihar Extension", static_cast<int>(i14), {"Blue Line"});
+// A journey over the state graph: stations in order, the line ridden on each hop
+// (lines[i] takes stations[i] to stations[i + 1]) and where the line changes.
+struct TransferRoute {
+    vector<uint32_t> stations;
+    vector<uint16_t> lines;
+    int distance = SearchWorkspace::INF;    // metres actually travelled
+    int transfers = 0;                      // line changes along the way
+};
 
-delhiMetro.addEdge("Mayur Vihar I", "Akshardham", static_cast<int>(i15), {"Blue Line"});
-delhiMetro.addEdge("Akshardham", "Mayur Vihar I", static_cast<int>(i15), {"Blue Line"});
+enum TransferObjective {
+    OBJECTIVE_PENALIZED,    // distance plus a fixed penalty per line change
+    OBJECTIVE_MIN_TRANSFERS // fewest line changes, shortest among those
+};
 
-delhiMetro.addEdge("Akshardham", "Yamuna Bank", static_cast<int>(i16), {"Blue Line"});
-delhiMetro.addEdge("Yamuna Bank", "Akshardham", static_cast<int>(i16), {"Blue Line"});
+// Scratch space for Pareto searches: an arena of compact labels, a heap of
+// label indices and, per state, the fewest line changes of any kept label
+struct ParetoWorkspace {
+    static constexpr uint32_t NO_PARENT = numeric_limits<uint32_t>::max();
+    static constexpr uint16_t UNREACHED = numeric_limits<uint16_t>::max();
+
+    struct Label {
+        int distance;
+        uint16_t transfers;
+        uint32_t state;
+        uint32_t parent;    // label this one was extended from
+    };
+
+    vector<Label> labels;
+    vector<pair<uint64_t, uint32_t>> heap;  // (distance << 16 | transfers, label)
+    vector<uint16_t> best;
+    vector<uint32_t> stamp;                 // best is valid only where stamp == epoch
+    uint32_t epoch = 0;
+    size_t settled = 0;                     // labels kept by the last search
+    SearchCounters counters;                // the rest of its work, see METRO_SEARCH_STATS
+
+    void prepare(uint32_t states) {
+        if (stamp.size() < states) {
+            best.resize(states);
+            stamp.resize(states, 0);
+        }
+        if (++epoch == 0) {
+            fill(stamp.begin(), stamp.end(), 0);
+            epoch = 1;
+        }
+        labels.clear();
+        heap.clear();
+        settled = 0;
+        if constexpr (SEARCH_STATS) {
+            counters = SearchCounters();
+        }
+    }
 
-delhiMetro.addEdge("Yamuna Bank", "Indraprastha", static_cast<int>(i17), {"Blue Line"});
-delhiMetro.addEdge("Indraprastha", "Yamuna Bank", static_cast<int>(i17), {"Blue Line"});
+    uint16_t bestAt(uint32_t state) const { return stamp[state] == epoch ? best[state] : UNREACHED; }
 
-delhiMetro.addEdge("Indraprastha", "Supreme Court (Pragati Maidan)", static_cast<int>(i18), {"Blue Line"});
-delhiMetro.addEdge("Supreme Court (Pragati Maidan)", "Indraprastha", static_cast<int>(i18), {"Blue Line"});
+    void countStale() {
+        if constexpr (SEARCH_STATS) ++counters.stalePops;
+    }
+    void countRelaxed(uint32_t arcs) {
+        if constexpr (SEARCH_STATS) counters.relaxed += arcs;
+    }
 
-delhiMetro.addEdge("Supreme Court (Pragati Maidan)", "Mandi House", static_cast<int>(i19), {"Blue Line"});
-delhiMetro.addEdge("Mandi House", "Supreme Court (Pragati Maidan)", static_cast<int>(i19), {"Blue Line"});
+    void setBest(uint32_t state, uint16_t transfers) {
+        stamp[state] = epoch;
+        best[state] = transfers;
+    }
 
-delhiMetro.addEdge("Mandi House", "Barakhambha Road", static_cast<int>(i20), {"Blue Line"});
-delhiMetro.addEdge("Barakhambha Road", "Mandi House", static_cast<int>(i20), {"Blue Line"});
+    void push(const Label& label) {
+        if constexpr (SEARCH_STATS) ++counters.pushes;
+        labels.push_back(label);
+        uint64_t key = (uint64_t(uint32_t(label.distance)) << 16) | label.transfers;
+        heap.emplace_back(key, static_cast<uint32_t>(labels.size() - 1));
+        push_heap(heap.begin(), heap.end(), greater<pair<uint64_t, uint32_t>>());
+    }
 
-delhiMetro.addEdge("Barakhambha Road", "Rajiv Chowk", static_cast<int>(i21), {"Blue Line"});
-delhiMetro.addEdge("Rajiv Chowk", "Barakhambha Road", static_cast<int>(i21), {"Blue Line"});
+    uint32_t pop() {
+        pop_heap(heap.begin(), heap.end(), greater<pair<uint64_t, uint32_t>>());
+        uint32_t index = heap.back().second;
+        heap.pop_back();
+        return index;
+    }
 
-delhiMetro.addEdge("Rajiv Chowk", "RK Ashram Marg", static_cast<int>(i22), {"Blue Line"});
-delhiMetro.addEdge("RK Ashram Marg", "Rajiv Chowk", static_cast<int>(i22), {"Blue Line"});
+    bool heapEmpty() const { return heap.empty(); }
+};
 
-delhiMetro.addEdge("RK Ashram Marg", "Jhandewalan", static_cast<int>(i23), {"Blue Line"});
-delhiMetro.addEdge("Jhandewalan", "RK Ashram Marg", static_cast<int>(i23), {"Blue Line"});
+// Transfer-aware searches add up 64-bit costs, see TransferRouter::route()
+using TransferWorkspace = BasicSearchWorkspace<int64_t>;
+
+// Routes over (station, line) states instead of stations, so line changes are
+// part of the search rather than guessed afterwards. Every station gets one
+// state per line serving it; ride arcs join states of the same line along an
+// edge, and transfer arcs (implicit, between all states of one station) cost
+// the penalty. The state graph depends only on the network, so it is built
+// once and the penalty is chosen per query; ride arcs keep their CSR edge and
+// take its weight from the live network, so closures apply as they happen.
+class TransferRouter {
+public:
+    static constexpr uint16_t NO_LINE = numeric_limits<uint16_t>::max();   // edges loaded without a line
+    // Cost of a line change under OBJECTIVE_MIN_TRANSFERS: route lengths are
+    // ints, so this is more than any route is long and costs compare as
+    // (transfers, distance)
+    static constexpr int64_t TRANSFER_STEP = int64_t(1) << 32;
+
+    explicit TransferRouter(const MetroGraph& metro) : live(metro.liveNetwork()) {
+        const CompactGraph& graph = metro.compactGraph();
+        uint32_t n = graph.stationCount();
+
+        // States of station s are [stateOffsets[s], stateOffsets[s + 1]), sorted by line
+        stateOffsets.assign(n + 1, 0);
+        for (uint32_t s = 0; s < n; ++s) {
+            LineSet served;
+            bool unlabelled = false;
+            for (uint32_t e = graph.offsets[s]; e < graph.offsets[s + 1]; ++e) {
+                served = served | graph.edgeLines[e];
+                unlabelled = unlabelled || !graph.edgeLines[e].any();
+            }
+            for (size_t line = 0; line < MAX_METRO_LINES; ++line) {
+                if (served.test(line)) {
+                    stateLine.push_back(static_cast<uint16_t>(line));
+                    stateStation.push_back(s);
+                }
+            }
+            if (unlabelled) {
+                stateLine.push_back(NO_LINE);
+                stateStation.push_back(s);
+            }
+            stateOffsets[s + 1] = static_cast<uint32_t>(stateLine.size());
+        }
 
-delhiMetro.addEdge("Jhandewalan", "Karol Bagh", static_cast<int>(i24), {"Blue Line"});
-delhiMetro.addEdge("Karol Bagh", "Jhandewalan", static_cast<int>(i24), {"Blue Line"});
+        // Ride arcs, one per (edge, line) pair
+        uint32_t states = stateCount();
+        arcOffsets.assign(states + 1, 0);
+        for (int pass = 0; pass < 2; ++pass) {
+            vector<uint32_t> slot(arcOffsets.begin(), arcOffsets.end() - 1);
+            for (uint32_t s = 0; s < n; ++s) {
+                for (uint32_t e = graph.offsets[s]; e < graph.offsets[s + 1]; ++e) {
+                    uint32_t t = graph.targets[e];
+                    for (uint32_t x = stateOffsets[s]; x < stateOffsets[s + 1]; ++x) {
+                        uint16_t line = stateLine[x];
+                        if (line == NO_LINE ? graph.edgeLines[e].any() : !graph.edgeLines[e].test(line)) {
+                            continue;
+                        }
+                        if (pass == 0) {
+                            ++arcOffsets[x + 1];
+                        } else {
+                            arcTargets[slot[x]] = stateOf(t, line);
+                            arcEdges[slot[x]] = e;
+                            ++slot[x];
+                        }
+                    }
+                }
+            }
+            if (pass == 0) {
+                for (uint32_t x = 0; x < states; ++x) {
+                    arcOffsets[x + 1] += arcOffsets[x];
+                }
+                arcTargets.resize(arcOffsets[states]);
+                arcEdges.resize(arcOffsets[states]);
+            }
+        }
+    }
 
-delhiMetro.addEdge("Karol Bagh", "Rajendra Place", static_cast<int>(i25), {"Blue Line"});
-delhiMetro.addEdge("Rajendra Place", "Karol Bagh", static_cast<int>(i25), {"Blue Line"});
+    uint32_t stateCount() const { return static_cast<uint32_t>(stateLine.size()); }
+    size_t arcCount() const { return arcTargets.size(); }
+
+    // Best route under the objective. OBJECTIVE_PENALIZED charges penalty metres per
+    // line change; OBJECTIVE_MIN_TRANSFERS ignores penalty and charges
+    // TRANSFER_STEP, so transfers dominate and distance breaks ties at any
+    // network size. Returns false if destination is unreachable.
+    bool route(uint32_t source, uint32_t destination, TransferObjective objective, int penalty,
+               TransferRoute& result, TransferWorkspace& ws) const {
+        chrono::steady_clock::time_point start;
+        if constexpr (SEARCH_STATS) {
+            start = chrono::steady_clock::now();
+        }
+        bool found = bestRoute(source, destination, objective, penalty, result, ws);
+        if constexpr (SEARCH_STATS) {
+            SearchStats::record(SEARCH_TRANSFERS, ws.settled, ws.counters, result.stations.size(), !found,
+                                chrono::steady_clock::now() - start);
+        }
+        return found;
+    }
 
-delhiMetro.addEdge("Rajendra Place", "Patel Nagar", static_cast<int>(i26), {"Blue Line"});
-delhiMetro.addEdge("Patel Nagar", "Rajendra Place", static_cast<int>(i26), {"Blue Line"});
+    // Every journey that is best on some trade-off between distance, line
+    // changes and fare band, shortest first (so with ever fewer changes).
+    // Multi-criteria label-setting: labels leave the queue in (distance,
+    // changes) order, so a label is dominated exactly when an earlier one at
+    // the same state, or at the destination, made no more line changes.
+    // The fare band follows distance monotonically and never prunes on its own.
+    // Returns the number of labels created.
+    size_t paretoRoutes(uint32_t source, uint32_t destination, vector<TransferRoute>& routes,
+                        ParetoWorkspace& ws) const {
+        chrono::steady_clock::time_point start;
+        if constexpr (SEARCH_STATS) {
+            start = chrono::steady_clock::now();
+        }
+        size_t labels = paretoSearch(source, destination, routes, ws);
+        if constexpr (SEARCH_STATS) {
+            size_t stations = 0;
+            for (const TransferRoute& route : routes) {
+                stations += route.stations.size();
+            }
+            SearchStats::record(SEARCH_PARETO, ws.settled, ws.counters, stations, routes.empty(),
+                                chrono::steady_clock::now() - start);
+        }
+        return labels;
+    }
 
-delhiMetro.addEdge("Patel Nagar", "Shadipur", static_cast<int>(i27), {"Blue Line"});
-delhiMetro.addEdge("Shadipur", "Patel Nagar", static_cast<int>(i27), {"Blue Line"});
+private:
+    vector<uint32_t> stateOffsets;  // per station, into the state arrays
+    vector<uint32_t> stateStation;  // station of each state
+    vector<uint16_t> stateLine;     // line of each state
+    vector<uint32_t> arcOffsets;    // ride arcs of state x are [arcOffsets[x], arcOffsets[x + 1])
+    vector<uint32_t> arcTargets;
+    vector<uint32_t> arcEdges;      // CSR edge each ride arc runs along
+    const LiveNetwork& live;
+
+    // route() without the accounting
+    bool bestRoute(uint32_t source, uint32_t destination, TransferObjective objective, int penalty,
+                   TransferRoute& result, TransferWorkspace& ws) const {
+        int64_t transferCost = objective == OBJECTIVE_MIN_TRANSFERS ? TRANSFER_STEP : max(penalty, 0);
+        result.stations.clear();
+        result.lines.clear();
+        result.distance = SearchWorkspace::INF;
+        result.transfers = 0;
+        ws.prepare(stateCount());
+        if (source == destination) {
+            result.stations.push_back(source);
+            result.distance = 0;
+            return true;
+        }
 
-delhiMetro.addEdge("Shadipur", "Kirti Nagar", static_cast<int>(i28), {"Blue Line"});
-delhiMetro.addEdge("Kirti Nagar", "Shadipur", static_cast<int>(i28), {"Blue Line"});
+        // Start on any line at the source for free
+        for (uint32_t x = stateOffsets[source]; x < stateOffsets[source + 1]; ++x) {
+            ws.update(x, 0, SearchWorkspace::NONE);
+            ws.push(0, x);
+        }
 
-delhiMetro.addEdge("Kirti Nagar", "Moti Nagar", static_cast<int>(i29), {"Blue Line"});
-delhiMetro.addEdge("Moti Nagar", "Kirti Nagar", static_cast<int>(i29), {"Blue Line"});
+        uint32_t reachedState = SearchWorkspace::NONE;
+        while (!ws.heapEmpty()) {
+            pair<int64_t, uint32_t> top = ws.pop();
+            int64_t cost = top.first;
+            uint32_t x = top.second;
+            if (cost > ws.distanceOf(x)) {
+                ws.countStale();
+                continue; // Skip stale heap entries
+            }
+            ++ws.settled;
+            uint32_t station = stateStation[x];
+            if (station == destination) {
+                reachedState = x;
+                break;
+            }
+            // Ride arcs plus transfers to the station's other states
+            ws.countRelaxed(arcOffsets[x + 1] - arcOffsets[x] + stateOffsets[station + 1] - stateOffsets[station] - 1);
+            for (uint32_t a = arcOffsets[x]; a < arcOffsets[x + 1]; ++a) {
+                int metres = live.weight(arcEdges[a]);
+                if (metres != SearchWorkspace::INF) {
+                    relax(ws, x, arcTargets[a], cost + metres);
+                }
+            }
+            for (uint32_t y = stateOffsets[station]; y < stateOffsets[station + 1]; ++y) {
+                if (y != x) {
+                    relax(ws, x, y, cost + transferCost);
+                }
+            }
+        }
+        if (reachedState == SearchWorkspace::NONE) {
+            return false;
+        }
 
-delhiMetro.addEdge("Moti Nagar", "Ramesh Nagar", static_cast<int>(i30), {"Blue Line"});
-delhiMetro.addEdge("Ramesh Nagar", "Moti Nagar", static_cast<int>(i30), {"Blue Line"});
+        vector<pair<uint32_t, int64_t>>& steps = stepScratch();
+        steps.clear();
+        for (uint32_t at = reachedState; at != SearchWorkspace::NONE; at = ws.previousOf(at)) {
+            steps.emplace_back(at, ws.distanceOf(at));
+        }
+        collectRoute(steps, result);
+        return true;
+    }
 
-delhiMetro.addEdge("Ramesh Nagar", "Rajouri Garden", static_cast<int>(i31), {"Blue Line"});
-delhiMetro.addEdge("Rajouri Garden", "Ramesh Nagar", static_cast<int>(i31), {"Blue Line"});
+    // paretoRoutes() without the accounting
+    size_t paretoSearch(uint32_t source, uint32_t destination, vector<TransferRoute>& routes,
+                        ParetoWorkspace& ws) const {
+        routes.clear();
+        ws.prepare(stateCount());
+        if (source == destination) {
+            routes.emplace_back();
+            routes.back().stations.push_back(source);
+            routes.back().distance = 0;
+            return 0;
+        }
 
-delhiMetro.addEdge("Rajouri Garden", "Tagore Garden", static_cast<int>(i32), {"Blue Line"});
-delhiMetro.addEdge("Tagore Garden", "Rajouri Garden", static_cast<int>(i32), {"Blue Line"});
+        for (uint32_t x = stateOffsets[source]; x < stateOffsets[source + 1]; ++x) {
+            ws.push(ParetoWorkspace::Label{0, 0, x, ParetoWorkspace::NO_PARENT});
+        }
 
-delhiMetro.addEdge("Tagore Garden", "Subhash Nagar", static_cast<int>(i33), {"Blue Line"});
-delhiMetro.addEdge("Subhash Nagar", "Tagore Garden", static_cast<int>(i33), {"Blue Line"});
+        uint16_t destinationBest = ParetoWorkspace::UNREACHED;
+        while (!ws.heapEmpty()) {
+            uint32_t index = ws.pop();
+            ParetoWorkspace::Label label = ws.labels[index];
+            uint32_t station = stateStation[label.state];
+            if (label.transfers >= ws.bestAt(label.state) || label.transfers >= destinationBest) {
+                ws.countStale();
+                continue; // Dominated
+            }
+            ++ws.settled;
+            ws.setBest(label.state, label.transfers);
+            if (station == destination) {
+                destinationBest = label.transfers;
+                routes.emplace_back();
+                vector<pair<uint32_t, int64_t>>& steps = stepScratch();
+                steps.clear();
+                for (uint32_t at = index; at != ParetoWorkspace::NO_PARENT; at = ws.labels[at].parent) {
+                    steps.emplace_back(ws.labels[at].state, ws.labels[at].distance);
+                }
+                collectRoute(steps, routes.back());
+                continue;
+            }
+            ws.countRelaxed(arcOffsets[label.state + 1] - arcOffsets[label.state]);
+            for (uint32_t a = arcOffsets[label.state]; a < arcOffsets[label.state + 1]; ++a) {
+                int metres = live.weight(arcEdges[a]);
+                if (metres != SearchWorkspace::INF && label.transfers < ws.bestAt(arcTargets[a])) {
+                    ws.push(ParetoWorkspace::Label{label.distance + metres, label.transfers, arcTargets[a], index});
+                }
+            }
+            if (label.transfers + 1 < min(destinationBest, ParetoWorkspace::UNREACHED)) {
+                for (uint32_t y = stateOffsets[station]; y < stateOffsets[station + 1]; ++y) {
+                    if (y != label.state && label.transfers + 1 < ws.bestAt(y)) {
+                        ws.push(ParetoWorkspace::Label{label.distance, uint16_t(label.transfers + 1), y, index});
+                    }
+                }
+            }
+        }
+        return ws.labels.size();
+    }
 
-delhiMetro.addEdge("Subhash Nagar", "Tilak Nagar", static_cast<int>(i34), {"Blue Line"});
-delhiMetro.addEdge("Tilak Nagar", "Subhash Nagar", static_cast<int>(i34), {"Blue Line"});
+    static vector<pair<uint32_t, int64_t>>& stepScratch() {
+        static thread_local vector<pair<uint32_t, int64_t>> steps;
+        return steps;
+    }
 
-delhiMetro.addEdge("Tilak Nagar", "Janakpuri East", static_cast<int>(i35), {"Blue Line"});
-delhiMetro.addEdge("Janakpuri East", "Tilak Nagar", static_cast<int>(i35), {"Blue Line"});
+    // Turn (state, cost so far) steps, listed destination first, into a route;
+    // a step between states of one station is a line change
+    void collectRoute(vector<pair<uint32_t, int64_t>>& steps, TransferRoute& result) const {
+        reverse(steps.begin(), steps.end());
+        result.stations.clear();
+        result.lines.clear();
+        result.distance = 0;
+        result.transfers = 0;
+        result.stations.push_back(stateStation[steps[0].first]);
+        for (size_t i = 1; i < steps.size(); ++i) {
+            if (stateStation[steps[i].first] == stateStation[steps[i - 1].first]) {
+                ++result.transfers;
+                continue;
+            }
+            result.lines.push_back(stateLine[steps[i - 1].first]);
+            result.stations.push_back(stateStation[steps[i].first]);
+            result.distance += static_cast<int>(steps[i].second - steps[i - 1].second);
+        }
+    }
 
-delhiMetro.addEdge("Janakpuri East", "Janakpuri West", static_cast<int>(i36), {"Blue Line"});
-delhiMetro.addEdge("Janakpuri West", "Janakpuri East", static_cast<int>(i36), {"Blue Line"});
+    uint32_t stateOf(uint32_t station, uint16_t line) const {
+        for (uint32_t x = stateOffsets[station]; x < stateOffsets[station + 1]; ++x) {
+            if (stateLine[x] == line) {
+                return x;
+            }
+        }
+        return SearchWorkspace::NONE;
+    }
 
-delhiMetro.addEdge("Janakpuri West", "Uttam Nagar East", static_cast<int>(i37), {"Blue Line"});
-delhiMetro.addEdge("Uttam Nagar East", "Janakpuri West", static_cast<int>(i37), {"Blue Line"});
+    static void relax(TransferWorkspace& ws, uint32_t from, uint32_t to, int64_t cost) {
+        if (cost < ws.distanceOf(to)) {
+            ws.update(to, cost, from);
+            ws.push(cost, to);
+        }
+    }
+};
 
-delhiMetro.addEdge("Uttam Nagar East", "Uttam Nagar West", static_cast<int>(i38), {"Blue Line"});
-delhiMetro.addEdge("Uttam Nagar West", "Uttam Nagar East", static_cast<int>(i38), {"Blue Line"});
+// Print a transfer-aware route with the line of every hop, announcing each change
+void printTransferRoute(ostream& out, const TransferRoute& route, const CompactGraph& graph,
+                        const LineRegistry& lineNames) {
+    for (size_t i = 0; i < route.stations.size(); ++i) {
+        out << graph.names[route.stations[i]];
+        if (i == route.lines.size()) {
+            break;
+        }
+        uint16_t line = route.lines[i];
+        const string& name = line == TransferRouter::NO_LINE ? string("unknown line") : lineNames.name(line);
+        if (i > 0 && line != route.lines[i - 1]) {
+            out << " [Change to " << name << "]";
+        } else {
+            out << " (" << name << ")";
+        }
+        out << " -> ";
+    }
+}
+
+// How a query picks its route: the engine for plain shortest distance, or
+// transfer-aware routing over (station, line) states when a line-change
+// penalty is set or the objective is OBJECTIVE_MIN_TRANSFERS
+struct RouteProfile {
+    RouteEngine engine = ENGINE_DIJKSTRA;
+    TransferObjective objective = OBJECTIVE_PENALIZED;
+    int penalty = -1;       // metres per line change, -1 = plain shortest distance
+
+    bool transferAware() const { return objective == OBJECTIVE_MIN_TRANSFERS || penalty >= 0; }
+};
+
+// Scratch space for one query at a time through any engine
+struct RouteWorkspace {
+    SearchWorkspace forward;
+    SearchWorkspace backward;
+    TransferWorkspace transfer;
+    TransferRoute transferRoute;
+    size_t settled = 0;     // stations settled by the last query
+};
+
+// Owns the preprocessed engines for a frozen graph and routes id queries
+// through whichever engine is asked for, over the graph's live network.
+// Read-only once built, so threads can share one planner as long as each
+// brings its own RouteWorkspace.
+class RoutePlanner {
+public:
+    explicit RoutePlanner(const MetroGraph& metro)
+        : graph(metro), astar(metro), bidirectional(metro), transfers(metro) {}
+
+    // Route under a profile: transfer-aware profiles go through the state
+    // graph and report the metres travelled, the rest through their engine
+    int route(const RouteProfile& profile, uint32_t source, uint32_t destination, vector<uint32_t>& path,
+              RouteWorkspace& ws) const {
+        if (!profile.transferAware()) {
+            return route(profile.engine, source, destination, path, ws);
+        }
+        TransferRoute& found = ws.transferRoute;
+        bool reached = transfers.route(source, destination, profile.objective, profile.penalty, found, ws.transfer);
+        ws.settled = ws.transfer.settled;
+        path.assign(found.stations.begin(), found.stations.end());
+        return reached ? found.distance : SearchWorkspace::INF;
+    }
+
+    int route(RouteEngine engine, uint32_t source, uint32_t destination, vector<uint32_t>& path,
+              RouteWorkspace& ws) const {
+        int distance;
+        chrono::steady_clock::time_point start;
+        ws.backward.settled = 0;
+        if constexpr (SEARCH_STATS) {
+            start = chrono::steady_clock::now();
+            ws.backward.counters = SearchCounters();
+        }
+        switch (engine) {
+        case ENGINE_BIDIRECTIONAL:
+            distance = bidirectional.route(source, destination, path, ws.forward, ws.backward);
+            break;
+        case ENGINE_ASTAR:
+            distance = astar.route(source, destination, path, ws.forward);
+            break;
+        case ENGINE_CH:
+            if (hierarchy.ready() && !graph.liveNetwork().modified()) {
+                distance = hierarchy.route(source, destination, path, ws.forward, ws.backward);
+                break;
+            }
+            // No hierarchy prepared, or its shortcuts may cross a closure: answer with plain
+            // Dijkstra, and account the search under the engine that actually ran
+            engine = ENGINE_DIJKSTRA;
+            distance = graph.dijkstraIds(source, destination, path, ws.forward);
+            break;
+        case ENGINE_RADIX:
+            distance = searchPathRadix(graph.view(), source, destination, path, ws.forward);
+            break;
+        default:
+            distance = graph.dijkstraIds(source, destination, path, ws.forward);
+            break;
+        }
+        ws.settled = ws.forward.settled + ws.backward.settled;
+        if constexpr (SEARCH_STATS) {
+            SearchStats::record(engine, ws.forward, &ws.backward, path.size(), distance,
+                                chrono::steady_clock::now() - start);
+        }
+        return distance;
+    }
+
+    // String front end, mirrors MetroGraph::dijkstra()
+    pair<vector<string>, int> route(RouteEngine engine, const string& source, const string& destination,
+                                    RouteWorkspace& ws) const {
+        const CompactGraph& compact = graph.compactGraph();
+        vector<string> path;
+        uint32_t from, to;
+        if (!compact.lookup(source, from) || !compact.lookup(destination, to)) {
+            return {path, SearchWorkspace::INF};
+        }
+        vector<uint32_t> ids;
+        int distance = route(engine, from, to, ids, ws);
+        for (uint32_t id : ids) {
+            path.push_back(compact.names[id]);
+        }
+        return {path, distance};
+    }
+
+    // Load the contraction hierarchy from file if it matches this network,
+    // otherwise build it (and save it to file when one is given)
+    void prepareContraction(unsigned threads, const string& file = "") {
+        string error;
+        if (!file.empty() && hierarchy.load(file, graph.compactGraph(), error)) {
+            return;
+        }
+        if (!file.empty()) {
+            cerr << error << ", rebuilding\n";
+        }
+        hierarchy.build(graph.compactGraph(), threads);
+        if (!file.empty() && !hierarchy.save(file, error)) {
+            cerr << error << "\n";
+        }
+    }
+
+    const ContractionHierarchy& contraction() const { return hierarchy; }
+    const MetroGraph& metro() const { return graph; }
+
+private:
+    const MetroGraph& graph;
+    AStarEngine astar;
+    BidirectionalEngine bidirectional;
+    ContractionHierarchy hierarchy;
+    TransferRouter transfers;
+};
+
+// Bounded LRU cache of routes keyed by interned (source, destination,
+// profile), where the profile is the whole RouteProfile: engine, objective
+// and line-change penalty. Split into independently locked shards so worker
+// threads rarely contend. Each shard holds routes of one graph version; the
+// first lookup or insert that sees a newer graphVersion() (after
+// addEdge()/addStation()) empties the shard, so stale routes never hold on to
+// its capacity.
+class RouteCache {
+public:
+    static constexpr size_t SHARDS = 16;
+
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;   // pushed out by capacity
+        size_t stale = 0;       // dropped because the graph changed since
+        size_t entries = 0;
+    };
+
+    explicit RouteCache(size_t capacity) : shardCapacity(max<size_t>(1, (capacity + SHARDS - 1) / SHARDS)) {}
+
+    // Route through the cache: a hit copies the stored path, a miss asks the planner and stores the answer
+    int route(const RoutePlanner& planner, const RouteProfile& profile, uint32_t source, uint32_t destination,
+              vector<uint32_t>& path, RouteWorkspace& ws) {
+        Key key = keyOf(source, destination, profile);
+        uint64_t version = planner.metro().graphVersion();
+        int distance;
+        if (lookup(key, version, path, distance)) {
+            ws.settled = 0;
+            return distance;
+        }
+        distance = planner.route(profile, source, destination, path, ws);
+        insert(key, version, path, distance);
+        return distance;
+    }
+
+    int route(const RoutePlanner& planner, RouteEngine engine, uint32_t source, uint32_t destination,
+              vector<uint32_t>& path, RouteWorkspace& ws) {
+        RouteProfile profile;
+        profile.engine = engine;
+        return route(planner, profile, source, destination, path, ws);
+    }
+
+    // Cached front end for MetroGraph::dijkstra()
+    pair<vector<string>, int> dijkstra(const MetroGraph& graph, const string& source, const string& destination) {
+        const CompactGraph& compact = graph.compactGraph();
+        vector<string> names;
+        uint32_t from, to;
+        if (!graph.isFrozen() || !compact.lookup(source, from) || !compact.lookup(destination, to)) {
+            return graph.dijkstra(source, destination);
+        }
+        static thread_local vector<uint32_t> path;
+        static thread_local SearchWorkspace ws;
+        Key key = keyOf(from, to, RouteProfile());
+        int distance;
+        if (!lookup(key, graph.graphVersion(), path, distance)) {
+            distance = graph.dijkstraIds(from, to, path, ws);
+            insert(key, graph.graphVersion(), path, distance);
+        }
+        for (uint32_t id : path) {
+            names.push_back(compact.names[id]);
+        }
+        return {names, distance};
+    }
+
+    Stats stats() const {
+        Stats total;
+        for (const Shard& shard : shards) {
+            lock_guard<mutex> lock(shard.lock);
+            total.hits += shard.stats.hits;
+            total.misses += shard.stats.misses;
+            total.evictions += shard.stats.evictions;
+            total.stale += shard.stats.stale;
+            total.entries += shard.entries.size();
+        }
+        return total;
+    }
+
+    void clear() {
+        for (Shard& shard : shards) {
+            lock_guard<mutex> lock(shard.lock);
+            shard.entries.clear();
+            shard.index.clear();
+        }
+    }
+
+private:
+    struct Key {
+        uint32_t source;
+        uint32_t destination;
+        uint64_t profile;       // engine, objective and penalty packed by keyOf()
+
+        bool operator==(const Key& other) const {
+            return source == other.source && destination == other.destination && profile == other.profile;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            // splitmix64 finalizer over the packed key
+            uint64_t x = (uint64_t(key.source) << 32 | key.destination) ^ (key.profile * 0x9E3779B97F4A7C15ull);
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+            return static_cast<size_t>(x ^ (x >> 31));
+        }
+    };
+
+    struct Entry {
+        Key key;
+        int distance;
+        vector<uint32_t> path;
+    };
+
+    // Most recently used entry at the front of the list, all of graph version `version`
+    struct Shard {
+        mutable mutex lock;
+        list<Entry> entries;
+        unordered_map<Key, list<Entry>::iterator, KeyHash> index;
+        uint64_t version = 0;
+        Stats stats;
+    };
+
+    size_t shardCapacity;
+    Shard shards[SHARDS];
+
+    static Key keyOf(uint32_t source, uint32_t destination, const RouteProfile& profile) {
+        uint64_t packed = uint64_t(profile.engine) | uint64_t(profile.objective) << 8 |
+                          uint64_t(uint32_t(profile.penalty)) << 32;
+        return Key{source, destination, packed};
+    }
+
+    Shard& shardOf(const Key& key) { return shards[KeyHash()(key) >> 7 & (SHARDS - 1)]; }
+
+    // Empty the shard once the graph has moved past its version. False if
+    // version is older than the shard's: a caller still on an old graph.
+    static bool catchUp(Shard& shard, uint64_t version) {
+        if (version > shard.version) {
+            shard.stats.stale += shard.entries.size();
+            shard.entries.clear();
+            shard.index.clear();
+            shard.version = version;
+        }
+        return version == shard.version;
+    }
+
+    bool lookup(const Key& key, uint64_t version, vector<uint32_t>& path, int& distance) {
+        Shard& shard = shardOf(key);
+        lock_guard<mutex> lock(shard.lock);
+        auto it = shard.index.end();
+        if (catchUp(shard, version)) {
+            it = shard.index.find(key);
+        }
+        if (it == shard.index.end()) {
+            ++shard.stats.misses;
+            return false;
+        }
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        path = it->second->path;
+        distance = it->second->distance;
+        ++shard.stats.hits;
+        return true;
+    }
+
+    void insert(const Key& key, uint64_t version, const vector<uint32_t>& path, int distance) {
+        Shard& shard = shardOf(key);
+        lock_guard<mutex> lock(shard.lock);
+        if (!catchUp(shard, version)) {
+            return;
+        }
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            // Another thread answered the same query meanwhile
+            it->second->distance = distance;
+            it->second->path = path;
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            return;
+        }
+        if (shard.entries.size() >= shardCapacity) {
+            // Recycle the least recently used entry, keeping its path buffer
+            auto last = prev(shard.entries.end());
+            shard.index.erase(last->key);
+            shard.entries.splice(shard.entries.begin(), shard.entries, last);
+            ++shard.stats.evictions;
+        } else {
+            shard.entries.emplace_front();
+        }
+        Entry& entry = shard.entries.front();
+        entry.key = key;
+        entry.distance = distance;
+        entry.path.assign(path.begin(), path.end());
+        shard.index[key] = shard.entries.begin();
+    }
+};
+
+// Settled stations and latency of every engine, over all pairs and repeated
+// runs of one long trip (Samaypur Badli to Escorts Mujesar by default)
+void benchmarkEngines(const MetroGraph& graph, const string& source, const string& destination, unsigned threads) {
+    const CompactGraph& compact = graph.compactGraph();
+    uint32_t n = compact.stationCount();
+    RoutePlanner planner(graph);
+    planner.prepareContraction(threads);
+    const ContractionHierarchy& hierarchy = planner.contraction();
+    cout << "Contraction hierarchy: " << hierarchy.buildTimeMs() << " ms, " << hierarchy.arcCount()
+         << " upward arcs (" << hierarchy.shortcutCount() << " shortcuts)\n";
+    RouteWorkspace ws;
+    vector<uint32_t> path;
+    size_t pairs = size_t(n) * n;
+
+    vector<int> expected(pairs);
+    for (uint32_t s = 0; s < n; ++s) {
+        for (uint32_t t = 0; t < n; ++t) {
+            expected[size_t(s) * n + t] = planner.route(ENGINE_DIJKSTRA, s, t, path, ws);
+        }
+    }
+
+    uint32_t from = 0, to = 0;
+    bool tripKnown = compact.lookup(source, from) && compact.lookup(destination, to);
+    cout << "All pairs (" << pairs << " queries):\n";
+    for (int e = 0; e < ENGINE_COUNT; ++e) {
+        RouteEngine engine = static_cast<RouteEngine>(e);
+        size_t settled = 0, mismatches = 0;
+        auto start = chrono::steady_clock::now();
+        for (uint32_t s = 0; s < n; ++s) {
+            for (uint32_t t = 0; t < n; ++t) {
+                if (planner.route(engine, s, t, path, ws) != expected[size_t(s) * n + t]) {
+                    ++mismatches;
+                }
+                settled += ws.settled;
+            }
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "  " << ENGINE_NAMES[e] << ": " << double(settled) / pairs << " settled/query, "
+             << ms * 1000.0 / pairs << " us/query, " << mismatches << " mismatches\n";
+    }
+
+    if (!tripKnown) {
+        cout << "Unknown trip " << source << " -> " << destination << "\n";
+        return;
+    }
+    const int RUNS = 10000;
+    cout << source << " -> " << destination << " (" << RUNS << " runs):\n";
+    for (int e = 0; e < ENGINE_COUNT; ++e) {
+        RouteEngine engine = static_cast<RouteEngine>(e);
+        int distance = 0;
+        auto start = chrono::steady_clock::now();
+        for (int run = 0; run < RUNS; ++run) {
+            distance = planner.route(engine, from, to, path, ws);
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "  " << ENGINE_NAMES[e] << ": " << formatKm(distance) << " km, " << path.size() << " stations, "
+             << ws.settled << " settled, " << ms * 1000.0 / RUNS << " us/query\n";
+    }
+}
+
+// Point-to-point Dijkstra with the binary heap against the radix heap over
+// random station pairs, sampled so large synthetic networks finish quickly
+void benchmarkQueues(const MetroGraph& graph) {
+    const CompactGraph& compact = graph.compactGraph();
+    uint32_t n = compact.stationCount();
+    if (n == 0) {
+        return;
+    }
+    int longest = 0;
+    for (int weight : compact.weights) {
+        longest = max(longest, weight);
+    }
+    cout << "Stations: " << n << ", edges: " << compact.edgeCount() << ", longest edge: " << longest << " m\n";
+
+    const size_t QUERIES = min<size_t>(size_t(n) * n, max<size_t>(200, 40000000 / n));
+    mt19937 random(31);
+    uniform_int_distribution<uint32_t> pick(0, n - 1);
+    vector<pair<uint32_t, uint32_t>> queries(QUERIES);
+    for (auto& query : queries) {
+        query = {pick(random), pick(random)};
+    }
+
+    SearchWorkspace ws;
+    vector<uint32_t> path;
+    vector<int> expected(QUERIES);
+    size_t settled = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t q = 0; q < QUERIES; ++q) {
+        expected[q] = searchPath(graph.view(), queries[q].first, queries[q].second, path, ws);
+        settled += ws.settled;
+    }
+    double heapUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / QUERIES;
+    cout << "Random pairs (" << QUERIES << " queries):\n";
+    cout << "  binary heap: " << double(settled) / QUERIES << " settled/query, " << heapUs << " us/query\n";
+
+    size_t mismatches = 0;
+    settled = 0;
+    start = chrono::steady_clock::now();
+    for (size_t q = 0; q < QUERIES; ++q) {
+        mismatches += searchPathRadix(graph.view(), queries[q].first, queries[q].second, path, ws) != expected[q];
+        settled += ws.settled;
+    }
+    double radixUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / QUERIES;
+    cout << "  radix heap: " << double(settled) / QUERIES << " settled/query, " << radixUs << " us/query, "
+         << mismatches << " mismatches\n";
+}
+
+// Line changes, distance and latency of transfer-aware routing over all pairs,
+// from no penalty (must match plain Dijkstra on distance) to minimum transfers
+void benchmarkTransfers(const MetroGraph& graph, int penalty) {
+    const CompactGraph& compact = graph.compactGraph();
+    uint32_t n = compact.stationCount();
+    auto start = chrono::steady_clock::now();
+    TransferRouter router(graph);
+    double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "State graph: " << router.stateCount() << " states, " << router.arcCount() << " ride arcs, built in "
+         << buildMs << " ms\n";
+
+    SearchWorkspace ws;
+    TransferWorkspace transferWs;
+    vector<uint32_t> path;
+    TransferRoute route;
+    size_t pairs = size_t(n) * n;
+    size_t settled = 0;
+    start = chrono::steady_clock::now();
+    for (uint32_t s = 0; s < n; ++s) {
+        for (uint32_t t = 0; t < n; ++t) {
+            graph.dijkstraIds(s, t, path, ws);
+            settled += ws.settled;
+        }
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "  dijkstra: " << double(settled) / pairs << " settled/query, " << ms * 1000.0 / pairs << " us/query\n";
+
+    struct Setting {
+        const char* name;
+        TransferObjective objective;
+        int penalty;
+    };
+    const Setting settings[] = {{"no penalty", OBJECTIVE_PENALIZED, 0},
+                                {"penalty", OBJECTIVE_PENALIZED, penalty},
+                                {"min transfers", OBJECTIVE_MIN_TRANSFERS, 0}};
+    for (const Setting& setting : settings) {
+        size_t transfers = 0, mismatches = 0, found = 0;
+        int64_t metres = 0;
+        settled = 0;
+        start = chrono::steady_clock::now();
+        for (uint32_t s = 0; s < n; ++s) {
+            for (uint32_t t = 0; t < n; ++t) {
+                if (!router.route(s, t, setting.objective, setting.penalty, route, transferWs)) {
+                    continue;
+                }
+                ++found;
+                settled += transferWs.settled;
+                transfers += route.transfers;
+                metres += route.distance;
+                if (setting.objective == OBJECTIVE_PENALIZED && setting.penalty == 0 &&
+                    route.distance != graph.dijkstraIds(s, t, path, ws)) {
+                    ++mismatches;
+                }
+            }
+        }
+        ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "  " << setting.name;
+        if (setting.objective == OBJECTIVE_PENALIZED && setting.penalty > 0) {
+            cout << " " << formatKm(setting.penalty) << " km";
+        }
+        cout << ": " << double(transfers) / max<size_t>(found, 1) << " changes/route, "
+             << double(metres) / METRES_PER_KM / max<size_t>(found, 1) << " km/route, " << double(settled) / max<size_t>(found, 1)
+             << " settled/query, " << ms * 1000.0 / pairs << " us/query";
+        if (setting.objective == OBJECTIVE_PENALIZED && setting.penalty == 0) {
+            cout << ", " << mismatches << " distance mismatches";
+        }
+        cout << "\n";
+    }
+
+    ParetoWorkspace pareto;
+    vector<TransferRoute> options;
+    size_t journeys = 0, labels = 0;
+    start = chrono::steady_clock::now();
+    for (uint32_t s = 0; s < n; ++s) {
+        for (uint32_t t = 0; t < n; ++t) {
+            labels += router.paretoRoutes(s, t, options, pareto);
+            journeys += options.size();
+        }
+    }
+    ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    // The ends of each Pareto set must be the shortest and the fewest-changes routes
+    size_t mismatches = 0;
+    for (uint32_t s = 0; s < n; ++s) {
+        for (uint32_t t = 0; t < n; ++t) {
+            router.paretoRoutes(s, t, options, pareto);
+            bool found = router.route(s, t, OBJECTIVE_MIN_TRANSFERS, 0, route, transferWs);
+            if (options.empty() != !found ||
+                (found && (options.front().distance != graph.dijkstraIds(s, t, path, ws) ||
+                           options.back().transfers != route.transfers ||
+                           options.back().distance != route.distance))) {
+                ++mismatches;
+            }
+        }
+    }
+    cout << "  pareto: " << double(journeys) / pairs << " journeys/query, " << double(labels) / pairs
+         << " labels/query, " << ms * 1000.0 / pairs << " us/query, " << mismatches << " mismatches\n";
+}
+
+// k-shortest loopless paths between random station pairs for k in {1, 3, 5, 10},
+// with and without the distance bound, against k plain Dijkstra runs
+void benchmarkKShortest(const MetroGraph& graph) {
+    const CompactGraph& compact = graph.compactGraph();
+    GraphView view = graph.view();
+    const int PAIRS = 2000;
+    mt19937 random(7);
+    uniform_int_distribution<uint32_t> station(0, compact.stationCount() - 1);
+    vector<pair<uint32_t, uint32_t>> queries;
+    for (int q = 0; q < PAIRS; ++q) {
+        queries.emplace_back(station(random), station(random));
+    }
+
+    SearchWorkspace search;
+    vector<uint32_t> path;
+    auto start = chrono::steady_clock::now();
+    for (const auto& query : queries) {
+        graph.dijkstraIds(query.first, query.second, path, search);
+    }
+    double dijkstraUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / PAIRS;
+    cout << PAIRS << " random pairs, dijkstra " << dijkstraUs << " us/query\n";
+
+    PathsWorkspace ws;
+    vector<RankedPath> paths, unpruned;
+    for (size_t k : {1, 3, 5, 10}) {
+        size_t found = 0, searches = 0, settled = 0, mismatches = 0;
+        start = chrono::steady_clock::now();
+        for (const auto& query : queries) {
+            found += kShortestPaths(view, query.first, query.second, k, paths, ws);
+            searches += ws.spurSearches;
+            settled += ws.settled;
+        }
+        double prunedUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / PAIRS;
+
+        size_t unprunedSettled = 0;
+        start = chrono::steady_clock::now();
+        for (const auto& query : queries) {
+            kShortestPaths(view, query.first, query.second, k, unpruned, ws, false);
+            unprunedSettled += ws.settled;
+        }
+        double unprunedUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / PAIRS;
+
+        // Both variants must agree on the distances
+        for (const auto& query : queries) {
+            kShortestPaths(view, query.first, query.second, k, paths, ws);
+            kShortestPaths(view, query.first, query.second, k, unpruned, ws, false);
+            bool same = paths.size() == unpruned.size();
+            for (size_t i = 0; same && i < paths.size(); ++i) {
+                same = paths[i].distance == unpruned[i].distance;
+            }
+            mismatches += !same;
+        }
+        cout << "  k=" << k << ": " << double(found) / PAIRS << " paths, " << double(searches) / PAIRS
+             << " spur searches, " << double(settled) / PAIRS << " settled (" << double(unprunedSettled) / PAIRS
+             << " unpruned), " << prunedUs << " us/query (" << unprunedUs << " unpruned, "
+             << prunedUs / (k * dijkstraUs) << "x of k dijkstra runs), " << mismatches << " mismatches\n";
+    }
+}
+
+// Resolve a million noisy station names (random case, extra spaces, and up to
+// two typos: dropped, swapped or wrong letters) through the index, and a
+// sample of them by scanning every name, which is what a lookup without the
+// index has to do
+void benchmarkNames(const MetroGraph& graph, const vector<pair<string, string>>& aliases) {
+    const CompactGraph& compact = graph.compactGraph();
+    StationIndex index;
+    auto start = chrono::steady_clock::now();
+    index.build(compact, aliases);
+    double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Index: " << index.entryCount() << " names and aliases, built in " << buildMs << " ms\n";
+
+    vector<pair<string, uint32_t>> sources;
+    for (uint32_t id = 0; id < compact.stationCount(); ++id) {
+        sources.emplace_back(compact.names[id], id);
+    }
+    for (const auto& alias : aliases) {
+        uint32_t id;
+        if (compact.lookup(alias.second, id)) {
+            sources.emplace_back(alias.first, id);
+        }
+    }
+    if (sources.empty()) {
+        return;
+    }
+
+    const size_t QUERIES = 1000000;
+    mt19937 random(17);
+    uniform_int_distribution<size_t> pickSource(0, sources.size() - 1);
+    uniform_int_distribution<int> edits(0, 2), coin(0, 1), letter('a', 'z');
+    vector<pair<string, uint32_t>> queries(QUERIES);
+    for (auto& query : queries) {
+        const auto& source = sources[pickSource(random)];
+        string noisy;
+        for (char c : source.first) {
+            noisy.push_back(coin(random) ? static_cast<char>(toupper(static_cast<unsigned char>(c))) : c);
+            if (c == ' ' && coin(random) && coin(random)) {
+                noisy.push_back(' ');
+            }
+        }
+        for (int e = edits(random); e > 0 && noisy.size() > 3; --e) {
+            size_t at = uniform_int_distribution<size_t>(0, noisy.size() - 2)(random);
+            switch (uniform_int_distribution<int>(0, 2)(random)) {
+            case 0:
+                noisy.erase(at, 1);
+                break;
+            case 1:
+                swap(noisy[at], noisy[at + 1]);
+                break;
+            default:
+                noisy[at] = static_cast<char>(letter(random));
+                break;
+            }
+        }
+        query = {noisy, source.second};
+    }
+
+    NameWorkspace ws;
+    NameMatch match;
+    size_t correct = 0, wrong = 0, unresolved = 0, exactHits = 0;
+    start = chrono::steady_clock::now();
+    for (const auto& query : queries) {
+        if (!index.resolve(query.first, match, ws)) {
+            ++unresolved;
+        } else if (match.station == query.second) {
+            ++correct;
+            exactHits += match.score == 1.0f;
+        } else {
+            ++wrong;
+        }
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << QUERIES << " noisy names: " << QUERIES / max(ms / 1000.0, 1e-9) << " names/s (" << ms * 1e6 / QUERIES
+         << " ns/name)\n";
+    cout << "  correct " << 100.0 * correct / QUERIES << "% (" << 100.0 * exactHits / QUERIES << "% exact after normalizing), wrong "
+         << 100.0 * wrong / QUERIES << "%, unresolved " << 100.0 * unresolved / QUERIES << "%\n";
+
+    // Brute force: best Dice similarity over every name
+    vector<vector<uint32_t>> sourceGrams(sources.size());
+    string key;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        normalizeName(sources[i].first, key);
+        nameTrigrams(key, sourceGrams[i]);
+    }
+    const size_t SAMPLE = min<size_t>(QUERIES, max<size_t>(100, 4000000 / sources.size()));
+    vector<uint32_t> grams, common;
+    size_t agree = 0;
+    start = chrono::steady_clock::now();
+    for (size_t q = 0; q < SAMPLE; ++q) {
+        normalizeName(queries[q].first, key);
+        nameTrigrams(key, grams);
+        float best = 0;
+        uint32_t bestStation = SearchWorkspace::NONE;
+        for (size_t i = 0; i < sources.size(); ++i) {
+            common.clear();
+            set_intersection(grams.begin(), grams.end(), sourceGrams[i].begin(), sourceGrams[i].end(),
+                             back_inserter(common));
+            float score = 2.0f * common.size() / float(grams.size() + sourceGrams[i].size());
+            if (score > best) {
+                best = score;
+                bestStation = sources[i].second;
+            }
+        }
+        agree += bestStation == queries[q].second;
+    }
+    double scanMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Linear scan: " << scanMs * 1e6 / SAMPLE << " ns/name on " << SAMPLE << " names, correct "
+         << 100.0 * agree / SAMPLE << "%\n";
+}
+
+// Nearest-station and radius queries at random GPS fixes around the network,
+// through the k-d tree and by scanning every station with Haversine
+void benchmarkSpatial(const MetroGraph& graph) {
+    const unordered_map<string, Station>& stations = graph.getStations();
+    const CompactGraph& compact = graph.compactGraph();
+    if (stations.empty()) {
+        return;
+    }
+    SpatialIndex index;
+    auto start = chrono::steady_clock::now();
+    index.build(graph);
+    double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "k-d tree: " << index.size() << " stations, built in " << buildMs << " ms\n";
+
+    double minLat = 90, maxLat = -90, minLon = 180, maxLon = -180;
+    for (const auto& entry : stations) {
+        minLat = min(minLat, entry.second.latitude);
+        maxLat = max(maxLat, entry.second.latitude);
+        minLon = min(minLon, entry.second.longitude);
+        maxLon = max(maxLon, entry.second.longitude);
+    }
+    const size_t QUERIES = 100000;
+    mt19937 random(23);
+    uniform_real_distribution<double> lat(minLat - 0.02, maxLat + 0.02), lon(minLon - 0.02, maxLon + 0.02);
+    vector<pair<double, double>> fixes(QUERIES);
+    for (auto& fix : fixes) {
+        fix = {lat(random), lon(random)};
+    }
+
+    // Brute force over the station table, on a sample sized to the network
+    const size_t SAMPLE = min<size_t>(QUERIES, max<size_t>(100, 20000000 / stations.size()));
+    const double RADIUS_KM = 1.0;
+    vector<double> scanNearest(SAMPLE);
+    vector<size_t> scanWithin(SAMPLE);
+    start = chrono::steady_clock::now();
+    for (size_t q = 0; q < SAMPLE; ++q) {
+        double best = numeric_limits<double>::max();
+        size_t inside = 0;
+        for (const auto& entry : stations) {
+            double km = MetroGraph::haversine(fixes[q].first, fixes[q].second, entry.second.latitude,
+                                              entry.second.longitude);
+            best = min(best, km);
+            inside += km <= RADIUS_KM && compact.ids.count(entry.first);
+        }
+        scanNearest[q] = best;
+        scanWithin[q] = inside;
+    }
+    double scanUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / SAMPLE;
+
+    vector<SpatialMatch> matches;
+    size_t mismatches = 0;
+    for (size_t q = 0; q < SAMPLE; ++q) {
+        index.nearest(fixes[q].first, fixes[q].second, 1, matches);
+        mismatches += matches.empty() || fabs(matches[0].km - scanNearest[q]) > 1e-9;
+        index.within(fixes[q].first, fixes[q].second, RADIUS_KM, matches);
+        mismatches += matches.size() != scanWithin[q];
+    }
+
+    cout << "Brute-force scan (nearest + " << RADIUS_KM << " km radius): " << scanUs << " us/query on " << SAMPLE
+         << " fixes\n";
+    for (size_t k : {1, 5}) {
+        start = chrono::steady_clock::now();
+        for (const auto& fix : fixes) {
+            index.nearest(fix.first, fix.second, k, matches);
+        }
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / QUERIES;
+        cout << "  " << k << "-nearest: " << us << " us/query\n";
+    }
+    size_t found = 0;
+    start = chrono::steady_clock::now();
+    for (const auto& fix : fixes) {
+        found += index.within(fix.first, fix.second, RADIUS_KM, matches);
+    }
+    double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / QUERIES;
+    cout << "  within " << RADIUS_KM << " km: " << us << " us/query, " << double(found) / QUERIES << " stations/query\n";
+    cout << "Mismatches against the scan: " << mismatches << "\n";
+}
+
+// Pairwise and one-to-many Haversine distances over random stations: the
+// string-keyed calculateDistance(), the scalar path of the coordinate store and
+// its AVX2 kernel, with the worst error of each batch path against MetroGraph::haversine()
+void benchmarkHaversine(const MetroGraph& graph) {
+    const CompactGraph& compact = graph.compactGraph();
+    uint32_t n = compact.stationCount();
+    if (n == 0) {
+        return;
+    }
+    CoordinateStore store;
+    store.build(graph);
+    vector<double> latitude(n), longitude(n);
+    for (uint32_t id = 0; id < n; ++id) {
+        const Station* station = graph.findStation(compact.names[id]);
+        latitude[id] = station ? station->latitude : 0.0;
+        longitude[id] = station ? station->longitude : 0.0;
+    }
+
+    const size_t PAIRS = 1000000;
+    mt19937 random(29);
+    uniform_int_distribution<uint32_t> pick(0, n - 1);
+    vector<uint32_t> from(PAIRS), to(PAIRS);
+    for (size_t i = 0; i < PAIRS; ++i) {
+        from[i] = pick(random);
+        to[i] = pick(random);
+    }
+    vector<double> expected(PAIRS), out(PAIRS);
+    for (size_t i = 0; i < PAIRS; ++i) {
+        expected[i] = MetroGraph::haversine(latitude[from[i]], longitude[from[i]], latitude[to[i]], longitude[to[i]]);
+    }
+
+    auto nsPer = [](chrono::steady_clock::time_point start, size_t count) {
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / count;
+    };
+    auto report = [&](const char* name, double ns) {
+        double worstKm = 0, worstRelative = 0;
+        for (size_t i = 0; i < PAIRS; ++i) {
+            double error = fabs(out[i] - expected[i]);
+            worstKm = max(worstKm, error);
+            if (expected[i] > 0) {
+                worstRelative = max(worstRelative, error / expected[i]);
+            }
+        }
+        cout << "  " << name << ": " << ns << " ns/pair, max error " << worstKm * 1e6 << " mm ("
+             << worstRelative << " relative)\n";
+    };
+
+    cout << "Stations: " << n << ", pairs: " << PAIRS << ", AVX2: "
+         << (CoordinateStore::avx2Supported() ? "yes" : "not supported, scalar only") << "\n";
+    const size_t SAMPLE = PAIRS / 10;
+    double checksum = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < SAMPLE; ++i) {
+        checksum += graph.calculateDistance(compact.names[from[i]], compact.names[to[i]]);
+    }
+    cout << "  calculateDistance (by name): " << nsPer(start, SAMPLE) << " ns/pair on " << SAMPLE << " pairs\n";
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < PAIRS; ++i) {
+        checksum += MetroGraph::haversine(latitude[from[i]], longitude[from[i]], latitude[to[i]], longitude[to[i]]);
+    }
+    cout << "  MetroGraph::haversine (degrees): " << nsPer(start, PAIRS) << " ns/pair\n";
+
+    store.setVectorized(false);
+    start = chrono::steady_clock::now();
+    store.distances(from.data(), to.data(), PAIRS, out.data());
+    report("pairwise, scalar", nsPer(start, PAIRS));
+    if (CoordinateStore::avx2Supported()) {
+        store.setVectorized(true);
+        start = chrono::steady_clock::now();
+        store.distances(from.data(), to.data(), PAIRS, out.data());
+        report("pairwise, AVX2", nsPer(start, PAIRS));
+    }
+
+    // One origin against every station, contiguous loads instead of gathers
+    size_t origins = max<size_t>(1, PAIRS / n), count = origins * n;
+    vector<double> row(n);
+    for (bool avx2 : {false, true}) {
+        if (avx2 && !CoordinateStore::avx2Supported()) {
+            break;
+        }
+        store.setVectorized(avx2);
+        double worstKm = 0;
+        start = chrono::steady_clock::now();
+        for (size_t o = 0; o < origins; ++o) {
+            store.oneToMany(from[o], nullptr, n, row.data());
+            checksum += row[o % n];
+        }
+        double ns = nsPer(start, count);
+        for (size_t o = 0; o < origins; ++o) {
+            store.oneToMany(from[o], nullptr, n, row.data());
+            for (uint32_t t = 0; t < n; ++t) {
+                double reference = MetroGraph::haversine(latitude[from[o]], longitude[from[o]], latitude[t], longitude[t]);
+                worstKm = max(worstKm, fabs(row[t] - reference));
+            }
+        }
+        cout << "  one-to-all, " << (avx2 ? "AVX2" : "scalar") << ": " << ns << " ns/pair over " << origins
+             << " origins, max error " << worstKm * 1e6 << " mm\n";
+    }
+    if (checksum < 0) {
+        cout << checksum;   // keep the timed loops from being optimized out
+    }
+}
+
+// A stretch of a route ridden on one line, boarded at path[start]; line is
+// -1 where the hop was loaded without a line
+struct RouteLeg {
+    size_t start;
+    int line;
+};
+
+// Split a path into the legs ridden on one line each, labelling every hop
+// with the lines of the CSR edge actually taken (edgeLines(e)) and switching
+// only when the current line does not continue, which gives the fewest
+// changes for the path. Shared by every route printer and the server's
+// CHANGES reply, so they all agree.
+template <typename EdgeLines>
+void routeLegs(const GraphView& graph, const vector<uint32_t>& path, EdgeLines edgeLines, vector<RouteLeg>& legs) {
+    legs.clear();
+    LineSet riding;
+    for (size_t i = 0; i + 1 < path.size(); ++i) {
+        LineSet hop;
+        for (uint32_t e = graph.offsets[path[i]]; e < graph.offsets[path[i] + 1]; ++e) {
+            if (graph.targets[e] == path[i + 1]) {
+                hop = edgeLines(e);
+                break;
+            }
+        }
+        LineSet staying = riding & hop;
+        if (staying.any()) {
+            riding = staying;
+            continue;
+        }
+        if (!legs.empty()) {
+            legs.back().line = riding.first();
+        }
+        legs.push_back(RouteLeg{i, -1});
+        riding = hop;
+    }
+    if (!legs.empty()) {
+        legs.back().line = riding.first();
+    }
+}
+
+// Same over a frozen graph's own edge lines
+void routeLegs(const CompactGraph& graph, const vector<uint32_t>& path, vector<RouteLeg>& legs) {
+    routeLegs(graph.view(), path, [&](uint32_t e) -> const LineSet& { return graph.edgeLines[e]; }, legs);
+}
+
+// Print a route with the line ridden on each hop and where to change lines,
+// legs as found by routeLegs(); lineName(id) returns the name of a line
+template <typename LineName>
+void printRoute(ostream& out, const vector<string>& path, const vector<RouteLeg>& legs, LineName lineName) {
+    size_t leg = 0;
+    for (size_t i = 0; i < path.size(); ++i) {
+        out << path[i];
+        if (i + 1 == path.size() || legs.empty()) {
+            continue;
+        }
+        while (leg + 1 < legs.size() && legs[leg + 1].start <= i) {
+            ++leg;
+        }
+        if (legs[leg].line < 0) {
+            out << " (unknown line)";
+        } else if (leg > 0 && legs[leg].start == i) {
+            out << " [Change to " << lineName(legs[leg].line) << "]";
+        } else {
+            out << " (" << lineName(legs[leg].line) << ")";
+        }
+        out << " -> ";
+    }
+}
+
+// Binary network snapshot: a fixed header followed by 8-byte aligned sections
+// that map straight onto the CSR arrays. Bump SNAPSHOT_VERSION on any layout or
+// unit change (version 2: weights in metres instead of km; version 3: the
+// checksum covers the header too).
+const char SNAPSHOT_MAGIC[8] = {'D', 'M', 'E', 'T', 'R', 'O', 'S', 'N'};
+const uint32_t SNAPSHOT_VERSION = 3;
+const uint32_t SNAPSHOT_ENDIAN_TAG = 0x01020304;
+
+enum SnapshotSection {
+    SECTION_NAME_OFFSETS,       // uint32_t[stations + 1] into the name blob
+    SECTION_NAME_BLOB,          // station names, sorted, not terminated
+    SECTION_LATITUDES,          // double[stations]
+    SECTION_LONGITUDES,         // double[stations]
+    SECTION_STATION_LINES,      // LineSet[stations]
+    SECTION_OFFSETS,            // uint32_t[stations + 1]
+    SECTION_TARGETS,            // uint32_t[edges]
+    SECTION_WEIGHTS,            // int32_t[edges]
+    SECTION_EDGE_LINES,         // LineSet[edges]
+    SECTION_LINE_NAME_OFFSETS,  // uint32_t[lines + 1] into the line name blob
+    SECTION_LINE_NAME_BLOB,
+    SNAPSHOT_SECTIONS
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t stationCount;
+    uint32_t edgeCount;
+    uint32_t lineCount;
+    uint32_t lineSetWords;
+    uint64_t fileSize;
+    uint64_t checksum;          // FNV-1a over the whole file, this field taken as zero
+    uint64_t sections[SNAPSHOT_SECTIONS];
+};
+
+// Write a frozen graph to a snapshot file. Returns false and sets error on failure.
+bool writeSnapshot(const MetroGraph& graph, const string& file, string& error) {
+    if (!graph.isFrozen()) {
+        error = "graph must be frozen before writing a snapshot";
+        return false;
+    }
+    const CompactGraph& compact = graph.compactGraph();
+    const LineRegistry& lines = graph.lines();
+    uint32_t n = compact.stationCount();
+
+    vector<char> buffer(sizeof(SnapshotHeader), 0);
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.endianTag = SNAPSHOT_ENDIAN_TAG;
+    header.stationCount = n;
+    header.edgeCount = static_cast<uint32_t>(compact.edgeCount());
+    header.lineCount = static_cast<uint32_t>(lines.size());
+    header.lineSetWords = LineSet::WORDS;
+
+    auto append = [&](SnapshotSection section, const void* data, size_t size) {
+        buffer.resize((buffer.size() + 7) & ~size_t(7), 0);
+        header.sections[section] = buffer.size();
+        const char* bytes = static_cast<const char*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    };
+
+    vector<uint32_t> nameOffsets(1, 0);
+    string nameBlob;
+    vector<double> latitudes(n), longitudes(n);
+    vector<LineSet> stationLines(n);
+    for (uint32_t id = 0; id < n; ++id) {
+        nameBlob += compact.names[id];
+        nameOffsets.push_back(static_cast<uint32_t>(nameBlob.size()));
+        if (const Station* station = graph.findStation(compact.names[id])) {
+            latitudes[id] = station->latitude;
+            longitudes[id] = station->longitude;
+            stationLines[id] = station->metroLines;
+        }
+    }
+    vector<uint32_t> lineNameOffsets(1, 0);
+    string lineNameBlob;
+    for (size_t line = 0; line < lines.size(); ++line) {
+        lineNameBlob += lines.name(line);
+        lineNameOffsets.push_back(static_cast<uint32_t>(lineNameBlob.size()));
+    }
+
+    append(SECTION_NAME_OFFSETS, nameOffsets.data(), nameOffsets.size() * sizeof(uint32_t));
+    append(SECTION_NAME_BLOB, nameBlob.data(), nameBlob.size());
+    append(SECTION_LATITUDES, latitudes.data(), n * sizeof(double));
+    append(SECTION_LONGITUDES, longitudes.data(), n * sizeof(double));
+    append(SECTION_STATION_LINES, stationLines.data(), n * sizeof(LineSet));
+    append(SECTION_OFFSETS, compact.offsets.data(), compact.offsets.size() * sizeof(uint32_t));
+    append(SECTION_TARGETS, compact.targets.data(), compact.targets.size() * sizeof(uint32_t));
+    append(SECTION_WEIGHTS, compact.weights.data(), compact.weights.size() * sizeof(int));
+    append(SECTION_EDGE_LINES, compact.edgeLines.data(), compact.edgeLines.size() * sizeof(LineSet));
+    append(SECTION_LINE_NAME_OFFSETS, lineNameOffsets.data(), lineNameOffsets.size() * sizeof(uint32_t));
+    append(SECTION_LINE_NAME_BLOB, lineNameBlob.data(), lineNameBlob.size());
+    buffer.resize((buffer.size() + 7) & ~size_t(7), 0);
+
+    header.fileSize = buffer.size();
+    memcpy(buffer.data(), &header, sizeof(header));
+    header.checksum = fnv1a64(buffer.data(), buffer.size());
+    memcpy(buffer.data(), &header, sizeof(header));
+
+    // Write to a temporary name and rename, so readers never map a half-written file
+    string temporary = file + ".tmp";
+    ofstream out(temporary, ios::binary | ios::trunc);
+    out.write(buffer.data(), buffer.size());
+    out.close();
+    if (!out) {
+        error = "cannot write " + temporary;
+        return false;
+    }
+    if (rename(temporary.c_str(), file.c_str()) != 0) {
+        error = "cannot rename " + temporary + " to " + file;
+        return false;
+    }
+    return true;
+}
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const string& file, string& error) {
+        close();
+        int fd = ::open(file.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "cannot open " + file;
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            error = "cannot stat " + file;
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length == 0) {
+            ::close(fd);
+            return true; // mmap rejects empty files, an empty view is fine
+        }
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            length = 0;
+            error = "cannot map " + file;
+            return false;
+        }
+        base = static_cast<const char*>(mapped);
+        return true;
+    }
+
+    void close() {
+        if (base) {
+            munmap(const_cast<char*>(base), length);
+        }
+        base = nullptr;
+        length = 0;
+    }
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+    string_view text() const { return string_view(base, length); }
+
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+};
+
+// A network served straight from a memory-mapped snapshot. Nothing is parsed
+// or copied: every accessor points into the mapped pages.
+class MappedNetwork {
+public:
+    MappedNetwork() = default;
+    MappedNetwork(const MappedNetwork&) = delete;
+    MappedNetwork& operator=(const MappedNetwork&) = delete;
+    ~MappedNetwork() { close(); }
+
+    // Map and validate a snapshot. The section table, and the first and last
+    // name offsets against their blobs, are always checked against the file;
+    // verifyChecksum (and with it the per-element checks) can be turned off
+    // when the file is trusted and even a linear pass over it is too slow.
+    bool open(const string& file, string& error, bool verifyChecksum = true) {
+        close();
+        if (!mapping.open(file, error)) {
+            return false;
+        }
+        base = mapping.data();
+        size_t size = mapping.size();
+        header = reinterpret_cast<const SnapshotHeader*>(base);
+
+        if (size < sizeof(SnapshotHeader) || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            error = file + " is not a network snapshot";
+        } else if (header->version != SNAPSHOT_VERSION) {
+            error = file + " has snapshot version " + to_string(header->version) +
+                    ", expected " + to_string(SNAPSHOT_VERSION);
+        } else if (header->endianTag != SNAPSHOT_ENDIAN_TAG || header->lineSetWords != LineSet::WORDS) {
+            error = file + " was written on an incompatible build";
+        } else if (header->fileSize != size) {
+            error = file + " is truncated";
+        } else if (!sectionsFit()) {
+            error = file + " has a corrupt section table";
+        } else if (verifyChecksum && checksum() != header->checksum) {
+            error = file + " failed its checksum";
+        } else if (verifyChecksum && !elementsValid()) {
+            error = file + " has out-of-range offsets, edges or lines";
+        } else {
+            return true;
+        }
+        close();
+        return false;
+    }
+
+    void close() {
+        mapping.close();
+        base = nullptr;
+        header = nullptr;
+    }
+
+    uint32_t stationCount() const { return header->stationCount; }
+    size_t edgeCount() const { return header->edgeCount; }
+
+    GraphView view() const {
+        return GraphView{stationCount(), section<uint32_t>(SECTION_OFFSETS),
+                         section<uint32_t>(SECTION_TARGETS), section<int>(SECTION_WEIGHTS)};
+    }
+
+    string_view name(uint32_t id) const {
+        const uint32_t* offsets = section<uint32_t>(SECTION_NAME_OFFSETS);
+        return string_view(section<char>(SECTION_NAME_BLOB) + offsets[id], offsets[id + 1] - offsets[id]);
+    }
+
+    // Names are stored sorted, so lookup is a binary search over the mapped blob
+    bool lookup(string_view station, uint32_t& id) const {
+        uint32_t low = 0, high = stationCount();
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            if (name(middle) < station) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        if (low == stationCount() || name(low) != station) {
+            return false;
+        }
+        id = low;
+        return true;
+    }
+
+    double latitude(uint32_t id) const { return section<double>(SECTION_LATITUDES)[id]; }
+    double longitude(uint32_t id) const { return section<double>(SECTION_LONGITUDES)[id]; }
+    const LineSet& stationLines(uint32_t id) const { return section<LineSet>(SECTION_STATION_LINES)[id]; }
+    const LineSet& edgeLines(size_t edge) const { return section<LineSet>(SECTION_EDGE_LINES)[edge]; }
+
+    // Name of a line, empty for ids the snapshot does not name
+    string_view lineName(int line) const {
+        if (line < 0 || uint32_t(line) >= header->lineCount) {
+            return string_view();
+        }
+        const uint32_t* offsets = section<uint32_t>(SECTION_LINE_NAME_OFFSETS);
+        return string_view(section<char>(SECTION_LINE_NAME_BLOB) + offsets[line], offsets[line + 1] - offsets[line]);
+    }
+
+private:
+    MappedFile mapping;
+    const char* base = nullptr;
+    const SnapshotHeader* header = nullptr;
+
+    template <typename T>
+    const T* section(SnapshotSection which) const {
+        return reinterpret_cast<const T*>(base + header->sections[which]);
+    }
+
+    // Bytes from the start of a section to the start of the next one (or the end of the file)
+    uint64_t sectionExtent(int which) const {
+        uint64_t end = which + 1 < SNAPSHOT_SECTIONS ? header->sections[which + 1] : header->fileSize;
+        return end - header->sections[which];
+    }
+
+    // Sections lie after the header in write order, 8-byte aligned, each long
+    // enough for the counts in the header; the CSR and name offsets end inside
+    // what they index, from its start
+    bool sectionsFit() const {
+        uint64_t n = header->stationCount, edges = header->edgeCount, lines = header->lineCount;
+        const uint64_t needed[SNAPSHOT_SECTIONS] = {
+            (n + 1) * sizeof(uint32_t), 0, n * sizeof(double), n * sizeof(double), n * sizeof(LineSet),
+            (n + 1) * sizeof(uint32_t), edges * sizeof(uint32_t), edges * sizeof(int), edges * sizeof(LineSet),
+            (lines + 1) * sizeof(uint32_t), 0};
+        uint64_t previous = sizeof(SnapshotHeader);
+        for (int s = 0; s < SNAPSHOT_SECTIONS; ++s) {
+            uint64_t start = header->sections[s];
+            if (start < previous || start % 8 != 0 || start > header->fileSize || sectionExtent(s) < needed[s]) {
+                return false;
+            }
+            previous = start;
+        }
+        const uint32_t* offsets = section<uint32_t>(SECTION_OFFSETS);
+        const uint32_t* nameOffsets = section<uint32_t>(SECTION_NAME_OFFSETS);
+        const uint32_t* lineNameOffsets = section<uint32_t>(SECTION_LINE_NAME_OFFSETS);
+        return offsets[0] == 0 && offsets[n] == edges && nameOffsets[0] == 0 &&
+               nameOffsets[n] <= sectionExtent(SECTION_NAME_BLOB) && lineNameOffsets[0] == 0 &&
+               lineNameOffsets[lines] <= sectionExtent(SECTION_LINE_NAME_BLOB);
+    }
+
+    // Offsets never go backwards, every edge ends at a station and every line
+    // set names only lines the snapshot has names for
+    bool elementsValid() const {
+        uint32_t n = header->stationCount;
+        for (SnapshotSection which : {SECTION_OFFSETS, SECTION_NAME_OFFSETS}) {
+            const uint32_t* offsets = section<uint32_t>(which);
+            for (uint32_t id = 0; id < n; ++id) {
+                if (offsets[id] > offsets[id + 1]) return false;
+            }
+        }
+        const uint32_t* lineOffsets = section<uint32_t>(SECTION_LINE_NAME_OFFSETS);
+        for (uint32_t line = 0; line < header->lineCount; ++line) {
+            if (lineOffsets[line] > lineOffsets[line + 1]) return false;
+        }
+        const uint32_t* targets = section<uint32_t>(SECTION_TARGETS);
+        const int* weights = section<int>(SECTION_WEIGHTS);
+        for (uint32_t e = 0; e < header->edgeCount; ++e) {
+            if (targets[e] >= n || weights[e] < 0) return false;
+        }
+        if (header->lineCount > MAX_METRO_LINES) {
+            return false;
+        }
+        LineSet named;
+        for (uint32_t line = 0; line < header->lineCount; ++line) {
+            named.set(line);
+        }
+        const LineSet* stationLines = section<LineSet>(SECTION_STATION_LINES);
+        for (uint32_t id = 0; id < n; ++id) {
+            if (stationLines[id].without(named).any()) return false;
+        }
+        const LineSet* edgeLines = section<LineSet>(SECTION_EDGE_LINES);
+        for (uint32_t e = 0; e < header->edgeCount; ++e) {
+            if (edgeLines[e].without(named).any()) return false;
+        }
+        return true;
+    }
+
+    // FNV-1a over the header with its checksum zeroed, then the rest of the file
+    uint64_t checksum() const {
+        SnapshotHeader copy = *header;
+        copy.checksum = 0;
+        uint64_t hash = fnv1a64(reinterpret_cast<const char*>(&copy), sizeof(copy));
+        return fnv1a64(base + sizeof(SnapshotHeader), header->fileSize - sizeof(SnapshotHeader), hash);
+    }
+};
+
+// Answer the interactive query from a mapped snapshot, without building the network
+int runSnapshotQuery(const string& file) {
+    MappedNetwork network;
+    string error;
+    if (!network.open(file, error)) {
+        cerr << error << "\n";
+        return 1;
+    }
+
+    string source, destination;
+    cout << "Enter the source station: ";
+    getline(cin, source);
+    cout << "Enter the destination station: ";
+    getline(cin, destination);
+
+    SearchWorkspace ws;
+    vector<uint32_t> ids;
+    uint32_t from, to;
+    int totalDistance = SearchWorkspace::INF;
+    if (network.lookup(source, from) && network.lookup(destination, to)) {
+        totalDistance = searchPath(network.view(), from, to, ids, ws);
+    }
+    vector<string> path;
+    for (uint32_t id : ids) {
+        path.emplace_back(network.name(id));
+    }
+
+    vector<RouteLeg> legs;
+    routeLegs(network.view(), ids, [&](uint32_t e) -> const LineSet& { return network.edgeLines(e); }, legs);
+    cout << "Shortest path from " << source << " to " << destination << ":\n";
+    printRoute(cout, path, legs, [&](int line) { return network.lineName(line); });
+    cout << "\nTotal distance: " << formatKm(totalDistance) << " km\n";
+    cout << "Fare: Rs. " << MetroGraph::calculateFare(totalDistance) << "\n";
+    return 0;
+}
+
+// Zero-copy tokenizer over a text buffer: hands out records one line at a
+// time and fields split on a separator, all as views into the buffer.
+// Blank lines and lines starting with '#' are skipped.
+class RecordReader {
+public:
+    explicit RecordReader(string_view text) : rest(text) {}
+
+    bool next(string_view& record) {
+        while (!rest.empty()) {
+            size_t end = rest.find('\n');
+            string_view line = rest.substr(0, end);
+            rest = end == string_view::npos ? string_view() : rest.substr(end + 1);
+            ++lineNumber;
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (!line.empty() && line[0] != '#') {
+                record = line;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t line() const { return lineNumber; }
+
+    // Pop the next field off the front of a record
+    static string_view field(string_view& record, char separator) {
+        size_t end = record.find(separator);
+        string_view result = record.substr(0, end);
+        record = end == string_view::npos ? string_view() : record.substr(end + 1);
+        return result;
+    }
+
+private:
+    string_view rest;
+    size_t lineNumber = 0;
+};
+
+// What loadNetworkFiles() read and how fast
+struct LoadReport {
+    size_t stationRecords = 0;
+    size_t lineRecords = 0;
+    size_t edges = 0;
+    size_t skippedEdges = 0;    // hops touching a station missing from the stations file
+    size_t bytes = 0;
+    double milliseconds = 0;
+};
+
+// Load a network from two text files in one pass each.
+//   stations file: name|latitude|longitude|line;line...
+//   lines file:    line|station|station|...   (consecutive stations are connected)
+// Edge weights are the Haversine distance between the two stations, rounded to whole metres.
+bool loadNetworkFiles(MetroGraph& graph, const string& stationsFile, const string& linesFile,
+                      LoadReport& report, string& error) {
+    auto start = chrono::steady_clock::now();
+    report = LoadReport();
+
+    MappedFile stationsText;
+    if (!stationsText.open(stationsFile, error)) {
+        return false;
+    }
+    RecordReader stationReader(stationsText.text());
+    string_view record;
+    string name, line;
+    while (stationReader.next(record)) {
+        string_view nameField = RecordReader::field(record, '|');
+        string_view latField = RecordReader::field(record, '|');
+        string_view lonField = RecordReader::field(record, '|');
+        string_view linesField = RecordReader::field(record, '|');
+        double latitude, longitude;
+        if (nameField.empty() ||
+            from_chars(latField.data(), latField.data() + latField.size(), latitude).ec != errc() ||
+            from_chars(lonField.data(), lonField.data() + lonField.size(), longitude).ec != errc()) {
+            error = stationsFile + ":" + to_string(stationReader.line()) + ": expected name|latitude|longitude|lines";
+            return false;
+        }
+        LineSet lines;
+        while (!linesField.empty()) {
+            string_view lineName = RecordReader::field(linesField, ';');
+            if (!lineName.empty()) {
+                line.assign(lineName.data(), lineName.size());
+                lines.set(graph.internLine(line));
+            }
+        }
+        name.assign(nameField.data(), nameField.size());
+        graph.addStation(name, latitude, longitude, lines);
+        ++report.stationRecords;
+    }
+
+    MappedFile linesText;
+    if (!linesText.open(linesFile, error)) {
+        return false;
+    }
+    RecordReader lineReader(linesText.text());
+    string previousName;
+    while (lineReader.next(record)) {
+        string_view lineName = RecordReader::field(record, '|');
+        if (lineName.empty() || record.empty()) {
+            error = linesFile + ":" + to_string(lineReader.line()) + ": expected line|station|station...";
+            return false;
+        }
+        line.assign(lineName.data(), lineName.size());
+        LineSet lines;
+        lines.set(graph.internLine(line));
+
+        const Station* previous = nullptr;
+        bool first = true;
+        while (!record.empty()) {
+            string_view stationName = RecordReader::field(record, '|');
+            name.assign(stationName.data(), stationName.size());
+            const Station* current = graph.findStation(name);
+            if (!first) {
+                if (previous && current) {
+                    double km = MetroGraph::haversine(previous->latitude, previous->longitude,
+                                                      current->latitude, current->longitude);
+                    graph.addEdge(previousName, name, metresFromKm(km), lines);
+                    ++report.edges;
+                } else {
+                    ++report.skippedEdges;
+                }
+            }
+            previous = current;
+            previousName.swap(name);
+            first = false;
+        }
+        ++report.lineRecords;
+    }
+
+    report.bytes = stationsText.size() + linesText.size();
+    report.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+void printLoadReport(ostream& out, const LoadReport& report) {
+    double seconds = max(report.milliseconds, 1e-6) / 1000.0;
+    out << "Loaded " << report.stationRecords << " station records and " << report.lineRecords
+        << " line records (" << report.edges << " edges) in " << report.milliseconds << " ms\n";
+    out << "Throughput: " << report.bytes / seconds / 1e6 << " MB/s, "
+        << report.stationRecords / seconds << " stations/s, " << report.edges / seconds << " edges/s\n";
+    if (report.skippedEdges > 0) {
+        out << "Skipped " << report.skippedEdges << " hops to stations missing from the stations file\n";
+    }
+}
+
+void printBuildReport(ostream& out, const BuildReport& report) {
+    out << "Built " << report.stations << " stations and " << report.edges << " directed edges in "
+        << report.milliseconds << " ms\n";
+    out << "Station declarations: " << report.declarations << ", " << report.mergedDeclarations
+        << " merged into interchanges (coordinates up to " << report.coordinateSpreadKm << " km apart)\n";
+    out << "Edges added: " << report.edgesAdded << ", dropped " << report.duplicateEdges << " duplicate, "
+        << report.parallelEdges << " parallel (lines merged), " << report.selfLoops << " self-loops\n";
+}
+
+// Load alias|station records, e.g. "Millennium City Centre|HUDA City Centre"
+bool loadAliases(const string& file, vector<pair<string, string>>& aliases, string& error) {
+    MappedFile text;
+    if (!text.open(file, error)) {
+        return false;
+    }
+    RecordReader reader(text.text());
+    string_view record;
+    while (reader.next(record)) {
+        string_view alias = RecordReader::field(record, '|');
+        string_view station = RecordReader::field(record, '|');
+        if (alias.empty() || station.empty()) {
+            error = file + ":" + to_string(reader.line()) + ": expected alias|station";
+            return false;
+        }
+        aliases.emplace_back(string(alias), string(station));
+    }
+    return true;
+}
+
+// Scratch space for repairing one AllPairsTable row at a time
+struct RepairWorkspace {
+    vector<uint32_t> stamp;         // stations whose label was reset, stamp == epoch
+    uint32_t epoch = 0;
+    vector<uint32_t> subtree;
+    vector<pair<int, uint32_t>> heap;
+    size_t resettled = 0;
+
+    void prepare(uint32_t n) {
+        if (stamp.size() < n) {
+            stamp.resize(n, 0);
+        }
+        if (++epoch == 0) {
+            fill(stamp.begin(), stamp.end(), 0);
+            epoch = 1;
+        }
+        subtree.clear();
+        heap.clear();
+    }
+
+    void reset(uint32_t v) { stamp[v] = epoch; }
+    bool isReset(uint32_t v) const { return stamp[v] == epoch; }
+
+    void push(int dist, uint32_t v) {
+        heap.emplace_back(dist, v);
+        push_heap(heap.begin(), heap.end(), greater<pair<int, uint32_t>>());
+    }
+};
+
+// Dense all-pairs distance table with O(1) distance lookup. Row s holds the
+// shortest-path tree from s, stored as the last hop before each destination:
+// unrolling stays inside one row, so paths are consistent even across
+// zero-length hops where per-source next-hop tables can disagree.
+// After closures repair() touches only the rows they can affect, and in each
+// only the stations whose distance can change: an edge that got longer or
+// closed invalidates the subtree hanging below it, which is re-settled from
+// its unaffected neighbours; an edge that got shorter or reopened is relaxed
+// once and the improvement propagates. Both start one Dijkstra pass, so a
+// mixed batch of changes is repaired together.
+class AllPairsTable {
+public:
+    // Default cap on table memory; bigger networks keep using on-line search
+    static constexpr size_t DEFAULT_MAX_BYTES = size_t(256) << 20;
+
+    // Run one-to-all Dijkstra from every station across worker threads.
+    // Returns false (and leaves the table empty) if the matrix would exceed maxBytes.
+    bool build(const MetroGraph& metro, unsigned threads = 0, size_t maxBytes = DEFAULT_MAX_BYTES) {
+        graph = &metro;
+        const CompactGraph& compact = metro.compactGraph();
+        n = compact.stationCount();
+        distances.clear();
+        lastHop.clear();
+        buildMs = 0;
+
+        size_t cells = size_t(n) * n;
+        if (cells * (sizeof(int) + sizeof(uint32_t)) > maxBytes) {
+            n = 0;
+            return false;
+        }
+
+        auto start = chrono::steady_clock::now();
+        distances.assign(cells, SearchWorkspace::INF);
+        lastHop.assign(cells, SearchWorkspace::NONE);
+
+        if (threads == 0) {
+            threads = max(1u, thread::hardware_concurrency());
+        }
+        threads = min<unsigned>(threads, max<uint32_t>(n, 1));
+
+        // Sources are handed out round-robin, every row is written by one thread only
+        vector<thread> workers;
+        for (unsigned w = 0; w < threads; ++w) {
+            workers.emplace_back([this, &metro, w, threads]() {
+                SearchWorkspace ws;
+                for (uint32_t source = w; source < n; source += threads) {
+                    metro.dijkstraAll(source, ws);
+                    int* distRow = &distances[size_t(source) * n];
+                    uint32_t* hopRow = &lastHop[size_t(source) * n];
+                    for (uint32_t t = 0; t < n; ++t) {
+                        distRow[t] = ws.distanceOf(t);
+                        hopRow[t] = ws.previousOf(t);
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        threadsUsed = threads;
+        version = metro.graphVersion();
+        return true;
+    }
+
+    // Bring the table up to date with the closures applied to the graph since
+    // it was built or last repaired, all of whose changes must be listed.
+    // Returns the number of rows that needed work.
+    size_t repair(vector<EdgeChange>& changes, unsigned threads = 0) {
+        resettled = 0;
+        if (!ready()) {
+            return 0;
+        }
+        coalesce(changes);
+        atomic<size_t> touched{0}, settled{0};
+        forEachRow(threads, [&](uint32_t source, RepairWorkspace& ws) {
+            if (repairRow(source, changes, ws)) {
+                ++touched;
+                settled += ws.resettled;
+            }
+        });
+        resettled = settled;
+        version = graph->graphVersion();
+        return touched;
+    }
+
+    bool ready() const { return n > 0; }
+    // Built or repaired for the graph as it is now; stale tables answer by on-line search
+    bool current() const { return ready() && version == graph->graphVersion(); }
+    size_t lastResettled() const { return resettled; }   // stations settled again by the last repair
+    double buildTimeMs() const { return buildMs; }
+    unsigned buildThreads() const { return threadsUsed; }
+    size_t memoryBytes() const { return distances.size() * sizeof(int) + lastHop.size() * sizeof(uint32_t); }
+
+    int distance(uint32_t source, uint32_t destination) const {
+        return distances[size_t(source) * n + destination];
+    }
+
+    // Shortest path by table lookup, falls back to on-line search if no
+    // table was built or the graph changed since without a repair()
+    int route(uint32_t source, uint32_t destination, vector<uint32_t>& path, SearchWorkspace& ws) const {
+        if (!current()) {
+            return graph->dijkstraIds(source, destination, path, ws);
+        }
+        path.clear();
+        int total = distance(source, destination);
+        if (total == SearchWorkspace::INF) {
+            return total;
+        }
+        const uint32_t* hopRow = &lastHop[size_t(source) * n];
+        for (uint32_t at = destination; at != SearchWorkspace::NONE; at = hopRow[at]) {
+            path.push_back(at);
+            if (at == source) break;
+        }
+        reverse(path.begin(), path.end());
+        return total;
+    }
+
+private:
+    const MetroGraph* graph = nullptr;
+    uint32_t n = 0;
+    vector<int> distances;      // row-major n x n
+    vector<uint32_t> lastHop;   // row-major n x n, predecessor of t in the tree from s
+    uint64_t version = 0;       // graphVersion() the rows are shortest for
+    double buildMs = 0;
+    unsigned threadsUsed = 0;
+    size_t resettled = 0;
+
+    // One change per edge: first weight before, last weight after
+    static void coalesce(vector<EdgeChange>& changes) {
+        stable_sort(changes.begin(), changes.end(),
+                    [](const EdgeChange& a, const EdgeChange& b) { return a.edge < b.edge; });
+        size_t kept = 0;
+        for (size_t i = 0; i < changes.size(); ++i) {
+            if (kept > 0 && changes[kept - 1].edge == changes[i].edge) {
+                changes[kept - 1].after = changes[i].after;
+            } else {
+                changes[kept++] = changes[i];
+            }
+        }
+        changes.resize(kept);
+        changes.erase(remove_if(changes.begin(), changes.end(),
+                                [](const EdgeChange& change) { return change.before == change.after; }),
+                      changes.end());
+    }
+
+    // Rows are handed out round-robin, every row is written by one thread only
+    template <typename Work>
+    void forEachRow(unsigned threads, Work work) {
+        if (threads == 0) {
+            threads = max(1u, thread::hardware_concurrency());
+        }
+        threads = min<unsigned>(threads, n);
+        auto run = [&](unsigned w) {
+            RepairWorkspace ws;
+            for (uint32_t source = w; source < n; source += threads) {
+                work(source, ws);
+            }
+        };
+        if (threads == 1) {
+            run(0);
+            return;
+        }
+        vector<thread> workers;
+        for (unsigned w = 0; w < threads; ++w) {
+            workers.emplace_back(run, w);
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    bool repairRow(uint32_t source, const vector<EdgeChange>& changes, RepairWorkspace& ws) {
+        const LiveNetwork& live = graph->liveNetwork();
+        GraphView view = graph->view();
+        int* dist = &distances[size_t(source) * n];
+        uint32_t* parent = &lastHop[size_t(source) * n];
+        ws.prepare(n);
+        ws.resettled = 0;
+
+        // Tree edges that got longer cut off everything below them
+        for (const EdgeChange& change : changes) {
+            if (change.after > change.before && parent[change.to] == change.from && !ws.isReset(change.to)) {
+                ws.reset(change.to);
+                ws.subtree.push_back(change.to);
+            }
+        }
+        for (size_t i = 0; i < ws.subtree.size(); ++i) {
+            uint32_t u = ws.subtree[i];
+            for (uint32_t e = view.offsets[u]; e < view.offsets[u + 1]; ++e) {
+                uint32_t v = view.targets[e];
+                if (parent[v] == u && !ws.isReset(v)) {
+                    ws.reset(v);
+                    ws.subtree.push_back(v);
+                }
+            }
+        }
+        for (uint32_t u : ws.subtree) {
+            dist[u] = SearchWorkspace::INF;
+            parent[u] = SearchWorkspace::NONE;
+        }
+        // ...and are re-entered from the rest of the tree
+        for (uint32_t u : ws.subtree) {
+            for (uint32_t e = view.offsets[u]; e < view.offsets[u + 1]; ++e) {
+                uint32_t v = view.targets[e];
+                int w = live.weight(live.reverse(e));
+                if (ws.isReset(v) || dist[v] == SearchWorkspace::INF || w == SearchWorkspace::INF) {
+                    continue;
+                }
+                if (dist[v] + w < dist[u]) {
+                    dist[u] = dist[v] + w;
+                    parent[u] = v;
+                }
+            }
+            if (dist[u] != SearchWorkspace::INF) {
+                ws.push(dist[u], u);
+            }
+        }
+        // Edges that got shorter may offer a better way in
+        for (const EdgeChange& change : changes) {
+            if (change.after < change.before && dist[change.from] != SearchWorkspace::INF &&
+                dist[change.from] + change.after < dist[change.to]) {
+                dist[change.to] = dist[change.from] + change.after;
+                parent[change.to] = change.from;
+                ws.push(dist[change.to], change.to);
+            }
+        }
+        if (ws.subtree.empty() && ws.heap.empty()) {
+            return false;
+        }
+
+        while (!ws.heap.empty()) {
+            pop_heap(ws.heap.begin(), ws.heap.end(), greater<pair<int, uint32_t>>());
+            pair<int, uint32_t> top = ws.heap.back();
+            ws.heap.pop_back();
+            uint32_t u = top.second;
+            if (top.first > dist[u]) {
+                continue;
+            }
+            ++ws.resettled;
+            for (uint32_t e = view.offsets[u]; e < view.offsets[u + 1]; ++e) {
+                if (!view.open(e)) {
+                    continue;
+                }
+                uint32_t v = view.targets[e];
+                int new_dist = top.first + view.weights[e];
+                if (new_dist < dist[v]) {
+                    dist[v] = new_dist;
+                    parent[v] = u;
+                    ws.push(new_dist, v);
+                }
+            }
+        }
+        return true;
+    }
+};
+
+// Build the all-pairs table and compare its query time with on-line search
+void benchmarkAllPairs(const MetroGraph& graph, unsigned threads) {
+    const CompactGraph& compact = graph.compactGraph();
+    uint32_t n = compact.stationCount();
+    AllPairsTable table;
+    if (!table.build(graph, threads)) {
+        cout << "Network too large for the all-pairs table, queries use on-line search\n";
+        return;
+    }
+    cout << "Stations: " << n << "\n";
+    cout << "Build: " << table.buildTimeMs() << " ms on " << table.buildThreads() << " thread(s), "
+         << table.memoryBytes() / 1024 << " KiB\n";
+
+    SearchWorkspace ws;
+    vector<uint32_t> path;
+    size_t pairs = size_t(n) * n, mismatches = 0, hops = 0;
+    auto start = chrono::steady_clock::now();
+    for (uint32_t source = 0; source < n; ++source) {
+        for (uint32_t destination = 0; destination < n; ++destination) {
+            table.route(source, destination, path, ws);
+            hops += path.size();
+        }
+    }
+    auto middle = chrono::steady_clock::now();
+    for (uint32_t source = 0; source < n; ++source) {
+        for (uint32_t destination = 0; destination < n; ++destination) {
+            if (graph.dijkstraIds(source, destination, path, ws) != table.distance(source, destination)) {
+                ++mismatches;
+            }
+        }
+    }
+    auto end = chrono::steady_clock::now();
+
+    double tableMs = chrono::duration<double, milli>(middle - start).count();
+    double searchMs = chrono::duration<double, milli>(end - middle).count();
+    cout << "Queries: " << pairs << " (all ordered pairs, " << hops << " path stations)\n";
+    cout << "Table lookup + unroll: " << tableMs << " ms (" << tableMs * 1e6 / pairs << " ns/query)\n";
+    cout << "On-line Dijkstra: " << searchMs << " ms (" << searchMs * 1e6 / pairs << " ns/query)\n";
+    cout << "Build pays for itself after " << static_cast<size_t>(table.buildTimeMs() / max(1e-9, (searchMs - tableMs) / pairs))
+         << " queries\n";
+    cout << "Distance mismatches: " << mismatches << "\n";
+}
+
+// Fare bands from every origin at once: for each origin, the stations in each
+// calculateFare() band, all in one flat array ordered by origin then band.
+class FareAtlas {
+public:
+    // Default cap on atlas memory, like the all-pairs table
+    static constexpr size_t DEFAULT_MAX_BYTES = size_t(256) << 20;
+
+    // Bounded one-to-all search from every station across worker threads.
+    // Returns false (and leaves the atlas empty) if it would exceed maxBytes.
+    bool build(const MetroGraph& metro, int budget, unsigned threads = 0, size_t maxBytes = DEFAULT_MAX_BYTES) {
+        const CompactGraph& compact = metro.compactGraph();
+        GraphView view = metro.view();
+        n = compact.stationCount();
+        stations.clear();
+        bandOffsets.assign(size_t(n) * FARE_BANDS + 1, 0);
+        buildMs = 0;
+
+        auto start = chrono::steady_clock::now();
+        if (threads == 0) {
+            threads = max(1u, thread::hardware_concurrency());
+        }
+        threads = min<unsigned>(threads, max<uint32_t>(n, 1));
+
+        // Each worker collects its origins' zones in a buffer of its own and
+        // records their band sizes; the buffers are stitched together afterwards
+        vector<vector<uint32_t>> buffers(threads);
+        vector<size_t> bufferStart(n, 0);
+        atomic<size_t> total(0);
+        atomic<bool> tooBig(false);
+        vector<thread> workers;
+        for (unsigned w = 0; w < threads; ++w) {
+            workers.emplace_back([&, w]() {
+                SearchWorkspace ws;
+                FareZones zones;
+                vector<uint32_t>& buffer = buffers[w];
+                for (uint32_t origin = w; origin < n && !tooBig; origin += threads) {
+                    reachableWithin(view, origin, budget, zones, ws);
+                    if ((total += zones.stations.size()) * sizeof(uint32_t) > maxBytes) {
+                        tooBig = true;
+                        break;
+                    }
+                    bufferStart[origin] = buffer.size();
+                    buffer.insert(buffer.end(), zones.stations.begin(), zones.stations.end());
+                    for (int band = 0; band < FARE_BANDS; ++band) {
+                        bandOffsets[size_t(origin) * FARE_BANDS + band + 1] = zones.bandSize(band);
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        if (tooBig) {
+            n = 0;
+            bandOffsets.clear();
+            return false;
+        }
+
+        for (size_t i = 1; i < bandOffsets.size(); ++i) {
+            bandOffsets[i] += bandOffsets[i - 1];
+        }
+        stations.resize(bandOffsets.back());
+        for (uint32_t origin = 0; origin < n; ++origin) {
+            size_t begin = bandOffsets[size_t(origin) * FARE_BANDS];
+            size_t count = bandOffsets[size_t(origin + 1) * FARE_BANDS] - begin;
+            const vector<uint32_t>& buffer = buffers[origin % threads];
+            copy(buffer.begin() + bufferStart[origin], buffer.begin() + bufferStart[origin] + count,
+                 stations.begin() + begin);
+        }
+        buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        threadsUsed = threads;
+        return true;
+    }
+
+    bool ready() const { return n > 0; }
+    double buildTimeMs() const { return buildMs; }
+    unsigned buildThreads() const { return threadsUsed; }
+    size_t memoryBytes() const { return stations.size() * sizeof(uint32_t) + bandOffsets.size() * sizeof(size_t); }
+
+    // Stations in one fare band from origin, nearest first
+    pair<const uint32_t*, size_t> band(uint32_t origin, int fareBand) const {
+        size_t cell = size_t(origin) * FARE_BANDS + fareBand;
+        return {stations.data() + bandOffsets[cell], bandOffsets[cell + 1] - bandOffsets[cell]};
+    }
+
+private:
+    uint32_t n = 0;
+    vector<uint32_t> stations;
+    vector<size_t> bandOffsets;     // band b of origin o is [bandOffsets[o * FARE_BANDS + b], next)
+    double buildMs = 0;
+    unsigned threadsUsed = 0;
+};
+
+// Build the fare-zone atlas in parallel and check it against one bounded
+// search per origin, and against answering it with one search per pair
+void benchmarkFareAtlas(const MetroGraph& graph, int budget, unsigned threads) {
+    const CompactGraph& compact = graph.compactGraph();
+    GraphView view = graph.view();
+    uint32_t n = compact.stationCount();
+    FareAtlas atlas;
+    if (!atlas.build(graph, budget, threads)) {
+        cout << "Fare-zone atlas would exceed " << FareAtlas::DEFAULT_MAX_BYTES / (1 << 20) << " MiB, lower the budget\n";
+        return;
+    }
+    cout << "Atlas: " << n << " origins in " << atlas.buildTimeMs() << " ms on " << atlas.buildThreads()
+         << " thread(s), " << atlas.memoryBytes() / 1024 << " KiB\n";
+
+    SearchWorkspace ws;
+    FareZones zones;
+    size_t mismatches = 0, bandTotals[FARE_BANDS] = {};
+    auto start = chrono::steady_clock::now();
+    for (uint32_t origin = 0; origin < n; ++origin) {
+        reachableWithin(view, origin, budget, zones, ws);
+        for (int band = 0; band < FARE_BANDS; ++band) {
+            pair<const uint32_t*, size_t> stored = atlas.band(origin, band);
+            bandTotals[band] += stored.second;
+            if (stored.second != zones.bandSize(band) ||
+                !equal(stored.first, stored.first + stored.second, zones.stations.begin() + zones.bandStart[band])) {
+                ++mismatches;
+            }
+        }
+    }
+    double sequentialMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Sequential bounded searches: " << sequentialMs << " ms (" << sequentialMs * 1000.0 / max<uint32_t>(n, 1)
+         << " us/origin)\n";
+
+    // The same bands from one dijkstra() per pair, timed on a sample and scaled up
+    uint32_t sample = min<uint32_t>(n, 20), destinations = min<uint32_t>(n, 500);
+    vector<uint32_t> path;
+    start = chrono::steady_clock::now();
+    for (uint32_t origin = 0; origin < sample; ++origin) {
+        for (uint32_t t = 0; t < destinations; ++t) {
+            graph.dijkstraIds(origin, t, path, ws);
+        }
+    }
+    double pairMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "One search per destination: "
+         << pairMs * 1000.0 / max<uint32_t>(sample, 1) * n / max<uint32_t>(destinations, 1) << " us/origin\n";
+    cout << "Stations per origin by fare:";
+    for (int band = 0; band < FARE_BANDS; ++band) {
+        cout << " Rs. " << FARE_BAND_PRICES[band] << ": " << double(bandTotals[band]) / max<uint32_t>(n, 1);
+    }
+    cout << "\nMismatches: " << mismatches << "\n";
+}
+
+// Print the stations reachable from source within budget, grouped by fare
+void printFareZones(ostream& out, const MetroGraph& graph, const string& source, int budget) {
+    const CompactGraph& compact = graph.compactGraph();
+    uint32_t from;
+    if (!compact.lookup(source, from)) {
+        out << "Unknown station " << source << "\n";
+        return;
+    }
+    SearchWorkspace ws;
+    FareZones zones;
+    reachableWithin(graph.view(), from, budget, zones, ws);
+    out << zones.stations.size() << " station(s) reachable from " << source << "\n";
+    for (int band = 0; band < FARE_BANDS; ++band) {
+        if (zones.bandSize(band) == 0) {
+            continue;
+        }
+        out << "Rs. " << FARE_BAND_PRICES[band] << ":";
+        for (uint32_t i = zones.bandStart[band]; i < zones.bandStart[band + 1]; ++i) {
+            out << (i == zones.bandStart[band] ? " " : ", ") << compact.names[zones.stations[i]] << " ("
+                << formatKm(zones.distances[i]) << " km)";
+        }
+        out << "\n";
+    }
+}
+
+// Time the map-based search against the CSR search over every ordered station pair
+void benchmarkGraph(MetroGraph& graph) {
+    const CompactGraph& compact = graph.compactGraph();
+    const vector<string>& names = compact.names;
+    size_t pairs = 0, mismatches = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (const auto& source : names) {
+        for (const auto& destination : names) {
+            graph.dijkstraMap(source, destination);
+            ++pairs;
+        }
+    }
+    auto middle = chrono::steady_clock::now();
+    vector<uint32_t> path;
+    for (uint32_t source = 0; source < compact.stationCount(); ++source) {
+        for (uint32_t destination = 0; destination < compact.stationCount(); ++destination) {
+            graph.dijkstraIds(source, destination, path);
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    SearchWorkspace ws;
+    for (uint32_t source = 0; source < compact.stationCount(); ++source) {
+        for (uint32_t destination = 0; destination < compact.stationCount(); ++destination) {
+            graph.dijkstraIds(source, destination, path, ws);
+        }
+    }
+    auto reused = chrono::steady_clock::now();
+
+    for (uint32_t source = 0; source < compact.stationCount(); ++source) {
+        for (uint32_t destination = 0; destination < compact.stationCount(); ++destination) {
+            int expected = graph.dijkstraMap(names[source], names[destination]).second;
+            if (graph.dijkstraIds(source, destination, path, ws) != expected) {
+                ++mismatches;
+            }
+        }
+    }
+
+    double mapMs = chrono::duration<double, milli>(middle - start).count();
+    double compactMs = chrono::duration<double, milli>(end - middle).count();
+    double reusedMs = chrono::duration<double, milli>(reused - end).count();
+    cout << "Stations: " << compact.stationCount() << ", directed edges: " << compact.edgeCount() << "\n";
+    cout << "Queries: " << pairs << " (all ordered pairs)\n";
+    cout << "Map graph: " << mapMs << " ms (" << mapMs * 1000.0 / pairs << " us/query)\n";
+    cout << "CSR graph: " << compactMs << " ms (" << compactMs * 1000.0 / pairs << " us/query)\n";
+    cout << "CSR graph, reused workspace: " << reusedMs << " ms (" << reusedMs * 1000.0 / pairs << " us/query)\n";
+    cout << "Speedup: " << mapMs / compactMs << "x (" << mapMs / reusedMs << "x with reused workspace)\n";
+    cout << "Distance mismatches: " << mismatches << "\n";
+}
+
+// Latency percentile (0-100) over a set of samples, reorders the samples
+double percentile(vector<double>& samples, double pct) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t rank = min(samples.size() - 1, static_cast<size_t>(pct / 100.0 * samples.size()));
+    nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+// Closure-to-fresh-answers latency: close and reopen random segments and
+// stations, and slow random segments down, repairing the all-pairs table
+// after each change, against rebuilding it. Repaired rows are checked against
+// fresh searches after every change. Every change is undone again, so the
+// graph ends up as it started.
+void benchmarkClosures(MetroGraph& graph, unsigned threads) {
+    const CompactGraph& compact = graph.compactGraph();
+    uint32_t n = compact.stationCount();
+    if (compact.edgeCount() == 0) {
+        return;
+    }
+    AllPairsTable table;
+    if (!table.build(graph, threads)) {
+        cout << "Network too large for the all-pairs table, queries use on-line search\n";
+        return;
+    }
+    double rebuildUs = table.buildTimeMs() * 1000;
+    cout << "Stations: " << n << ", all-pairs table rebuild: " << table.buildTimeMs() << " ms\n";
+
+    // Large networks check a rotating handful of rows per change
+    SearchWorkspace ws;
+    size_t checkRows = min<size_t>(n, max<size_t>(1, 1000000 / n)), nextCheck = 0;
+    auto verify = [&]() {
+        size_t mismatches = !table.current();
+        for (size_t i = 0; i < checkRows; ++i) {
+            uint32_t source = static_cast<uint32_t>(nextCheck++ % n);
+            graph.dijkstraAll(source, ws);
+            for (uint32_t t = 0; t < n; ++t) {
+                mismatches += ws.distanceOf(t) != table.distance(source, t);
+            }
+        }
+        return mismatches;
+    };
+
+    const size_t CHANGES = min<size_t>(200, max<size_t>(10, 2000000 / (size_t(n) * n / 64 + 1)));
+    mt19937 random(37);
+    uniform_int_distribution<uint32_t> pickEdge(0, static_cast<uint32_t>(compact.edgeCount() - 1));
+    uniform_int_distribution<uint32_t> pickStation(0, n - 1);
+    struct Tally {
+        const char* name;
+        vector<double> us;
+        size_t rows = 0, resettled = 0, mismatches = 0;
+    };
+    Tally tallies[] = {{"close segment", {}}, {"reopen segment", {}}, {"slow segment x2", {}},
+                       {"restore segment", {}}, {"close station", {}}, {"reopen station", {}}};
+    vector<EdgeChange> changes;
+    auto apply = [&](Tally& tally, auto change) {
+        changes.clear();
+        auto begin = chrono::steady_clock::now();
+        change();
+        tally.rows += table.repair(changes, threads);
+        tally.us.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count());
+        tally.resettled += table.lastResettled();
+        tally.mismatches += verify();
+    };
+    for (size_t i = 0; i < CHANGES; ++i) {
+        uint32_t e = pickEdge(random);
+        uint32_t a = graph.liveNetwork().source(e), b = compact.targets[e];
+        int metres = compact.weights[e];
+        apply(tallies[0], [&]() { graph.closeSegment(a, b, changes); });
+        apply(tallies[1], [&]() { graph.openSegment(a, b, changes); });
+        apply(tallies[2], [&]() { graph.setSegmentWeight(a, b, metres * 2, changes); });
+        apply(tallies[3], [&]() { graph.setSegmentWeight(a, b, metres, changes); });
+        uint32_t s = pickStation(random);
+        apply(tallies[4], [&]() { graph.closeStation(s, changes); });
+        apply(tallies[5], [&]() { graph.openStation(s, changes); });
+    }
+
+    cout << CHANGES << " changes of each kind, repaired on "
+         << (threads ? threads : max(1u, thread::hardware_concurrency())) << " thread(s):\n";
+    for (Tally& tally : tallies) {
+        double mean = 0;
+        for (double us : tally.us) {
+            mean += us / tally.us.size();
+        }
+        double p99 = percentile(tally.us, 99);
+        cout << "  " << tally.name << ": " << mean << " us (p50 " << percentile(tally.us, 50) << ", p99 " << p99
+             << "), " << double(tally.rows) / CHANGES << " rows and " << double(tally.resettled) / CHANGES
+             << " stations re-settled per change, " << rebuildUs / mean << "x faster than rebuild, "
+             << tally.mismatches << " mismatches\n";
+    }
+}
+
+// Metro-like synthetic network of about `stations` stations, written as
+// directory/stations.txt and directory/lines.txt in the format the loader
+// reads. Diameter lines cross the city at spread angles, slightly off
+// centre, and ring lines circle it at even radii; every place a ring meets a
+// diameter line is an interchange declared once per line, as in the Delhi
+// files. Coordinates are laid out around Delhi in kilometres, the city
+// radius grows with the square root of the size (12 km at 200 stations, at
+// most 300 km) and station spacing follows from the track length. Seeded, so
+// the same size always gives the same network.
+bool writeSyntheticNetwork(size_t stations, const string& directory, string& error) {
+    if (stations < 10) {
+        error = "a synthetic network needs at least 10 stations";
+        return false;
+    }
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        error = "cannot create " + directory;
+        return false;
+    }
+    const double CENTRE_LAT = 28.6139, CENTRE_LON = 77.2090, KM_PER_DEGREE = 111.32;
+    const size_t MAX_LINES = MAX_METRO_LINES - 16;
+    size_t diameters = min<size_t>(max<size_t>(2, lround(sqrt(double(stations)) / 3)), MAX_LINES * 2 / 3);
+    size_t rings = max<size_t>(1, diameters / 2);
+    double radius = min(300.0, 12.0 * sqrt(stations / 200.0));
+    mt19937 random(41);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+
+    // Diameter i: points centre + offset * normal + t * direction, t in [-radius, radius]
+    vector<double> angle(diameters), offset(diameters);
+    for (size_t i = 0; i < diameters; ++i) {
+        angle[i] = M_PI * (i + 0.5 * unit(random)) / diameters;
+        offset[i] = (unit(random) - 0.5) * 0.2 * radius;
+    }
+    vector<double> ringRadius(rings);
+    double track = 2 * radius * diameters;
+    for (size_t j = 0; j < rings; ++j) {
+        ringRadius[j] = radius * (j + 1) / (rings + 1);
+        track += 2 * M_PI * ringRadius[j];
+    }
+
+    // A stop on a line: position along it (t or angle), id, and x/y in km
+    struct Stop {
+        double at;
+        size_t id;
+        double x, y;
+    };
+    vector<vector<Stop>> diameterStops(diameters), ringStops(rings);
+    size_t nextId = 0;
+    double minimumGap = track / stations / 4;
+    for (size_t i = 0; i < diameters; ++i) {
+        double dx = cos(angle[i]), dy = sin(angle[i]);
+        for (size_t j = 0; j < rings; ++j) {
+            if (ringRadius[j] <= fabs(offset[i])) {
+                continue;
+            }
+            double t = sqrt(ringRadius[j] * ringRadius[j] - offset[i] * offset[i]);
+            for (double side : {-t, t}) {
+                Stop stop{side, nextId, offset[i] * -dy + side * dx, offset[i] * dx + side * dy};
+                // Lines meeting the ring at almost the same point share one interchange
+                auto shared = find_if(ringStops[j].begin(), ringStops[j].end(), [&](const Stop& other) {
+                    return hypot(other.x - stop.x, other.y - stop.y) < minimumGap;
+                });
+                if (shared == ringStops[j].end()) {
+                    ringStops[j].push_back(Stop{atan2(stop.y, stop.x), nextId++, stop.x, stop.y});
+                } else if (!diameterStops[i].empty() && diameterStops[i].back().id == shared->id) {
+                    continue;
+                } else {
+                    stop.id = shared->id;
+                }
+                diameterStops[i].push_back(stop);
+            }
+        }
+    }
+    // Each interchange stands in for a regular stop on both of its lines
+    double spacing = track / (stations + nextId);
+    auto fill = [&](vector<Stop>& stops, double from, double to, double step, auto position) {
+        vector<double> crossings;
+        for (const Stop& stop : stops) {
+            crossings.push_back(stop.at);
+        }
+        sort(crossings.begin(), crossings.end());
+        for (double at = from; at < to; at += step * (0.8 + 0.4 * unit(random))) {
+            auto near = lower_bound(crossings.begin(), crossings.end(), at);
+            if ((near != crossings.end() && *near - at < step / 2) ||
+                (near != crossings.begin() && at - *(near - 1) < step / 2)) {
+                continue;
+            }
+            pair<double, double> xy = position(at);
+            stops.push_back(Stop{at, nextId++, xy.first, xy.second});
+        }
+        sort(stops.begin(), stops.end(), [](const Stop& a, const Stop& b) { return a.at < b.at; });
+    };
+    for (size_t i = 0; i < diameters; ++i) {
+        double dx = cos(angle[i]), dy = sin(angle[i]);
+        fill(diameterStops[i], -radius, radius, spacing, [&](double t) {
+            return make_pair(offset[i] * -dy + t * dx, offset[i] * dx + t * dy);
+        });
+    }
+    for (size_t j = 0; j < rings; ++j) {
+        fill(ringStops[j], -M_PI, M_PI, spacing / ringRadius[j], [&](double a) {
+            return make_pair(ringRadius[j] * cos(a), ringRadius[j] * sin(a));
+        });
+    }
+
+    ofstream stationsOut(directory + "/stations.txt", ios::trunc);
+    ofstream linesOut(directory + "/lines.txt", ios::trunc);
+    stationsOut << "# Synthetic metro network: " << diameters << " diameter lines, " << rings << " ring lines\n";
+    stationsOut.precision(9);
+    auto writeLine = [&](const string& line, const vector<Stop>& stops, bool loop) {
+        linesOut << line;
+        for (const Stop& stop : stops) {
+            double latitude = CENTRE_LAT + stop.y / KM_PER_DEGREE;
+            double longitude = CENTRE_LON + stop.x / (KM_PER_DEGREE * cos(CENTRE_LAT * M_PI / 180.0));
+            stationsOut << "S" << stop.id << "|" << latitude << "|" << longitude << "|" << line << "\n";
+            linesOut << "|S" << stop.id;
+        }
+        if (loop && !stops.empty()) {
+            linesOut << "|S" << stops.front().id;
+        }
+        linesOut << "\n";
+    };
+    for (size_t i = 0; i < diameters; ++i) {
+        writeLine("Line " + to_string(i + 1), diameterStops[i], false);
+    }
+    for (size_t j = 0; j < rings; ++j) {
+        writeLine("Ring " + to_string(j + 1), ringStops[j], true);
+    }
+    if (!stationsOut || !linesOut) {
+        error = "cannot write the network to " + directory;
+        return false;
+    }
+    return true;
+}
+
+// Micro-benchmarks of the building blocks on the loaded network (Delhi, or
+// one made by --generate): network construction, calculateDistance(),
+// dijkstra() on random pairs and on the worst pair, path reconstruction,
+// printing the line changes of a route, and every engine on the same random
+// pairs. Sample sizes shrink as the network grows so a run stays short.
+void benchmarkSuite(const MetroGraph& graph, const string& stationsFile, const string& linesFile, unsigned threads) {
+    const CompactGraph& compact = graph.compactGraph();
+    uint32_t n = compact.stationCount();
+    if (n < 2) {
+        return;
+    }
+    const size_t QUERIES = min<size_t>(20000, max<size_t>(20, 20000000 / n));
+    auto usSince = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    };
+    cout << "Stations: " << n << ", directed edges: " << compact.edgeCount() << ", " << QUERIES
+         << " queries per benchmark\n";
+
+    // Construction: load and build a fresh copy of the network
+    const int BUILDS = n > 100000 ? 1 : 5;
+    double loadUs = 0, buildUs = 0;
+    for (int run = 0; run < BUILDS; ++run) {
+        MetroGraph copy;
+        LoadReport report;
+        string error;
+        auto start = chrono::steady_clock::now();
+        if (!loadNetworkFiles(copy, stationsFile, linesFile, report, error)) {
+            cerr << error << "\n";
+            return;
+        }
+        loadUs += usSince(start);
+        start = chrono::steady_clock::now();
+        copy.freeze();
+        buildUs += usSince(start);
+    }
+    cout << "  load files: " << loadUs / BUILDS / 1000 << " ms, build (freeze): " << buildUs / BUILDS / 1000
+         << " ms, " << n / ((loadUs + buildUs) / BUILDS / 1e6) << " stations/s\n";
+
+    mt19937 random(43);
+    uniform_int_distribution<uint32_t> pick(0, n - 1);
+    vector<pair<uint32_t, uint32_t>> pairs(QUERIES);
+    for (auto& query : pairs) {
+        query = {pick(random), pick(random)};
+    }
+
+    const size_t DISTANCES = QUERIES * 50;
+    double checksum = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < DISTANCES; ++i) {
+        const auto& query = pairs[i % QUERIES];
+        checksum += graph.calculateDistance(compact.names[query.first], compact.names[query.second]);
+    }
+    cout << "  calculateDistance: " << usSince(start) * 1000 / DISTANCES << " ns/call\n";
+
+    SearchWorkspace ws;
+    size_t settled = 0;
+    start = chrono::steady_clock::now();
+    for (const auto& query : pairs) {
+        auto route = graph.dijkstra(compact.names[query.first], compact.names[query.second], ws);
+        checksum += route.second;
+        settled += ws.settled;
+    }
+    cout << "  dijkstra, random pairs: " << usSince(start) / QUERIES << " us/query, "
+         << double(settled) / QUERIES << " settled/query\n";
+
+    // Worst pair: the far end of a tree grown from the far end of a tree from station 0
+    auto farthest = [&](uint32_t from) {
+        searchTree(graph.view(), from, ws);
+        uint32_t far = from;
+        for (uint32_t v = 0; v < n; ++v) {
+            if (ws.distanceOf(v) != SearchWorkspace::INF && ws.distanceOf(v) > ws.distanceOf(far)) {
+                far = v;
+            }
+        }
+        return far;
+    };
+    uint32_t worstFrom = farthest(0);
+    uint32_t worstTo = farthest(worstFrom);
+    const size_t WORST_RUNS = max<size_t>(5, QUERIES / 10);
+    pair<vector<string>, int> worst;
+    start = chrono::steady_clock::now();
+    for (size_t run = 0; run < WORST_RUNS; ++run) {
+        worst = graph.dijkstra(compact.names[worstFrom], compact.names[worstTo], ws);
+    }
+    cout << "  dijkstra, worst pair (" << formatKm(worst.second) << " km, " << worst.first.size() << " stations): "
+         << usSince(start) / WORST_RUNS << " us/query, " << ws.settled << " settled\n";
+
+    // Reconstruction alone: parent walk and id to name, on the last search
+    vector<uint32_t> ids;
+    vector<string> names;
+    searchPath(graph.view(), worstFrom, worstTo, ids, ws);
+    start = chrono::steady_clock::now();
+    for (size_t run = 0; run < QUERIES; ++run) {
+        ws.tracePath(worstFrom, worstTo, ids);
+        names.clear();
+        for (uint32_t id : ids) {
+            names.push_back(compact.names[id]);
+        }
+    }
+    cout << "  path reconstruction: " << usSince(start) * 1000 / QUERIES / max<size_t>(ids.size(), 1)
+         << " ns/station\n";
+
+    // Line-change printing of the worst route into a buffer
+    ostringstream sink;
+    const LineRegistry& lineNames = graph.lines();
+    vector<RouteLeg> legs;
+    start = chrono::steady_clock::now();
+    for (size_t run = 0; run < WORST_RUNS; ++run) {
+        sink.str("");
+        routeLegs(compact, ids, legs);
+        printRoute(sink, worst.first, legs, [&](int line) -> const string& { return lineNames.name(line); });
+    }
+    cout << "  print line changes: " << usSince(start) / WORST_RUNS << " us/route (" << sink.str().size()
+         << " bytes)\n";
+
+    // Every engine on the same pairs, preprocessing included
+    start = chrono::steady_clock::now();
+    RoutePlanner planner(graph);
+    double planUs = usSince(start);
+    start = chrono::steady_clock::now();
+    planner.prepareContraction(threads);
+    cout << "  engine preparation: " << planUs / 1000 << " ms (A*, bidirectional), " << usSince(start) / 1000
+         << " ms (contraction hierarchy)\n";
+    RouteWorkspace routeWs;
+    vector<int> expected(QUERIES);
+    for (int e = 0; e < ENGINE_COUNT; ++e) {
+        RouteEngine engine = static_cast<RouteEngine>(e);
+        size_t mismatches = 0;
+        settled = 0;
+        start = chrono::steady_clock::now();
+        for (size_t q = 0; q < QUERIES; ++q) {
+            int distance = planner.route(engine, pairs[q].first, pairs[q].second, ids, routeWs);
+            settled += routeWs.settled;
+            if (e == ENGINE_DIJKSTRA) {
+                expected[q] = distance;
+            } else {
+                mismatches += distance != expected[q];
+            }
+        }
+        cout << "  " << ENGINE_NAMES[e] << ": " << usSince(start) / QUERIES << " us/query, "
+             << double(settled) / QUERIES << " settled/query, " << mismatches << " mismatches\n";
+    }
+    if (checksum < 0) {
+        cout << checksum;   // keep the timed loops from being optimized out
+    }
+}
+
+// Timetable in GTFS style: seconds since midnight (may pass 24:00:00 for
+// trips running after midnight, as GTFS allows)
+bool parseClock(string_view text, uint32_t& seconds) {
+    uint32_t parts[3] = {0, 0, 0};
+    for (int i = 0; i < 3; ++i) {
+        string_view part = RecordReader::field(text, ':');
+        if (part.empty() || from_chars(part.data(), part.data() + part.size(), parts[i]).ec != errc()) {
+            return false;
+        }
+    }
+    seconds = parts[0] * 3600 + parts[1] * 60 + parts[2];
+    return text.empty();
+}
+
+string formatClock(uint32_t seconds) {
+    char text[16];
+    snprintf(text, sizeof(text), "%02u:%02u:%02u", seconds / 3600, seconds / 60 % 60, seconds % 60);
+    return text;
+}
+
+// Split one CSV record into fields. Quoted fields may hold commas; their
+// quotes are stripped (a doubled quote inside is left as is).
+void csvFields(string_view record, vector<string_view>& fields) {
+    fields.clear();
+    size_t at = 0;
+    while (true) {
+        if (at < record.size() && record[at] == '"') {
+            size_t close = at + 1;
+            while (close < record.size() &&
+                   !(record[close] == '"' && (close + 1 == record.size() || record[close + 1] == ','))) {
+                ++close;
+            }
+            fields.push_back(record.substr(at + 1, close - at - 1));
+            at = close + 1;
+        } else {
+            size_t end = min(record.find(',', at), record.size());
+            fields.push_back(record.substr(at, end - at));
+            at = end;
+        }
+        if (at >= record.size()) {
+            break;
+        }
+        ++at; // skip the comma
+    }
+}
+
+// One vehicle running from one stop to the next without stopping
+struct Connection {
+    uint32_t departure;
+    uint32_t arrival;
+    uint32_t from;      // MetroGraph station id
+    uint32_t to;
+    uint32_t trip;
+};
+
+// A ride on one trip, from boarding to alighting
+struct JourneyLeg {
+    uint32_t trip;
+    uint32_t from;
+    uint32_t to;
+    uint32_t departure;
+    uint32_t arrival;
+};
+
+struct Journey {
+    vector<JourneyLeg> legs;
+    uint32_t arrival = 0;
+};
+
+// What Timetable::load() read and how fast
+struct TimetableReport {
+    size_t stops = 0;
+    size_t unknownStops = 0;        // stop names that are not stations of the network
+    size_t trips = 0;
+    size_t stopTimes = 0;
+    size_t skippedConnections = 0;  // hops to or from unknown stops
+    size_t bytes = 0;
+    double milliseconds = 0;
+};
+
+// Scratch space for Connection Scan queries, reset lazily like SearchWorkspace
+struct ScanWorkspace {
+    static constexpr uint32_t NEVER = numeric_limits<uint32_t>::max();
+    static constexpr uint32_t NONE = numeric_limits<uint32_t>::max();
+
+    vector<uint32_t> arrival;       // earliest arrival per station
+    vector<uint32_t> reachedBy;     // connection that achieved it
+    vector<uint32_t> stationStamp;
+    vector<uint32_t> boardedAt;     // first connection taken on each trip
+    vector<uint32_t> tripStamp;
+    uint32_t epoch = 0;
+    size_t scanned = 0;             // connections looked at by the last query
+
+    void prepare(uint32_t stations, uint32_t trips) {
+        if (stationStamp.size() < stations) {
+            arrival.resize(stations);
+            reachedBy.resize(stations);
+            stationStamp.resize(stations, 0);
+        }
+        if (tripStamp.size() < trips) {
+            boardedAt.resize(trips);
+            tripStamp.resize(trips, 0);
+        }
+        if (++epoch == 0) {
+            fill(stationStamp.begin(), stationStamp.end(), 0);
+            fill(tripStamp.begin(), tripStamp.end(), 0);
+            epoch = 1;
+        }
+        scanned = 0;
+    }
+
+    uint32_t arrivalAt(uint32_t station) const { return stationStamp[station] == epoch ? arrival[station] : NEVER; }
+    bool boarded(uint32_t trip) const { return tripStamp[trip] == epoch; }
+};
+
+// Trips and stop times imported from a GTFS-style directory (stops.txt,
+// trips.txt, stop_times.txt), flattened into one array of connections sorted
+// by departure. Stops are matched to MetroGraph stations by name, so results
+// use the same station ids as every other engine.
+class Timetable {
+public:
+    bool load(const string& directory, const CompactGraph& graph, TimetableReport& report, string& error) {
+        auto start = chrono::steady_clock::now();
+        report = TimetableReport();
+        connections.clear();
+        tripIds.clear();
+        tripRoutes.clear();
+        stationCount = graph.stationCount();
+
+        vector<size_t> columns;
+        string name;
+        MappedFile stopsText, tripsText, stopTimesText;
+
+        // stops.txt: stop_id -> station id
+        unordered_map<string, uint32_t> stopStation;
+        if (!openTable(directory + "/stops.txt", stopsText, {"stop_id", "stop_name"}, columns, error)) {
+            return false;
+        }
+        forEachRow(stopsText, columns, [&](const vector<string_view>& row) {
+            uint32_t station = SearchWorkspace::NONE;
+            name.assign(row[1].data(), row[1].size());
+            if (!graph.lookup(name, station)) {
+                ++report.unknownStops;
+            }
+            stopStation[string(row[0])] = station;
+            ++report.stops;
+        });
+
+        // trips.txt: trip_id -> trip index, remembering the route (line) it runs on
+        unordered_map<string, uint32_t> tripIndex;
+        if (!openTable(directory + "/trips.txt", tripsText, {"trip_id", "route_id"}, columns, error)) {
+            return false;
+        }
+        forEachRow(tripsText, columns, [&](const vector<string_view>& row) {
+            tripIndex.emplace(string(row[0]), static_cast<uint32_t>(tripIds.size()));
+            tripIds.emplace_back(row[0]);
+            tripRoutes.emplace_back(row[1]);
+        });
+        report.trips = tripIds.size();
+
+        // stop_times.txt: consecutive stops of a trip become connections
+        struct StopTime {
+            uint32_t trip;
+            uint32_t sequence;
+            uint32_t arrival;
+            uint32_t departure;
+            uint32_t station;
+        };
+        vector<StopTime> stopTimes;
+        if (!openTable(directory + "/stop_times.txt", stopTimesText,
+                       {"trip_id", "arrival_time", "departure_time", "stop_id", "stop_sequence"}, columns, error)) {
+            return false;
+        }
+        bool valid = true;
+        forEachRow(stopTimesText, columns, [&](const vector<string_view>& row) {
+            StopTime stopTime;
+            auto trip = tripIndex.find(string(row[0]));
+            auto stop = stopStation.find(string(row[3]));
+            if (!valid || trip == tripIndex.end() || stop == stopStation.end() ||
+                !parseClock(row[1], stopTime.arrival) || !parseClock(row[2], stopTime.departure) ||
+                from_chars(row[4].data(), row[4].data() + row[4].size(), stopTime.sequence).ec != errc()) {
+                if (valid) {
+                    error = directory + "/stop_times.txt: bad record for trip " + string(row[0]);
+                }
+                valid = false;
+                return;
+            }
+            stopTime.trip = trip->second;
+            stopTime.station = stop->second;
+            stopTimes.push_back(stopTime);
+        });
+        if (!valid) {
+            return false;
+        }
+        report.stopTimes = stopTimes.size();
+
+        sort(stopTimes.begin(), stopTimes.end(), [](const StopTime& a, const StopTime& b) {
+            return a.trip != b.trip ? a.trip < b.trip : a.sequence < b.sequence;
+        });
+        connections.reserve(stopTimes.size());
+        for (size_t i = 1; i < stopTimes.size(); ++i) {
+            const StopTime& from = stopTimes[i - 1];
+            const StopTime& to = stopTimes[i];
+            if (from.trip != to.trip) {
+                continue;
+            }
+            if (from.station == SearchWorkspace::NONE || to.station == SearchWorkspace::NONE ||
+                to.arrival < from.departure) {
+                ++report.skippedConnections;
+                continue;
+            }
+            connections.push_back(Connection{from.departure, to.arrival, from.station, to.station, from.trip});
+        }
+        // Ties broken by arrival so zero-length hops come out in riding order
+        sort(connections.begin(), connections.end(), [](const Connection& a, const Connection& b) {
+            return a.departure != b.departure ? a.departure < b.departure : a.arrival < b.arrival;
+        });
+
+        report.bytes = stopsText.size() + tripsText.size() + stopTimesText.size();
+        report.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    size_t connectionCount() const { return connections.size(); }
+    uint32_t tripCount() const { return static_cast<uint32_t>(tripIds.size()); }
+    const string& tripId(uint32_t trip) const { return tripIds[trip]; }
+    const string& tripRoute(uint32_t trip) const { return tripRoutes[trip]; }
+
+    // Connection Scan: earliest arrival at destination leaving source no earlier
+    // than departure. One forward pass over the connections from the first one
+    // at departure, stopping once no later connection can improve the arrival.
+    // changeSeconds is the minimum time to change between trips.
+    bool earliestArrival(uint32_t source, uint32_t destination, uint32_t departure, Journey& journey,
+                         ScanWorkspace& ws, uint32_t changeSeconds = 0) const {
+        journey.legs.clear();
+        journey.arrival = ScanWorkspace::NEVER;
+        ws.prepare(stationCount, tripCount());
+        if (source == destination) {
+            journey.arrival = departure;
+            return true;
+        }
+        // Arriving changeSeconds early lets the first boarding use the same change test
+        ws.stationStamp[source] = ws.epoch;
+        ws.arrival[source] = departure >= changeSeconds ? departure - changeSeconds : 0;
+        ws.reachedBy[source] = ScanWorkspace::NONE;
+
+        auto first = lower_bound(connections.begin(), connections.end(), departure,
+                                 [](const Connection& c, uint32_t time) { return c.departure < time; });
+        const Connection* begin = connections.data();
+        const Connection* end = begin + connections.size();
+        for (const Connection* c = begin + (first - connections.begin()); c != end; ++c) {
+            if (c->departure >= ws.arrivalAt(destination)) {
+                break;
+            }
+            ++ws.scanned;
+            bool onBoard = ws.boarded(c->trip);
+            if (!onBoard) {
+                uint32_t ready = ws.arrivalAt(c->from);
+                if (ready == ScanWorkspace::NEVER || ready + changeSeconds > c->departure) {
+                    continue;
+                }
+                ws.tripStamp[c->trip] = ws.epoch;
+                ws.boardedAt[c->trip] = static_cast<uint32_t>(c - begin);
+            }
+            if (c->arrival < ws.arrivalAt(c->to)) {
+                ws.stationStamp[c->to] = ws.epoch;
+                ws.arrival[c->to] = c->arrival;
+                ws.reachedBy[c->to] = static_cast<uint32_t>(c - begin);
+            }
+        }
+
+        if (ws.arrivalAt(destination) == ScanWorkspace::NEVER) {
+            return false;
+        }
+        // Walk back leg by leg: the connection that reached a station, and where its trip was boarded
+        journey.arrival = ws.arrivalAt(destination);
+        for (uint32_t at = destination; at != source;) {
+            const Connection& alight = connections[ws.reachedBy[at]];
+            const Connection& board = connections[ws.boardedAt[alight.trip]];
+            journey.legs.push_back(JourneyLeg{alight.trip, board.from, alight.to, board.departure, alight.arrival});
+            at = board.from;
+        }
+        reverse(journey.legs.begin(), journey.legs.end());
+        return true;
+    }
+
+private:
+    uint32_t stationCount = 0;
+    vector<Connection> connections;     // sorted by departure, scanned front to back
+    vector<string> tripIds;
+    vector<string> tripRoutes;
+
+    // Map a table and find the columns we need in its header; GTFS allows them in any order
+    static bool openTable(const string& file, MappedFile& text, const vector<string>& columns,
+                          vector<size_t>& positions, string& error) {
+        if (!text.open(file, error)) {
+            return false;
+        }
+        RecordReader reader(text.text());
+        string_view header;
+        vector<string_view> fields;
+        if (reader.next(header)) {
+            if (header.substr(0, 3) == "\xEF\xBB\xBF") {
+                header.remove_prefix(3); // UTF-8 byte order mark
+            }
+            csvFields(header, fields);
+        }
+        positions.clear();
+        for (const string& column : columns) {
+            auto it = find(fields.begin(), fields.end(), column);
+            if (it == fields.end()) {
+                error = file + ": missing column " + column;
+                return false;
+            }
+            positions.push_back(static_cast<size_t>(it - fields.begin()));
+        }
+        return true;
+    }
+
+    // Call visit with the wanted columns of every data row, in the order
+    // openTable() was asked for them. Rows too short to hold them are skipped.
+    template <typename Visit>
+    static void forEachRow(const MappedFile& text, const vector<size_t>& positions, Visit visit) {
+        RecordReader reader(text.text());
+        string_view record;
+        vector<string_view> fields, row(positions.size());
+        reader.next(record); // header
+        while (reader.next(record)) {
+            csvFields(record, fields);
+            bool complete = true;
+            for (size_t i = 0; i < positions.size() && complete; ++i) {
+                complete = positions[i] < fields.size();
+                if (complete) {
+                    row[i] = fields[positions[i]];
+                }
+            }
+            if (complete) {
+                visit(row);
+            }
+        }
+    }
+};
+
+// How often and how fast writeTimetable() runs each line
+struct ServicePattern {
+    const char* line;
+    uint32_t headwaySeconds;
+    double speedKmh;
+};
+
+const ServicePattern DEFAULT_SERVICE = {"", 5 * 60, 32.0};
+const ServicePattern SERVICE_PATTERNS[] = {{"Airport Express Line", 10 * 60, 60.0}};
+const uint32_t SERVICE_START = 5 * 3600 + 30 * 60;  // first departures, 05:30
+const uint32_t SERVICE_END = 23 * 3600 + 30 * 60;   // last departures, 23:30
+const uint32_t DWELL_SECONDS = 30;
+
+// Quote a CSV field if it holds a comma or quote
+string csvField(const string& text) {
+    if (text.find_first_of(",\"") == string::npos) {
+        return text;
+    }
+    string quoted = "\"";
+    for (char c : text) {
+        quoted += c;
+        if (c == '"') {
+            quoted += '"';
+        }
+    }
+    return quoted + "\"";
+}
+
+// Write a sample GTFS-style timetable for the network: every line record of
+// the lines file runs both ways all day at the line's service pattern, with
+// running times from the Haversine distance between stops. Stations missing
+// from the network split a record into separate runs.
+bool writeTimetable(const MetroGraph& graph, const string& linesFile, const string& directory, string& error) {
+    const CompactGraph& compact = graph.compactGraph();
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        error = "cannot create " + directory;
+        return false;
+    }
+
+    ofstream stops(directory + "/stops.txt", ios::trunc);
+    stops << "stop_id,stop_name,stop_lat,stop_lon\n";
+    stops.precision(9);
+    for (uint32_t id = 0; id < compact.stationCount(); ++id) {
+        const Station* station = graph.findStation(compact.names[id]);
+        stops << "S" << id << "," << csvField(compact.names[id]) << "," << (station ? station->latitude : 0.0)
+              << "," << (station ? station->longitude : 0.0) << "\n";
+    }
+
+    MappedFile linesText;
+    if (!linesText.open(linesFile, error)) {
+        return false;
+    }
+    ofstream routes(directory + "/routes.txt", ios::trunc);
+    ofstream trips(directory + "/trips.txt", ios::trunc);
+    ofstream stopTimes(directory + "/stop_times.txt", ios::trunc);
+    routes << "route_id,route_long_name\n";
+    trips << "route_id,service_id,trip_id\n";
+    stopTimes << "trip_id,arrival_time,departure_time,stop_id,stop_sequence\n";
+
+    RecordReader reader(linesText.text());
+    string_view record;
+    string name;
+    set<string> lineNames;
+    size_t tripNumber = 0;
+    while (reader.next(record)) {
+        string line(RecordReader::field(record, '|'));
+        ServicePattern service = DEFAULT_SERVICE;
+        for (const ServicePattern& pattern : SERVICE_PATTERNS) {
+            if (line == pattern.line) {
+                service = pattern;
+            }
+        }
+        if (lineNames.insert(line).second) {
+            routes << csvField(line) << "," << csvField(line) << "\n";
+        }
+
+        // Collect runs of consecutive stations the network knows
+        vector<vector<uint32_t>> runs(1);
+        while (!record.empty()) {
+            string_view stationName = RecordReader::field(record, '|');
+            name.assign(stationName.data(), stationName.size());
+            uint32_t id;
+            if (compact.lookup(name, id)) {
+                runs.back().push_back(id);
+            } else if (!runs.back().empty()) {
+                runs.emplace_back();
+            }
+        }
+
+        for (vector<uint32_t>& run : runs) {
+            if (run.size() < 2) {
+                continue;
+            }
+            for (int direction = 0; direction < 2; ++direction) {
+                if (direction == 1) {
+                    reverse(run.begin(), run.end());
+                }
+                // Running time of each hop, at least a minute
+                vector<uint32_t> hopSeconds;
+                for (size_t i = 1; i < run.size(); ++i) {
+                    double km = graph.calculateDistance(compact.names[run[i - 1]], compact.names[run[i]]);
+                    hopSeconds.push_back(max<uint32_t>(60, static_cast<uint32_t>(km / service.speedKmh * 3600.0)));
+                }
+                for (uint32_t start = SERVICE_START; start <= SERVICE_END; start += service.headwaySeconds) {
+                    string trip = "T" + to_string(++tripNumber);
+                    trips << csvField(line) << ",daily," << trip << "\n";
+                    uint32_t clock = start;
+                    for (size_t i = 0; i < run.size(); ++i) {
+                        if (i > 0) {
+                            clock += hopSeconds[i - 1];
+                        }
+                        uint32_t leave = i == 0 || i + 1 == run.size() ? clock : clock + DWELL_SECONDS;
+                        stopTimes << trip << "," << formatClock(clock) << "," << formatClock(leave) << ",S"
+                                  << run[i] << "," << i + 1 << "\n";
+                        clock = leave;
+                    }
+                }
+            }
+        }
+    }
+
+    stops.close();
+    routes.close();
+    trips.close();
+    stopTimes.close();
+    if (!stops || !routes || !trips || !stopTimes) {
+        error = "cannot write timetable to " + directory;
+        return false;
+    }
+    return true;
+}
+
+// Load throughput, then earliest-arrival queries between random stations at
+// random times of day: connections scanned and latency
+int benchmarkTimetable(const MetroGraph& graph, const string& directory) {
+    const CompactGraph& compact = graph.compactGraph();
+    Timetable timetable;
+    TimetableReport report;
+    string error;
+    if (!timetable.load(directory, compact, report, error)) {
+        cerr << error << "\n";
+        return 1;
+    }
+    cout << "Loaded " << report.stops << " stops, " << report.trips << " trips and " << report.stopTimes
+         << " stop times in " << report.milliseconds << " ms ("
+         << report.bytes / max(report.milliseconds, 1e-6) / 1000.0 << " MB/s)\n";
+    cout << "Connections: " << timetable.connectionCount() << " (" << timetable.connectionCount() * sizeof(Connection) / 1024
+         << " KiB contiguous)\n";
+    if (report.unknownStops > 0 || report.skippedConnections > 0) {
+        cout << "Skipped " << report.unknownStops << " stops missing from the network and "
+             << report.skippedConnections << " connections touching them\n";
+    }
+
+    const int QUERIES = 10000;
+    mt19937 random(42);
+    uniform_int_distribution<uint32_t> station(0, compact.stationCount() - 1);
+    uniform_int_distribution<uint32_t> clock(SERVICE_START, SERVICE_END);
+    ScanWorkspace ws;
+    Journey journey;
+    size_t scanned = 0, found = 0, legs = 0;
+    vector<double> latencies;
+    latencies.reserve(QUERIES);
+    auto start = chrono::steady_clock::now();
+    for (int q = 0; q < QUERIES; ++q) {
+        uint32_t from = station(random), to = station(random), departure = clock(random);
+        auto begin = chrono::steady_clock::now();
+        if (timetable.earliestArrival(from, to, departure, journey, ws)) {
+            ++found;
+            legs += journey.legs.size();
+        }
+        latencies.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count());
+        scanned += ws.scanned;
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << QUERIES << " earliest-arrival queries: " << found << " answered, " << double(legs) / max<size_t>(found, 1)
+         << " legs/journey, " << double(scanned) / QUERIES << " connections scanned/query, " << ms * 1000.0 / QUERIES
+         << " us/query (p50 " << percentile(latencies, 50) << " us, p99 " << percentile(latencies, 99) << " us)\n";
+    return 0;
+}
+
+// Print a journey leg by leg with clock times
+void printJourney(ostream& out, const Journey& journey, const Timetable& timetable, const CompactGraph& graph) {
+    for (const JourneyLeg& leg : journey.legs) {
+        out << formatClock(leg.departure) << "  " << graph.names[leg.from] << " -> " << formatClock(leg.arrival)
+            << "  " << graph.names[leg.to] << "  (" << timetable.tripRoute(leg.trip) << ", trip "
+            << timetable.tripId(leg.trip) << ")\n";
+    }
+}
+
+// Answer newline-delimited "source|destination" queries (a tab also works as
+// the separator) read from a file, or stdin when file is "-". Queries are
+// spread over worker threads in fixed-size chunks, each worker with its own
+// workspace, and results are written in input order as
+//   source|destination|km|fare|station;station;...
+// Unknown stations and unreachable pairs get "-" for distance and fare.
+int runBatch(const RoutePlanner& planner, const RouteProfile& profile, const string& file, unsigned threads,
+             RouteCache* cache = nullptr) {
+    MappedFile mapped;
+    string buffered;
+    string_view input;
+    if (file == "-") {
+        buffered.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+        input = buffered;
+    } else {
+        string error;
+        if (!mapped.open(file, error)) {
+            cerr << error << "\n";
+            return 1;
+        }
+        input = mapped.text();
+    }
+
+    vector<pair<string_view, string_view>> queries;
+    RecordReader reader(input);
+    string_view record;
+    while (reader.next(record)) {
+        char separator = record.find('|') != string_view::npos ? '|' : '\t';
+        string_view source = RecordReader::field(record, separator);
+        queries.emplace_back(source, record);
+    }
+
+    const size_t CHUNK = 256;
+    size_t chunks = (queries.size() + CHUNK - 1) / CHUNK;
+    vector<string> output(chunks);
+    vector<double> latencies(queries.size());
+    atomic<size_t> nextChunk(0);
+    const CompactGraph& compact = planner.metro().compactGraph();
+
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(min<size_t>(threads, max<size_t>(chunks, 1)));
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (unsigned w = 0; w < threads; ++w) {
+        workers.emplace_back([&]() {
+            RouteWorkspace ws;
+            vector<uint32_t> path;
+            string key;
+            for (size_t chunk = nextChunk++; chunk < chunks; chunk = nextChunk++) {
+                string& out = output[chunk];
+                size_t end = min(queries.size(), (chunk + 1) * CHUNK);
+                for (size_t q = chunk * CHUNK; q < end; ++q) {
+                    auto queryStart = chrono::steady_clock::now();
+                    uint32_t from = 0, to = 0;
+                    int distance = SearchWorkspace::INF;
+                    path.clear();
+                    key.assign(queries[q].first.data(), queries[q].first.size());
+                    bool known = compact.lookup(key, from);
+                    key.assign(queries[q].second.data(), queries[q].second.size());
+                    if (known && compact.lookup(key, to)) {
+                        distance = cache ? cache->route(planner, profile, from, to, path, ws)
+                                         : planner.route(profile, from, to, path, ws);
+                    }
+
+                    out.append(queries[q].first).append("|").append(queries[q].second).append("|");
+                    if (distance == SearchWorkspace::INF) {
+                        out.append("-|-|");
+                    } else {
+                        out.append(formatKm(distance)).append("|");
+                        out.append(to_string(static_cast<int>(MetroGraph::calculateFare(distance)))).append("|");
+                    }
+                    for (size_t i = 0; i < path.size(); ++i) {
+                        if (i > 0) out.push_back(';');
+                        out.append(compact.names[path[i]]);
+                    }
+                    out.push_back('\n');
+                    latencies[q] = chrono::duration<double, micro>(chrono::steady_clock::now() - queryStart).count();
+                }
+                SearchStats::serviceDump(cerr);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double totalMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    for (const auto& chunk : output) {
+        cout.write(chunk.data(), chunk.size());
+    }
+    cout.flush();
+
+    cerr << "Answered " << queries.size() << " queries on " << threads << " thread(s) in " << totalMs << " ms ("
+         << queries.size() / max(totalMs / 1000.0, 1e-9) << " queries/s)\n";
+    cerr << "Latency p50: " << percentile(latencies, 50) << " us, p99: " << percentile(latencies, 99) << " us\n";
+    if (cache) {
+        RouteCache::Stats stats = cache->stats();
+        cerr << "Cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evictions, "
+             << stats.entries << " entries\n";
+    }
+    return 0;
+}
+
+// Resolve a server address: a port, localhost:PORT or 127.0.0.1:PORT means
+// TCP on the loopback interface, anything else is a Unix domain socket path
+bool parseLocalAddress(const string& address, sockaddr_storage& socketAddress, socklen_t& length, string& error) {
+    memset(&socketAddress, 0, sizeof(socketAddress));
+    string port = address;
+    for (const char* host : {"localhost:", "127.0.0.1:"}) {
+        if (port.compare(0, strlen(host), host) == 0) {
+            port = port.substr(strlen(host));
+        }
+    }
+    if (!port.empty() && port.size() <= 5 && all_of(port.begin(), port.end(), ::isdigit)) {
+        unsigned long number = stoul(port);
+        if (number == 0 || number > 65535) {
+            error = "bad port " + port;
+            return false;
+        }
+        sockaddr_in* inet = reinterpret_cast<sockaddr_in*>(&socketAddress);
+        inet->sin_family = AF_INET;
+        inet->sin_port = htons(static_cast<uint16_t>(number));
+        inet->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        length = sizeof(sockaddr_in);
+        return true;
+    }
+    sockaddr_un* local = reinterpret_cast<sockaddr_un*>(&socketAddress);
+    if (address.empty() || address.size() >= sizeof(local->sun_path)) {
+        error = "bad socket path " + address;
+        return false;
+    }
+    local->sun_family = AF_UNIX;
+    memcpy(local->sun_path, address.c_str(), address.size() + 1);
+    length = sizeof(sockaddr_un);
+    return true;
+}
+
+// Long-running route server on a local socket: the network is built once and
+// every query after that costs one search. The protocol is line based, one
+// request per line and exactly one response line per request, in request
+// order, so clients may pipeline as many requests as they like:
+//
+//   ROUTE source|destination     OK km|fare|station;station;...
+//   FARE source|destination      OK km|fare
+//   CHANGES source|destination   OK km|fare|line changes|station@line;station@line;...
+//   STATS                        OK {search stats as JSON, see --stats}
+//   PING                         OK
+//
+// Anything that cannot be answered gets ERR and a reason. One thread runs a
+// level-triggered epoll loop over the listening socket, the clients, an
+// eventfd the workers raise and a signalfd for SIGINT/SIGTERM. Complete lines
+// read from a client are cut into numbered chunks for the worker pool, and
+// answered chunks are written back strictly in number order.
+class RouteServer {
+public:
+    RouteServer(const RoutePlanner& routes, const RouteProfile& routeProfile, unsigned workerCount,
+                RouteCache* routeCache = nullptr)
+        : planner(routes), profile(routeProfile), cache(routeCache),
+          threads(workerCount == 0 ? max(1u, thread::hardware_concurrency()) : workerCount) {}
+
+    RouteServer(const RouteServer&) = delete;
+    RouteServer& operator=(const RouteServer&) = delete;
+    ~RouteServer() { closeAll(); }
+
+    bool listen(const string& address, string& error) {
+        sockaddr_storage socketAddress;
+        socklen_t length;
+        if (!parseLocalAddress(address, socketAddress, length, error)) {
+            return false;
+        }
+        tcp = socketAddress.ss_family == AF_INET;
+        listenFd = socket(socketAddress.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            error = "cannot create socket";
+            return false;
+        }
+        if (tcp) {
+            int on = 1;
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        } else {
+            // A socket file left behind by an earlier server is stale, anything else is not ours to remove
+            struct stat info;
+            if (lstat(address.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+                unlink(address.c_str());
+            }
+        }
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&socketAddress), length) != 0 || ::listen(listenFd, 128) != 0) {
+            error = "cannot listen on " + address + ": " + strerror(errno);
+            return false;
+        }
+        if (!tcp) {
+            socketPath = address;
+        }
+        return true;
+    }
+
+    // Serve until SIGINT or SIGTERM
+    int run() {
+        // Workers must not take the signals meant for the event loop
+        sigset_t signals, previous;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        sigaddset(&signals, SIGUSR1);
+        pthread_sigmask(SIG_BLOCK, &signals, &previous);
+        for (unsigned w = 0; w < threads; ++w) {
+            workers.emplace_back([this]() { work(); });
+        }
+        sigdelset(&signals, SIGUSR1);   // --stats dumps still interrupt the loop
+        sigset_t loopMask = previous;
+        sigaddset(&loopMask, SIGINT);
+        sigaddset(&loopMask, SIGTERM);
+        pthread_sigmask(SIG_SETMASK, &loopMask, nullptr);
+
+        signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (signalFd < 0 || wakeFd < 0 || epollFd < 0) {
+            cerr << "cannot set up the event loop: " << strerror(errno) << "\n";
+            stopWorkers();
+            return 1;
+        }
+        watch(listenFd, LISTENER_TAG, EPOLLIN);
+        watch(wakeFd, WAKE_TAG, EPOLLIN);
+        watch(signalFd, SIGNAL_TAG, EPOLLIN);
+        cerr << "Serving " << planner.metro().compactGraph().stationCount() << " stations on "
+             << (tcp ? "127.0.0.1" : socketPath) << " with " << threads << " worker(s)\n";
+
+        epoll_event events[64];
+        bool stopping = false;
+        while (!stopping) {
+            int ready = epoll_wait(epollFd, events, 64, -1);
+            SearchStats::serviceDump(cerr);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                cerr << "epoll_wait: " << strerror(errno) << "\n";
+                break;
+            }
+            for (int i = 0; i < ready; ++i) {
+                uint64_t tag = events[i].data.u64;
+                if (tag == LISTENER_TAG) {
+                    acceptClients();
+                } else if (tag == WAKE_TAG) {
+                    collectAnswers();
+                } else if (tag == SIGNAL_TAG) {
+                    stopping = true;
+                } else {
+                    serviceClient(tag, events[i].events);
+                }
+            }
+        }
+
+        stopWorkers();
+        cerr << "Answered " << requestsAnswered << " requests on " << connectionsAccepted << " connection(s)\n";
+        return 0;
+    }
+
+    // Answer one request line, appending exactly one response line to out
+    void answer(string_view request, string& out, RouteWorkspace& ws, vector<uint32_t>& path, string& key) const {
+        if (!request.empty() && request.back() == '\r') {
+            request.remove_suffix(1);
+        }
+        size_t space = request.find(' ');
+        string_view command = request.substr(0, space);
+        string_view argument = space == string_view::npos ? string_view() : request.substr(space + 1);
+        if (command == "PING") {
+            out.append("OK\n");
+            return;
+        }
+        if (command == "STATS") {
+            ostringstream json;
+            SearchStats::print(json, true);
+            string text = json.str();
+            out.append("OK ").append(text, 0, text.size() - 1).push_back('\n');
+            return;
+        }
+        if (command != "ROUTE" && command != "FARE" && command != "CHANGES") {
+            out.append("ERR unknown command\n");
+            return;
+        }
+        size_t bar = argument.find('|');
+        if (bar == string_view::npos) {
+            out.append("ERR expected source|destination\n");
+            return;
+        }
+
+        const CompactGraph& compact = planner.metro().compactGraph();
+        uint32_t ends[2];
+        string_view names[2] = {argument.substr(0, bar), argument.substr(bar + 1)};
+        for (int i = 0; i < 2; ++i) {
+            key.assign(names[i].data(), names[i].size());
+            if (!compact.lookup(key, ends[i])) {
+                out.append("ERR unknown station ").append(names[i]).push_back('\n');
+                return;
+            }
+        }
+        int distance = cache ? cache->route(planner, profile, ends[0], ends[1], path, ws)
+                             : planner.route(profile, ends[0], ends[1], path, ws);
+        if (distance == SearchWorkspace::INF) {
+            out.append("ERR no route\n");
+            return;
+        }
+        out.append("OK ").append(formatKm(distance)).append("|");
+        out.append(to_string(static_cast<int>(MetroGraph::calculateFare(distance))));
+        if (command == "ROUTE") {
+            out.push_back('|');
+            for (size_t i = 0; i < path.size(); ++i) {
+                if (i > 0) out.push_back(';');
+                out.append(compact.names[path[i]]);
+            }
+        } else if (command == "CHANGES") {
+            appendLegs(path, out);
+        }
+        out.push_back('\n');
+    }
+
+private:
+    static constexpr uint64_t LISTENER_TAG = 0;
+    static constexpr uint64_t WAKE_TAG = 1;
+    static constexpr uint64_t SIGNAL_TAG = 2;
+    static constexpr size_t CHUNK_LINES = 256;
+    static constexpr size_t MAX_LINE = 64 * 1024;
+    static constexpr uint64_t MAX_CHUNKS_IN_FLIGHT = 64;    // per client, reading pauses beyond this
+    static constexpr size_t MAX_PENDING_OUTPUT = 4 << 20;   // likewise for unsent responses
+
+    // A run of request lines from one client and, once a worker is done, their responses
+    struct Job {
+        uint64_t client;
+        uint64_t sequence;
+        string requests;
+        string responses;
+    };
+
+    struct Client {
+        int fd = -1;
+        string input;                   // bytes after the last complete line
+        string output;
+        size_t written = 0;             // output[0, written) is sent
+        uint64_t nextSequence = 0;      // number of the next chunk handed to the workers
+        uint64_t flushSequence = 0;     // number of the next chunk due on the wire
+        map<uint64_t, string> answered; // chunks finished ahead of flushSequence
+        uint32_t events = 0;
+        bool readClosed = false;
+    };
+
+    const RoutePlanner& planner;
+    RouteProfile profile;
+    RouteCache* cache;
+    unsigned threads;
+    bool tcp = false;
+    string socketPath;
+    int listenFd = -1;
+    int epollFd = -1;
+    int wakeFd = -1;
+    int signalFd = -1;
+    unordered_map<uint64_t, Client> clients;
+    uint64_t nextClient = SIGNAL_TAG + 1;
+    size_t connectionsAccepted = 0;
+    size_t requestsAnswered = 0;
+
+    vector<thread> workers;
+    mutex queueLock;
+    condition_variable queueReady;
+    deque<Job> pending;
+    bool stopped = false;
+    mutex doneLock;
+    vector<Job> done;
+
+    void watch(int fd, uint64_t tag, uint32_t events) {
+        epoll_event event = {};
+        event.events = events;
+        event.data.u64 = tag;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    void work() {
+        RouteWorkspace ws;
+        vector<uint32_t> path;
+        string key;
+        for (;;) {
+            Job job;
+            {
+                unique_lock<mutex> lock(queueLock);
+                queueReady.wait(lock, [this]() { return stopped || !pending.empty(); });
+                if (pending.empty()) {
+                    return;
+                }
+                job = move(pending.front());
+                pending.pop_front();
+            }
+            string_view requests = job.requests;
+            while (!requests.empty()) {
+                size_t end = requests.find('\n');
+                answer(requests.substr(0, end), job.responses, ws, path, key);
+                requests.remove_prefix(end + 1);
+            }
+            bool first;
+            {
+                lock_guard<mutex> lock(doneLock);
+                first = done.empty();
+                done.push_back(move(job));
+            }
+            if (first) {
+                uint64_t one = 1;
+                ssize_t ignored = write(wakeFd, &one, sizeof(one));
+                (void)ignored;
+            }
+        }
+    }
+
+    void stopWorkers() {
+        {
+            lock_guard<mutex> lock(queueLock);
+            stopped = true;
+            pending.clear();
+        }
+        queueReady.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    void acceptClients() {
+        for (;;) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return; // EAGAIN once the backlog is drained
+            }
+            if (tcp) {
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+            uint64_t id = nextClient++;
+            Client& client = clients[id];
+            client.fd = fd;
+            client.events = EPOLLIN;
+            watch(fd, id, EPOLLIN);
+            ++connectionsAccepted;
+        }
+    }
+
+    void serviceClient(uint64_t id, uint32_t events) {
+        auto it = clients.find(id);
+        if (it == clients.end()) {
+            return;
+        }
+        Client& client = it->second;
+        if (events & (EPOLLHUP | EPOLLERR)) {
+            dropClient(it); // nobody left to read the responses
+            return;
+        }
+        if ((events & EPOLLIN) && !readRequests(id, client)) {
+            dropClient(it);
+            return;
+        }
+        if (!flush(client)) {
+            dropClient(it);
+            return;
+        }
+        settle(it);
+    }
+
+    // Read what the client sent and hand every complete line on to the workers
+    bool readRequests(uint64_t id, Client& client) {
+        char buffer[64 * 1024];
+        ssize_t got = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (got == 0) {
+            client.readClosed = true;
+            if (!client.input.empty() && client.input.back() != '\n') {
+                client.input.push_back('\n'); // the last request may come without a newline
+            }
+        } else if (got < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        } else {
+            client.input.append(buffer, static_cast<size_t>(got));
+        }
+
+        size_t complete = client.input.rfind('\n');
+        if (complete == string::npos) {
+            return client.input.size() <= MAX_LINE;
+        }
+        size_t start = 0, lines = 0;
+        vector<Job> jobs;
+        for (size_t at = 0; at <= complete; at = client.input.find('\n', at) + 1) {
+            if (++lines > CHUNK_LINES) {
+                jobs.push_back(Job{0, client.nextSequence++, client.input.substr(start, at - start), string()});
+                start = at;
+                lines = 1;
+            }
+        }
+        jobs.push_back(Job{0, client.nextSequence++, client.input.substr(start, complete + 1 - start), string()});
+        client.input.erase(0, complete + 1);
+
+        {
+            lock_guard<mutex> lock(queueLock);
+            for (Job& job : jobs) {
+                job.client = id;
+                pending.push_back(move(job));
+            }
+        }
+        if (jobs.size() == 1) {
+            queueReady.notify_one();
+        } else {
+            queueReady.notify_all();
+        }
+        return true;
+    }
+
+    // Take the workers' answers and queue them on their clients in sequence
+    void collectAnswers() {
+        uint64_t count;
+        ssize_t ignored = read(wakeFd, &count, sizeof(count));
+        (void)ignored;
+        vector<Job> finished;
+        {
+            lock_guard<mutex> lock(doneLock);
+            finished.swap(done);
+        }
+        for (Job& job : finished) {
+            auto it = clients.find(job.client);
+            if (it == clients.end()) {
+                continue; // client went away while its requests were being answered
+            }
+            Client& client = it->second;
+            requestsAnswered += count_if(job.requests.begin(), job.requests.end(), [](char c) { return c == '\n'; });
+            if (job.sequence == client.flushSequence) {
+                client.output.append(job.responses);
+                ++client.flushSequence;
+                for (auto next = client.answered.begin();
+                     next != client.answered.end() && next->first == client.flushSequence;
+                     next = client.answered.erase(next)) {
+                    client.output.append(next->second);
+                    ++client.flushSequence;
+                }
+            } else {
+                client.answered.emplace(job.sequence, move(job.responses));
+            }
+        }
+        for (Job& job : finished) {
+            auto it = clients.find(job.client);
+            if (it == clients.end()) {
+                continue;
+            }
+            if (!flush(it->second)) {
+                dropClient(it);
+                continue;
+            }
+            settle(it);
+        }
+    }
+
+    // Send as much pending output as the socket takes without blocking
+    bool flush(Client& client) {
+        while (client.written < client.output.size()) {
+            ssize_t sent = send(client.fd, client.output.data() + client.written,
+                                client.output.size() - client.written, MSG_NOSIGNAL);
+            if (sent < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            client.written += static_cast<size_t>(sent);
+        }
+        client.output.clear();
+        client.written = 0;
+        return true;
+    }
+
+    // Close a client that is done, otherwise poll for what it can make progress on next
+    void settle(unordered_map<uint64_t, Client>::iterator it) {
+        Client& client = it->second;
+        bool busy = client.nextSequence != client.flushSequence;
+        bool unsent = client.written < client.output.size();
+        if (client.readClosed && !busy && !unsent) {
+            dropClient(it);
+            return;
+        }
+        bool backlog = client.nextSequence - client.flushSequence >= MAX_CHUNKS_IN_FLIGHT ||
+                       client.output.size() - client.written >= MAX_PENDING_OUTPUT;
+        uint32_t events = (client.readClosed || backlog ? 0u : uint32_t(EPOLLIN)) | (unsent ? uint32_t(EPOLLOUT) : 0u);
+        if (events != client.events) {
+            epoll_event event = {};
+            event.events = events;
+            event.data.u64 = it->first;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, client.fd, &event);
+            client.events = events;
+        }
+    }
+
+    void dropClient(unordered_map<uint64_t, Client>::iterator it) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        close(it->second.fd);
+        clients.erase(it);
+    }
+
+    void closeAll() {
+        for (auto& entry : clients) {
+            close(entry.second.fd);
+        }
+        clients.clear();
+        for (int* fd : {&listenFd, &epollFd, &wakeFd, &signalFd}) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+        if (!socketPath.empty()) {
+            unlink(socketPath.c_str());
+        }
+    }
+
+    // The legs of a path (see routeLegs()), each as its boarding station and line
+    void appendLegs(const vector<uint32_t>& path, string& out) const {
+        const CompactGraph& compact = planner.metro().compactGraph();
+        const LineRegistry& lineNames = planner.metro().lines();
+        static thread_local vector<RouteLeg> legs;
+        routeLegs(compact, path, legs);
+        out.append("|").append(to_string(legs.empty() ? 0 : legs.size() - 1)).append("|");
+        for (size_t i = 0; i < legs.size(); ++i) {
+            if (i > 0) out.push_back(';');
+            out.append(compact.names[path[legs[i].start]]).push_back('@');
+            out.append(legs[i].line < 0 ? string("unknown line") : lineNames.name(legs[i].line));
+        }
+    }
+};
 
-delhiMetro.addEdge("Uttam Nagar West", "Nawada", static_cast<int>(i39), {"Blue Line"});
-delhiMetro.addEdge("Nawada", "Uttam Nagar West", static_cast<int>(i39), {"Blue Line"});
+// Replay a query file against a running server over one pipelined
+// connection: a writer thread streams every request while this thread reads
+// the responses back. Responses go to stdout, throughput to stderr.
+int runClient(const string& address, const string& file, const string& command) {
+    sockaddr_storage socketAddress;
+    socklen_t length;
+    string error;
+    if (!parseLocalAddress(address, socketAddress, length, error)) {
+        cerr << error << "\n";
+        return 1;
+    }
+    MappedFile mapped;
+    string buffered;
+    string_view input;
+    if (file == "-") {
+        buffered.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+        input = buffered;
+    } else {
+        if (!mapped.open(file, error)) {
+            cerr << error << "\n";
+            return 1;
+        }
+        input = mapped.text();
+    }
+    string requests;
+    size_t count = 0;
+    RecordReader reader(input);
+    string_view record;
+    while (reader.next(record)) {
+        requests.append(command).append(" ").append(record).push_back('\n');
+        ++count;
+    }
 
-delhiMetro.addEdge("Nawada", "Dwarka Mor", static_cast<int>(i40), {"Blue Line"});
-delhiMetro.addEdge("Dwarka Mor", "Nawada", static_cast<int>(i40), {"Blue Line"});
+    int fd = socket(socketAddress.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&socketAddress), length) != 0) {
+        cerr << "cannot connect to " << address << ": " << strerror(errno) << "\n";
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    if (socketAddress.ss_family == AF_INET) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
 
-delhiMetro.addEdge("Dwarka Mor", "Dwarka", static_cast<int>(i41), {"Blue Line"});
-delhiMetro.addEdge("Dwarka", "Dwarka Mor", static_cast<int>(i41), {"Blue Line"});
+    auto start = chrono::steady_clock::now();
+    thread writer([&]() {
+        for (size_t at = 0; at < requests.size();) {
+            ssize_t sent = send(fd, requests.data() + at, requests.size() - at, MSG_NOSIGNAL);
+            if (sent <= 0) break;
+            at += static_cast<size_t>(sent);
+        }
+        shutdown(fd, SHUT_WR);
+    });
+    string responses;
+    size_t received = 0;
+    char buffer[64 * 1024];
+    while (received < count) {
+        ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+        if (got <= 0) break;
+        received += count_if(buffer, buffer + got, [](char c) { return c == '\n'; });
+        responses.append(buffer, static_cast<size_t>(got));
+    }
+    double totalMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    writer.join();
+    close(fd);
+
+    cout.write(responses.data(), responses.size());
+    cout.flush();
+    cerr << "Received " << received << " of " << count << " responses in " << totalMs << " ms ("
+         << received / max(totalMs / 1000.0, 1e-9) << " queries/s)\n";
+    return received == count ? 0 : 1;
+}
+
+// Replay a hub-heavy query stream (most queries between a few hundred
+// interchange pairs, Zipf-distributed, the rest uniform) through the route
+// cache on a worker pool, then change the graph and replay it again
+void benchmarkRouteCache(MetroGraph& graph, size_t capacity, unsigned threads) {
+    const CompactGraph& compact = graph.compactGraph();
+    uint32_t n = compact.stationCount();
+    if (n == 0) {
+        return;
+    }
+    // Hubs are the best connected stations
+    vector<uint32_t> hubs(n);
+    for (uint32_t id = 0; id < n; ++id) {
+        hubs[id] = id;
+    }
+    uint32_t hubCount = min<uint32_t>(n, 25);
+    partial_sort(hubs.begin(), hubs.begin() + hubCount, hubs.end(), [&](uint32_t a, uint32_t b) {
+        return compact.offsets[a + 1] - compact.offsets[a] > compact.offsets[b + 1] - compact.offsets[b];
+    });
+    vector<pair<uint32_t, uint32_t>> hubPairs;
+    vector<double> weights;
+    for (uint32_t a = 0; a < hubCount; ++a) {
+        for (uint32_t b = 0; b < hubCount; ++b) {
+            if (a != b) {
+                hubPairs.emplace_back(hubs[a], hubs[b]);
+                weights.push_back(1.0 / (hubPairs.size()));
+            }
+        }
+    }
 
-delhiMetro.addEdge("Dwarka", "Dwarka Sector 14", static_cast<int>(i42), {"Blue Line"});
-delhiMetro.addEdge("Dwarka Sector 14", "Dwarka", static_cast<int>(i42), {"Blue Line"});
+    const size_t QUERIES = 200000;
+    mt19937 random(11);
+    discrete_distribution<size_t> pickPair(weights.begin(), weights.end());
+    uniform_int_distribution<uint32_t> station(0, n - 1);
+    uniform_int_distribution<int> percent(0, 99);
+    vector<pair<uint32_t, uint32_t>> queries(QUERIES);
+    for (auto& query : queries) {
+        query = percent(random) < 80 && !hubPairs.empty() ? hubPairs[pickPair(random)]
+                                                           : make_pair(station(random), station(random));
+    }
 
-delhiMetro.addEdge("Dwarka Sector 14", "Dwarka Sector 13", static_cast<int>(i43), {"Blue Line"});
-delhiMetro.addEdge("Dwarka Sector 13", "Dwarka Sector 14", static_cast<int>(i43), {"Blue Line"});
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+    RoutePlanner planner(graph);
+    auto replay = [&](RouteCache* cache) {
+        atomic<size_t> next(0);
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (unsigned w = 0; w < threads; ++w) {
+            workers.emplace_back([&]() {
+                RouteWorkspace ws;
+                vector<uint32_t> path;
+                const size_t CHUNK = 256;
+                for (size_t begin = next.fetch_add(CHUNK); begin < QUERIES; begin = next.fetch_add(CHUNK)) {
+                    for (size_t q = begin; q < min(QUERIES, begin + CHUNK); ++q) {
+                        if (cache) {
+                            cache->route(planner, ENGINE_DIJKSTRA, queries[q].first, queries[q].second, path, ws);
+                        } else {
+                            planner.route(ENGINE_DIJKSTRA, queries[q].first, queries[q].second, path, ws);
+                        }
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+    RouteCache::Stats before;
+    auto report = [&](const char* label, double ms, const RouteCache* cache) {
+        cout << label << ": " << QUERIES / max(ms / 1000.0, 1e-9) << " queries/s";
+        if (cache) {
+            // Counters are cumulative, report this replay only
+            RouteCache::Stats stats = cache->stats();
+            RouteCache::Stats total = stats;
+            stats.hits -= before.hits;
+            stats.misses -= before.misses;
+            stats.evictions -= before.evictions;
+            stats.stale -= before.stale;
+            before = total;
+            cout << ", " << stats.hits << " hits (" << 100.0 * stats.hits / max<size_t>(stats.hits + stats.misses, 1)
+                 << "%), " << stats.misses << " misses, " << stats.evictions << " evictions, " << stats.stale
+                 << " stale, " << stats.entries << " entries";
+        }
+        cout << "\n";
+    };
+
+    cout << QUERIES << " queries, " << hubPairs.size() << " hub pairs, cache of " << capacity << " routes, "
+         << threads << " thread(s)\n";
+    report("Uncached", replay(nullptr), nullptr);
+    RouteCache cache(capacity);
+    report("Cached", replay(&cache), &cache);
+
+    // Any mutation bumps the version: re-declaring a station is enough
+    uint32_t hub = hubs[0];
+    const Station* declared = graph.findStation(compact.names[hub]);
+    Station copy = declared ? *declared : Station(compact.names[hub], 0, 0);
+    graph.addStation(copy.name, copy.latitude, copy.longitude, copy.metroLines);
+    graph.freeze();
+    report("After addStation()", replay(&cache), &cache);
+
+    // ...and so does a closure, which the next replay routes around
+    vector<EdgeChange> changes;
+    if (compact.offsets[hub + 1] > compact.offsets[hub]) {
+        uint32_t neighbour = compact.targets[compact.offsets[hub]];
+        graph.closeSegment(hub, neighbour, changes);
+        report("After closeSegment()", replay(&cache), &cache);
+        graph.openSegment(hub, neighbour, changes);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // Network files can be overridden anywhere on the command line, the rest selects the mode
+    string stationsFile = "data/stations.txt";
+    string linesFile = "data/lines.txt";
+    unsigned threads = 0;   // 0 = one per core
+    RouteEngine engine = ENGINE_DIJKSTRA;
+    string chFile;          // where the contraction hierarchy is cached between runs
+    int transferPenalty = -1;   // metres charged per line change, -1 = plain shortest distance
+    bool minTransfers = false;
+    bool pareto = false;        // list every distance / line change / fare trade-off
+    string timetableDir;        // GTFS-style timetable for earliest-arrival queries
+    size_t alternatives = 0;    // list this many shortest loopless routes
+    size_t cacheEntries = 0;    // route cache in front of batch queries, 0 = off
+    string aliasesFile = "data/aliases.txt";
+    bool aliasesGiven = false;
+    vector<string> closures;    // "A|B" segments and "A" stations closed for every mode
+    string statsFormat;         // dump search stats as text or json, empty = no dump
+    vector<string> args;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--stations" && i + 1 < argc) {
+            stationsFile = argv[++i];
+        } else if (arg == "--lines" && i + 1 < argc) {
+            linesFile = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = static_cast<unsigned>(stoul(argv[++i]));
+        } else if (arg == "--transfer-penalty" && i + 1 < argc) {
+            transferPenalty = metresFromKm(stod(argv[++i]));
+        } else if (arg == "--min-transfers") {
+            minTransfers = true;
+        } else if (arg == "--aliases" && i + 1 < argc) {
+            aliasesFile = argv[++i];
+            aliasesGiven = true;
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cacheEntries = stoul(argv[++i]);
+        } else if (arg == "--close" && i + 1 < argc) {
+            closures.push_back(argv[++i]);
+        } else if (arg == "--alternatives" && i + 1 < argc) {
+            alternatives = stoul(argv[++i]);
+        } else if (arg == "--timetable" && i + 1 < argc) {
+            timetableDir = argv[++i];
+        } else if (arg == "--pareto") {
+            pareto = true;
+        } else if (arg == "--ch" && i + 1 < argc) {
+            chFile = argv[++i];
+        } else if (arg == "--stats" && i + 1 < argc) {
+            statsFormat = argv[++i];
+            if (statsFormat != "text" && statsFormat != "json") {
+                cerr << "Unknown stats format " << statsFormat << "\n";
+                return 1;
+            }
+        } else if (arg == "--engine" && i + 1 < argc) {
+            if (!parseEngine(argv[++i], engine)) {
+                cerr << "Unknown engine " << argv[i] << "\n";
+                return 1;
+            }
+        } else {
+            args.push_back(arg);
+        }
+    }
+    string mode = args.empty() ? "" : args[0];
+
+    // Search stats go to stderr on the way out of main, and on SIGUSR1 while batch queries run
+    struct StatsDump {
+        string format;
+        ~StatsDump() {
+            if (!format.empty()) {
+                cout.flush();
+                SearchStats::print(cerr, format == "json");
+            }
+        }
+    } statsDump{statsFormat};
+    if (!statsFormat.empty()) {
+        SearchStats::setDumpFormat(statsFormat == "json");
+        signal(SIGUSR1, [](int) { SearchStats::requestDump(); });
+    }
 
-delhiMetro.addEdge("Dwarka Sector 13", "Dwarka Sector 12", static_cast<int>(i44), {"Blue Line"});
-delhiMetro.addEdge("Dwarka Sector 12", "Dwarka Sector 13", static_cast<int>(i44), {"Blue Line"});
+    // A snapshot carries the whole built network, skip construction entirely
+    if (mode == "--snapshot" && args.size() > 1) {
+        return runSnapshotQuery(args[1]);
+    }
+    if (mode == "--client" && args.size() > 1) {
+        return runClient(args[1], args.size() > 2 ? args[2] : "-", args.size() > 3 ? args[3] : "ROUTE");
+    }
+    if (mode == "--generate" && args.size() > 2) {
+        string error;
+        if (!writeSyntheticNetwork(stoul(args[1]), args[2], error)) {
+            cerr << error << "\n";
+            return 1;
+        }
+        cout << "Wrote " << args[2] << "/stations.txt and " << args[2] << "/lines.txt\n";
+        return 0;
+    }
 
-delhiMetro.addEdge("Dwarka Sector 12", "Dwarka Sector 11", static_cast<int>(i45), {"Blue Line"});
-delhiMetro.addEdge("Dwarka Sector 11", "Dwarka Sector 12", static_cast<int>(i45), {"Blue Line"});
+    MetroGraph delhiMetro;
+    LoadReport report;
+    string error;
+    if (!loadNetworkFiles(delhiMetro, stationsFile, linesFile, report, error)) {
+        cerr << error << "\n";
+        return 1;
+    }
 
-delhiMetro.addEdge("Dwarka Sector 11", "Dwarka Sector 10", static_cast<int>(i46), {"Blue Line"});
-delhiMetro.addEdge("Dwarka Sector 10", "Dwarka Sector 11", static_cast<int>(i46), {"Blue Line"});
+    // Network is complete, build the compact search graph
+    delhiMetro.freeze();
+
+    // Closures apply to every search from here on
+    vector<EdgeChange> changed;
+    for (const string& closure : closures) {
+        const CompactGraph& compact = delhiMetro.compactGraph();
+        size_t bar = closure.find('|');
+        uint32_t a, b;
+        bool closed = bar == string::npos
+                          ? compact.lookup(closure, a) && delhiMetro.closeStation(a, changed)
+                          : compact.lookup(closure.substr(0, bar), a) && compact.lookup(closure.substr(bar + 1), b) &&
+                                delhiMetro.closeSegment(a, b, changed);
+        if (!closed) {
+            cerr << "Cannot close " << closure << ": unknown station or stations not adjacent\n";
+            return 1;
+        }
+    }
 
-delhiMetro.addEdge("Dwarka Sector 10", "Dwarka Sector 9", static_cast<int>(i47), {"Blue Line"});
-delhiMetro.addEdge("Dwarka Sector 9", "Dwarka Sector 10", static_cast<int>(i47), {"Blue Line"});
+    if (mode == "--load-report") {
+        printLoadReport(cout, report);
+        printBuildReport(cout, delhiMetro.buildReport());
+        return 0;
+    }
+    if (mode == "--bench") {
+        benchmarkSuite(delhiMetro, stationsFile, linesFile, threads);
+        return 0;
+    }
+    if (mode == "--bench-graph") {
+        benchmarkGraph(delhiMetro);
+        return 0;
+    }
+    if (mode == "--write-snapshot" && args.size() > 1) {
+        if (!writeSnapshot(delhiMetro, args[1], error)) {
+            cerr << error << "\n";
+            return 1;
+        }
+        cout << "Wrote " << delhiMetro.compactGraph().stationCount() << " stations and "
+             << delhiMetro.compactGraph().edgeCount() << " edges to " << args[1] << "\n";
+        return 0;
+    }
+    if (mode == "--all-pairs") {
+        benchmarkAllPairs(delhiMetro, threads);
+        return 0;
+    }
+    if (mode == "--astar") {
+        benchmarkAStar(delhiMetro);
+        return 0;
+    }
+    if (mode == "--compare-engines") {
+        benchmarkEngines(delhiMetro, args.size() > 2 ? args[1] : "Samaypur Badli",
+                         args.size() > 2 ? args[2] : "Escorts Mujesar", threads);
+        return 0;
+    }
 
-delhiMetro.addEdge("Dwarka Sector 9", "Dwarka Sector 8", static_cast<int>(i48), {"Blue Line"});
-delhiMetro.addEdge("Dwarka Sector 8", "Dwarka Sector 9", static_cast<int>(i48), {"Blue Line"});
+    if (mode == "--write-timetable" && args.size() > 1) {
+        if (!writeTimetable(delhiMetro, linesFile, args[1], error)) {
+            cerr << error << "\n";
+            return 1;
+        }
+        cout << "Wrote timetable to " << args[1] << "\n";
+        return 0;
+    }
+    if (mode == "--csa" && args.size() > 1) {
+        return benchmarkTimetable(delhiMetro, args[1]);
+    }
+    if (mode == "--reachable" && args.size() > 2) {
+        // Budget in km, or in rupees when written as Rs40
+        string budget = args[2];
+        bool rupees = budget.compare(0, 2, "Rs") == 0;
+        int metres = rupees ? fareDistanceBudget(stod(budget.substr(budget.find_first_of("0123456789"))))
+                            : metresFromKm(stod(budget));
+        printFareZones(cout, delhiMetro, args[1], metres);
+        return 0;
+    }
+    if (mode == "--fare-atlas") {
+        benchmarkFareAtlas(delhiMetro, args.size() > 1 ? metresFromKm(stod(args[1])) : SearchWorkspace::INF, threads);
+        return 0;
+    }
+    // Other names for stations; the default file is optional
+    vector<pair<string, string>> aliases;
+    if (!loadAliases(aliasesFile, aliases, error) && aliasesGiven) {
+        cerr << error << "\n";
+        return 1;
+    }
+    StationIndex names;
+    names.build(delhiMetro.compactGraph(), aliases);
+    NameWorkspace nameWs;
+    if (mode == "--bench-names") {
+        benchmarkNames(delhiMetro, aliases);
+        return 0;
+    }
+    if (mode == "--complete" && args.size() > 1) {
+        vector<uint32_t> completions;
+        names.complete(args[1], completions, nameWs);
+        for (uint32_t id : completions) {
+            cout << delhiMetro.compactGraph().names[id] << "\n";
+        }
+        return 0;
+    }
+    if (mode == "--cache-bench") {
+        benchmarkRouteCache(delhiMetro, cacheEntries > 0 ? cacheEntries : 4096, threads);
+        return 0;
+    }
+    if ((mode == "--nearest" || mode == "--within") && args.size() > 3) {
+        SpatialIndex spatial;
+        spatial.build(delhiMetro);
+        vector<SpatialMatch> matches;
+        double latitude = stod(args[1]), longitude = stod(args[2]);
+        if (mode == "--nearest") {
+            spatial.nearest(latitude, longitude, stoul(args[3]), matches);
+        } else {
+            spatial.within(latitude, longitude, stod(args[3]), matches);
+        }
+        for (const SpatialMatch& match : matches) {
+            cout << delhiMetro.compactGraph().names[match.station] << " (" << match.km << " km)\n";
+        }
+        return 0;
+    }
+    if (mode == "--bench-spatial") {
+        benchmarkSpatial(delhiMetro);
+        return 0;
+    }
+    if (mode == "--closures") {
+        benchmarkClosures(delhiMetro, threads);
+        return 0;
+    }
+    if (mode == "--bench-queues") {
+        benchmarkQueues(delhiMetro);
+        return 0;
+    }
+    if (mode == "--bench-haversine") {
+        benchmarkHaversine(delhiMetro);
+        return 0;
+    }
+    if (mode == "--k-shortest") {
+        benchmarkKShortest(delhiMetro);
+        return 0;
+    }
+    if (mode == "--transfers") {
+        benchmarkTransfers(delhiMetro, transferPenalty >= 0 ? transferPenalty : 5 * METRES_PER_KM);
+        return 0;
+    }
 
-delhiMetro.addEdge("Dwarka Sector 8", "Dwarka Sector 21", static_cast<int>(i49), {"Blue Line"});
-delhiMetro.addEdge("Dwarka Sector 21", "Dwarka Sector 8", static_cast<int>(i49), {"Blue Line"});
+    RoutePlanner planner(delhiMetro);
+    if (mode == "--build-ch" && args.size() > 1) {
+        ContractionHierarchy hierarchy;
+        hierarchy.build(delhiMetro.compactGraph(), threads);
+        if (!hierarchy.save(args[1], error)) {
+            cerr << error << "\n";
+            return 1;
+        }
+        cout << "Contracted " << delhiMetro.compactGraph().stationCount() << " stations in "
+             << hierarchy.buildTimeMs() << " ms in " << hierarchy.roundCount() << " parallel rounds, "
+             << hierarchy.shortcutCount() << " shortcuts, wrote " << args[1] << "\n";
+        return 0;
+    }
+    if (engine == ENGINE_CH) {
+        planner.prepareContraction(threads, chFile);
+    }
+    RouteProfile profile;
+    profile.engine = engine;
+    profile.objective = minTransfers ? OBJECTIVE_MIN_TRANSFERS : OBJECTIVE_PENALIZED;
+    profile.penalty = transferPenalty;
+    if (mode == "--batch") {
+        if (cacheEntries > 0) {
+            RouteCache cache(cacheEntries);
+            return runBatch(planner, profile, args.size() > 1 ? args[1] : "-", threads, &cache);
+        }
+        return runBatch(planner, profile, args.size() > 1 ? args[1] : "-", threads);
+    }
+    if (mode == "--serve" && args.size() > 1) {
+        RouteCache cache(max<size_t>(cacheEntries, 1));
+        RouteServer server(planner, profile, threads, cacheEntries > 0 ? &cache : nullptr);
+        if (!server.listen(args[1], error)) {
+            cerr << error << "\n";
+            return 1;
+        }
+        return server.run();
+    }
 
     // Example usage: find shortest path and calculate fare
    string source, destination;
@@ -1292,36 +7569,136 @@ delhiMetro.addEdge("Dwarka Sector 21", "Dwarka Sector 8", static_cast<int>(i49),
     cout << "Enter the destination station: ";
     getline(cin, destination);
 
-    auto [path, totalDistance] = delhiMetro.dijkstra(source, destination);
-
-    // Output shortest path with line changes
-    cout << "Shortest path from " << source << " to " << destination << ":\n";
-    for (size_t i = 0; i < path.size(); ++i) {
-        cout << path[i];
-        // Print metro line information and where to change lines (if applicable)
-        if (i < path.size() - 1) {
-            auto currentLines = delhiMetro.getMetroLines(path[i]);
-            auto nextLines = delhiMetro.getMetroLines(path[i + 1]);
-            auto commonLines = delhiMetro.getCommonLines(path[i], path[i + 1]);
-
-            if (!commonLines.empty()) {
-                cout << " (" << commonLines[0] << ")";
-            } else {
-                // Identify the line change and to which line
-                for (const auto& line : currentLines) {
-                    if (find(nextLines.begin(), nextLines.end(), line) == nextLines.end()) {
-                        cout << " [Change to " << nextLines[0] << " Line]";
-                        break;
-                    }
-                }
+    // Resolve typos, case and aliases to the station's own name
+    for (string* typed : {&source, &destination}) {
+        NameMatch match;
+        if (names.resolve(*typed, match, nameWs)) {
+            const string& resolved = delhiMetro.compactGraph().names[match.station];
+            if (resolved != *typed) {
+                cout << "Using \"" << resolved << "\" for \"" << *typed << "\"\n";
             }
-            cout << " -> ";
-        } else {
-            // Print the line of the last station
-            cout << " (" << delhiMetro.getMetroLines(path[i])[0] << ")";
+            *typed = resolved;
+            continue;
+        }
+        vector<NameMatch> suggestions;
+        names.suggest(*typed, suggestions, 3, nameWs);
+        cout << "Unknown station \"" << *typed << "\"";
+        for (size_t i = 0; i < suggestions.size(); ++i) {
+            cout << (i == 0 ? ", did you mean: " : ", ") << delhiMetro.compactGraph().names[suggestions[i].station];
+        }
+        cout << "\n";
+        return 1;
+    }
+
+    const LineRegistry& lineNames = delhiMetro.lines();
+    // Station ids of a route given by name, for routeLegs()
+    auto idsOf = [&](const vector<string>& path) {
+        vector<uint32_t> ids;
+        for (const string& name : path) {
+            ids.push_back(delhiMetro.compactGraph().ids.at(name));
         }
+        return ids;
+    };
+    if (!timetableDir.empty()) {
+        const CompactGraph& compact = delhiMetro.compactGraph();
+        Timetable timetable;
+        TimetableReport loaded;
+        if (!timetable.load(timetableDir, compact, loaded, error)) {
+            cerr << error << "\n";
+            return 1;
+        }
+        string when;
+        cout << "Enter the departure time (HH:MM:SS): ";
+        getline(cin, when);
+        uint32_t from, to, departure;
+        Journey journey;
+        ScanWorkspace ws;
+        if (!parseClock(when, departure)) {
+            cerr << "Bad departure time " << when << "\n";
+            return 1;
+        }
+        if (!compact.lookup(source, from) || !compact.lookup(destination, to) ||
+            !timetable.earliestArrival(from, to, departure, journey, ws)) {
+            cout << "No connection from " << source << " to " << destination << " after " << when << "\n";
+            return 0;
+        }
+        cout << "Earliest arrival from " << source << " to " << destination << ": " << formatClock(journey.arrival)
+             << "\n";
+        printJourney(cout, journey, timetable, compact);
+        return 0;
+    }
+    if (alternatives > 0) {
+        vector<pair<vector<string>, int>> routes = delhiMetro.kShortestPaths(source, destination, alternatives);
+        if (routes.empty()) {
+            cout << "No route from " << source << " to " << destination << "\n";
+            return 0;
+        }
+        cout << routes.size() << " shortest route(s) from " << source << " to " << destination << ":\n";
+        const CompactGraph& compact = delhiMetro.compactGraph();
+        vector<RouteLeg> legs;
+        for (size_t i = 0; i < routes.size(); ++i) {
+            const vector<string>& path = routes[i].first;
+            cout << "\nRoute " << i + 1 << ": " << formatKm(routes[i].second) << " km, Rs. "
+                 << delhiMetro.calculateFare(routes[i].second) << "\n";
+            routeLegs(compact, idsOf(path), legs);
+            printRoute(cout, path, legs, [&](int line) -> const string& { return lineNames.name(line); });
+            cout << "\n";
+        }
+        return 0;
+    }
+    if (pareto) {
+        const CompactGraph& compact = delhiMetro.compactGraph();
+        TransferRouter router(delhiMetro);
+        uint32_t from, to;
+        vector<TransferRoute> options;
+        ParetoWorkspace ws;
+        if (compact.lookup(source, from) && compact.lookup(destination, to)) {
+            router.paretoRoutes(from, to, options, ws);
+        }
+        if (options.empty()) {
+            cout << "No route from " << source << " to " << destination << "\n";
+            return 0;
+        }
+        cout << options.size() << " route option(s) from " << source << " to " << destination << ":\n";
+        for (size_t i = 0; i < options.size(); ++i) {
+            cout << "\nOption " << i + 1 << ": " << formatKm(options[i].distance) << " km, " << options[i].transfers
+                 << " line change(s), Rs. " << delhiMetro.calculateFare(options[i].distance) << "\n";
+            printTransferRoute(cout, options[i], compact, lineNames);
+            cout << "\n";
+        }
+        return 0;
+    }
+    if (transferPenalty >= 0 || minTransfers) {
+        // Search over (station, line) states so the line of every hop is known
+        const CompactGraph& compact = delhiMetro.compactGraph();
+        TransferRouter router(delhiMetro);
+        uint32_t from, to;
+        TransferRoute route;
+        TransferWorkspace ws;
+        if (!compact.lookup(source, from) || !compact.lookup(destination, to) ||
+            !router.route(from, to, minTransfers ? OBJECTIVE_MIN_TRANSFERS : OBJECTIVE_PENALIZED,
+                          transferPenalty, route, ws)) {
+            cout << "No route from " << source << " to " << destination << "\n";
+            return 0;
+        }
+        cout << (minTransfers ? "Fewest line changes" : "Best route") << " from " << source << " to "
+             << destination << ":\n";
+        printTransferRoute(cout, route, compact, lineNames);
+        cout << "\nTotal distance: " << formatKm(route.distance) << " km\n";
+        cout << "Line changes: " << route.transfers << "\n";
+        cout << "Fare: Rs. " << delhiMetro.calculateFare(route.distance) << "\n";
+        return 0;
     }
-    cout << "\nTotal distance: " << totalDistance << " km\n";
+
+    RouteWorkspace ws;
+    auto [path, totalDistance] = planner.route(engine, source, destination, ws);
+
+    // Output shortest path with line changes
+    cout << "Shortest path from " << source << " to " << destination << ":\n";
+    vector<RouteLeg> legs;
+    routeLegs(delhiMetro.compactGraph(), idsOf(path), legs);
+    printRoute(cout, path, legs, [&](int line) -> const string& { return lineNames.name(line); });
+    cout << "\nTotal distance: " << formatKm(totalDistance) << " km\n";
 
     // Calculate fare
     double fare = delhiMetro.calculateFare(totalDistance);